@@ -50,6 +50,10 @@ bvector_create(uint64_t length)
 void
 bvector_free(bvector_t *bvector)
 {
+    if (!bvector) {
+        return;
+    }
+
     free(bvector->vector);
     free(bvector);
 }
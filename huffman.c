@@ -15,9 +15,25 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
 #include "huffman_element.h"
 #include "huffman_list.h"
 #include "huffman_tree.h"
+#include "huffman_code.h"
+#include "huffman_stream.h"
+#include "huffman_parallel.h"
+#include "huffman_header.h"
+#include "huffman_block.h"
+#include "huffman_index.h"
+#include "huffman_pipeline.h"
+#include "huffman_direct.h"
+#include "huffman_splice.h"
+#include "huffman_pool.h"
+#include "huffman_io.h"
 #include "bit_vector.h"
 
 /* Debug Macro */
@@ -27,9 +43,43 @@
         printf(format " [%d: %s]\n",##__VA_ARGS__,             \
         errno,                                                 \
         strerror(errno));                                      \
-        return errno;                                          \
+        return errno ? errno : -1;                             \
     } while(0)
 
+/* Debug Macro which leaves through the clean up at done */
+#define ERROR_DEBUG_DONE(format, ...)                          \
+    do {                                                       \
+        printf(format " [%d: %s]\n",##__VA_ARGS__,             \
+        errno,                                                 \
+        strerror(errno));                                      \
+        ret = errno ? errno : -1;                              \
+        goto done;                                             \
+    } while(0)
+
+/*
+ * The beginning of a file is read in a single call when decoding.
+ * This is enough to hold the container header along with the largest
+ * tree of any version, or the tree of a file from before the header.
+ */
+#define HUFFMAN_PREFIX_SIZE     (HEADER_MAX_SIZE + TREE_INPUT_MAX_SIZE)
+
+/*
+ * Test mode decodes into a scratch buffer of this size over and
+ * over again instead of an output sized buffer.
+ */
+#define HUFFMAN_SCRATCH_SIZE    (1U << 16)
+
+/* This is the file name which stands for standard input or output */
+#define STANDARD_STREAM_NAME    "-"
+
+/*
+ * In batch mode every file is encoded into a file with this suffix
+ * added, and decoded into a file with it taken off again, or with
+ * the second suffix added to a file which does not have it.
+ */
+#define HUFFMAN_SUFFIX          ".huf"
+#define HUFFMAN_DECODED_SUFFIX  ".out"
+
 /*
  * This enumeration is used to maintain all the flags which are
  * supported for this program. The last flag is simply used to hold
@@ -43,6 +93,23 @@ enum huffman_flags {
     FLAG_HELP,
     FLAG_INPUT,
     FLAG_OUTPUT,
+    FLAG_STREAMS,
+    FLAG_WIDE,
+    FLAG_SCALAR,
+    FLAG_THREADS,
+    FLAG_TEST,
+    FLAG_BLOCKS,
+    FLAG_CHECKSUM,
+    FLAG_INDEX,
+    FLAG_RANGE,
+    FLAG_APPEND,
+    FLAG_PIPELINE,
+    FLAG_URING,
+    FLAG_DIRECT,
+    FLAG_OVERLAP,
+    FLAG_SPLICE,
+    FLAG_SIZED,
+    FLAG_BATCH,
     FLAG_LENGTH
 };
 bvector_t *flags;
@@ -51,6 +118,42 @@ bvector_t *flags;
 char *input_filename = NULL;
 char *output_filename = NULL;
 
+/* The file list or directory of the files to work on in batch mode */
+char *batch_name = NULL;
+
+/* The number of threads to use */
+int thread_count = 1;
+
+/* The number of elements in every block of the block format */
+uint32_t block_size = BLOCK_DEFAULT_SIZE;
+
+/* The part of the original file to decode with the index */
+uint64_t range_offset = 0;
+uint64_t range_length = 0;
+
+/* The number of blocks going around the encoding pipeline */
+uint32_t pipeline_depth = PIPELINE_DEFAULT_DEPTH;
+
+/*
+ * This structure holds how far the block file being written has
+ * got, for the function which writes every encoded block. With
+ * direct I/O the blocks are written through a window. When stored
+ * blocks are passed through, their bodies are copied from where
+ * they are in the input inside the kernel.
+ */
+typedef struct huffman_writer {
+    int out_fd;
+    hdirect_t *direct;
+    hsplice_t *splice;
+    int in_fd;
+    uint64_t in_offset;
+    hindex_t *index;
+    uint64_t offset;
+    uint64_t original_length;
+    uint32_t checksum;
+    uint32_t table;
+} hwriter_t;
+
 /**
  * This function is used to print the usage of this
  * program including all the supported flags and correct
@@ -62,12 +165,32 @@ void
 print_usage(int retval)
 {
     printf("Usage: huffman [opt] -i [input_file] -o [output_file]\n");
-    printf("    -i: Input File Name\n");
-    printf("    -o: Output File Name\n");
+    printf("       huffman [opt] -t -i [input_file]\n");
+    printf("       huffman [opt] -m [file_list | directory] [-o output_directory]\n");
+    printf("    -i: Input File Name, - For Standard Input\n");
+    printf("    -o: Output File Name, - For Standard Output\n");
     printf("    -e: Encode The Input File\n");
     printf("    -d: Decode The Input File\n");
     printf("    -a: Perform Compression in ASCII\n");
     printf("    -p: Print The Encode String\n");
+    printf("    -s: Use Interleaved Streams\n");
+    printf("    -w: Use Eight Interleaved Streams\n");
+    printf("    -b: Compress Into Independent Blocks\n");
+    printf("    -k: Block Size In KiB (128 To 4096)\n");
+    printf("    -c: Add Checksums To Every Block\n");
+    printf("    -x: Add An Index Of The Blocks To The End\n");
+    printf("    -g: Decode Only [offset],[length] Using The Index\n");
+    printf("    -u: Append Blocks To The End Of The Output File\n");
+    printf("    -q: Read, Encode And Write Blocks In A Pipeline Of Depth (2 To 64)\n");
+    printf("    -l: Read And Write The Pipeline Through io_uring Where Available\n");
+    printf("    -n: Read And Write Blocks With Direct I/O Around The Page Cache\n");
+    printf("    -v: Prepare The Next Block While Packing The Current One On Two Threads\n");
+    printf("    -z: Copy Stored Blocks Inside The Kernel Without Reading Them In\n");
+    printf("    -f: Size Blocks Up Front, Preallocate Them And Write Them From Every Thread\n");
+    printf("    -m: Work On Every File In A List Or Directory, - For A List On Standard Input\n");
+    printf("    -r: Decode With The Reference Scalar Decoder\n");
+    printf("    -j: Number Of Threads To Use\n");
+    printf("    -t: Test The Input File Without Writing Output\n");
     printf("    -h: Print This Help Message\n");
 
     exit(retval);
@@ -85,13 +208,15 @@ print_usage(int retval)
 int
 set_flags(int count, char **arg_val)
 {
+    unsigned long kibibytes;
+    char *end;
     int opt_option;
 
     /* Suppress getopt warnings */
     opterr = 0;
 
     /* Acquire the flags */
-    while ((opt_option = getopt(count, arg_val, "i:o:aphed")) != -1) {
+    while ((opt_option = getopt(count, arg_val, "i:o:j:k:g:q:m:aphedswrtbcxulnvzf")) != -1) {
         switch(opt_option) {
             case 'i':
                 /* Confirm that flag has not been set before */
@@ -137,6 +262,97 @@ set_flags(int count, char **arg_val)
             case 'p':
                 bvector_set_bit(flags, FLAG_PRINT);
                 break;
+            case 's':
+                bvector_set_bit(flags, FLAG_STREAMS);
+                break;
+            case 'w':
+                bvector_set_bit(flags, FLAG_STREAMS);
+                bvector_set_bit(flags, FLAG_WIDE);
+                break;
+            case 'r':
+                bvector_set_bit(flags, FLAG_SCALAR);
+                break;
+            case 'b':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                break;
+            case 'c':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_CHECKSUM);
+                break;
+            case 'x':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_INDEX);
+                break;
+            case 'q':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_PIPELINE);
+                pipeline_depth = strtoul(optarg, NULL, 10);
+                if (pipeline_depth < PIPELINE_MIN_DEPTH || pipeline_depth > PIPELINE_MAX_DEPTH) {
+                    printf("[FLAGS] Pipeline Depth Out Of Range {-q %s}\n\n", optarg);
+                    return -14;
+                }
+                break;
+            case 'l':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_PIPELINE);
+                bvector_set_bit(flags, FLAG_URING);
+                break;
+            case 'n':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_DIRECT);
+                break;
+            case 'v':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_OVERLAP);
+                break;
+            case 'z':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_SPLICE);
+                break;
+            case 'f':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_SIZED);
+                break;
+            case 'm':
+                bvector_set_bit(flags, FLAG_BATCH);
+                batch_name = optarg;
+                break;
+            case 'u':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                bvector_set_bit(flags, FLAG_APPEND);
+                break;
+            case 'g':
+                bvector_set_bit(flags, FLAG_RANGE);
+                if (sscanf(optarg, "%llu,%llu", (unsigned long long*)&range_offset,
+                           (unsigned long long*)&range_length) != 2) {
+                    printf("[FLAGS] Range Must Be An Offset And A Length {-g %s}\n\n", optarg);
+                    return -12;
+                }
+                break;
+            case 'k':
+                bvector_set_bit(flags, FLAG_BLOCKS);
+                /* The size is checked in KiB, before it can wrap around */
+                errno = 0;
+                kibibytes = strtoul(optarg, &end, 10);
+                if (errno || end == optarg || *end || kibibytes < BLOCK_MIN_SIZE / 1024 ||
+                    kibibytes > BLOCK_MAX_SIZE / 1024) {
+                    printf("[FLAGS] Block Size Out Of Range {-k %s}\n\n", optarg);
+                    return -11;
+                }
+                block_size = kibibytes * 1024;
+                break;
+            case 't':
+                bvector_set_bit(flags, FLAG_TEST);
+                bvector_set_bit(flags, FLAG_DECODE);
+                break;
+            case 'j':
+                bvector_set_bit(flags, FLAG_THREADS);
+                thread_count = atoi(optarg);
+                if (thread_count < 1) {
+                    printf("[FLAGS] Thread Count Must Be Positive {-j %s}\n\n", optarg);
+                    return -9;
+                }
+                break;
             case 'h':
                 print_usage(0);
                 break;
@@ -151,6 +367,21 @@ set_flags(int count, char **arg_val)
                 } else if (optopt == 'o') {
                     printf("[FLAGS] Need To Specify Output Filename {-o}\n\n");
                     return -2;
+                } else if (optopt == 'j') {
+                    printf("[FLAGS] Need To Specify Thread Count {-j}\n\n");
+                    return -9;
+                } else if (optopt == 'k') {
+                    printf("[FLAGS] Need To Specify Block Size {-k}\n\n");
+                    return -11;
+                } else if (optopt == 'q') {
+                    printf("[FLAGS] Need To Specify Pipeline Depth {-q}\n\n");
+                    return -14;
+                } else if (optopt == 'g') {
+                    printf("[FLAGS] Need To Specify Range {-g}\n\n");
+                    return -12;
+                } else if (optopt == 'm') {
+                    printf("[FLAGS] Need To Specify File List Or Directory {-m}\n\n");
+                    return -19;
                 } else {
                     printf("[FLAGS] Unknown Flag Given {-%c}\n", optopt);
                     return -5;
@@ -171,12 +402,121 @@ set_flags(int count, char **arg_val)
         }
     }
 
+    /* Appending only ever encodes */
+    if (bvector_check_bit(flags, FLAG_APPEND) == VECTOR_BIT_SET &&
+        bvector_check_bit(flags, FLAG_DECODE) == VECTOR_BIT_SET) {
+        printf("[FLAGS] Append Flag Cannot Be Used With Decode {-u}\n\n");
+        return -13;
+    }
+
+    /* The pipeline writes blocks where they go without a direct window */
+    if (bvector_check_bit(flags, FLAG_DIRECT) == VECTOR_BIT_SET &&
+        bvector_check_bit(flags, FLAG_PIPELINE) == VECTOR_BIT_SET) {
+        printf("[FLAGS] Direct Flag Cannot Be Used With The Pipeline {-n}\n\n");
+        return -15;
+    }
+
+    /* The pipeline has an encoder loop of its own */
+    if (bvector_check_bit(flags, FLAG_OVERLAP) == VECTOR_BIT_SET &&
+        bvector_check_bit(flags, FLAG_PIPELINE) == VECTOR_BIT_SET) {
+        printf("[FLAGS] Overlap Flag Cannot Be Used With The Pipeline {-v}\n\n");
+        return -16;
+    }
+
+    /* Stored blocks are copied between the files as they are in the page cache */
+    if (bvector_check_bit(flags, FLAG_SPLICE) == VECTOR_BIT_SET &&
+        (bvector_check_bit(flags, FLAG_PIPELINE) == VECTOR_BIT_SET ||
+         bvector_check_bit(flags, FLAG_DIRECT) == VECTOR_BIT_SET)) {
+        printf("[FLAGS] Zero Copy Flag Cannot Be Used With The Pipeline Or Direct I/O {-z}\n\n");
+        return -17;
+    }
+
+    /* Sized blocks are written by a loop of their own, straight from every thread */
+    if (bvector_check_bit(flags, FLAG_SIZED) == VECTOR_BIT_SET &&
+        (bvector_check_bit(flags, FLAG_PIPELINE) == VECTOR_BIT_SET ||
+         bvector_check_bit(flags, FLAG_OVERLAP) == VECTOR_BIT_SET ||
+         bvector_check_bit(flags, FLAG_DIRECT) == VECTOR_BIT_SET ||
+         bvector_check_bit(flags, FLAG_SPLICE) == VECTOR_BIT_SET)) {
+        printf("[FLAGS] Sized Flag Cannot Be Used With The Pipeline, Overlap, Direct I/O Or Zero Copy {-f}\n\n");
+        return -18;
+    }
+
+    /* A range is only ever decoded and written out */
+    if (bvector_check_bit(flags, FLAG_RANGE) == VECTOR_BIT_SET) {
+        if (bvector_check_bit(flags, FLAG_DECODE) == VECTOR_BIT_OFF ||
+            bvector_check_bit(flags, FLAG_TEST) == VECTOR_BIT_SET) {
+            printf("[FLAGS] Range Flag Can Only Be Used With Decode {-g}\n\n");
+            return -12;
+        }
+    }
+
+    /* Test mode only decodes, whether on one file or a batch */
+    if (bvector_check_bit(flags, FLAG_TEST) == VECTOR_BIT_SET &&
+        bvector_check_bit(flags, FLAG_ENCODE) == VECTOR_BIT_SET) {
+        printf("[FLAGS] Test Flag Cannot Be Used With Encode {-t}\n\n");
+        return -10;
+    }
+
+    /*
+     * Batch mode names its own inputs and outputs, and only ever
+     * encodes blocks, which never read a file by its name.
+     */
+    if (bvector_check_bit(flags, FLAG_BATCH) == VECTOR_BIT_SET) {
+        if (input_filename != NULL) {
+            printf("[FLAGS] Input Flag Cannot Be Used With Batch {-m}\n\n");
+            return -19;
+        } else if (output_filename != NULL && !strcmp(output_filename, STANDARD_STREAM_NAME)) {
+            printf("[FLAGS] Batch Output Must Be A Directory {-o %s}\n\n", output_filename);
+            return -19;
+        } else if (bvector_check_bit(flags, FLAG_APPEND) == VECTOR_BIT_SET ||
+                   bvector_check_bit(flags, FLAG_RANGE) == VECTOR_BIT_SET) {
+            printf("[FLAGS] Append And Range Flags Cannot Be Used With Batch {-m}\n\n");
+            return -19;
+        }
+
+        if (bvector_check_bit(flags, FLAG_ENCODE) == VECTOR_BIT_SET) {
+            bvector_set_bit(flags, FLAG_BLOCKS);
+        }
+        return 0;
+    }
+
+    /* Test mode never writes any output */
+    if (bvector_check_bit(flags, FLAG_TEST) == VECTOR_BIT_SET) {
+        if (input_filename == NULL) {
+            printf("[FLAGS] Input Filename Not Set {Use Flags: -i}\n\n");
+            return -8;
+        }
+        return 0;
+    }
+
     /* We need to confirm that both input and out filenames are set */
     if (input_filename == NULL || output_filename == NULL) {
         printf("[FLAGS] Either Input or Output Filename Not Set {Use Flags: -i | -o}\n\n");
         return -8;
     }
 
+    /* Whatever -p prints would end up mixed into the output */
+    if (bvector_check_bit(flags, FLAG_PRINT) == VECTOR_BIT_SET &&
+        !strcmp(output_filename, STANDARD_STREAM_NAME)) {
+        printf("[FLAGS] Print Flag Cannot Be Used With Standard Output {-p}\n\n");
+        return -20;
+    }
+
+    /*
+     * Only blocks are encoded in one pass without seeking, so they are
+     * what a standard stream is encoded with. The other engines read
+     * their input twice and are refused rather than replaced.
+     */
+    if (bvector_check_bit(flags, FLAG_ENCODE) == VECTOR_BIT_SET &&
+        (!strcmp(input_filename, STANDARD_STREAM_NAME) || !strcmp(output_filename, STANDARD_STREAM_NAME))) {
+        if (bvector_check_bit(flags, FLAG_ASCII) == VECTOR_BIT_SET ||
+            bvector_check_bit(flags, FLAG_STREAMS) == VECTOR_BIT_SET) {
+            printf("[FLAGS] ASCII And Stream Flags Cannot Be Used With Standard Streams {-a | -s | -w}\n\n");
+            return -21;
+        }
+        bvector_set_bit(flags, FLAG_BLOCKS);
+    }
+
     return 0;
 }
 
@@ -214,6 +554,155 @@ array_append(uint8_t *dest, uint64_t *dest_length, uint8_t *src, uint64_t src_le
     return dest;
 }
 
+/**
+ * This function is used to read an entire file into memory. The
+ * buffer is allocated once when the size of the file is known and
+ * it is readable and zeroed for padding bytes past its end.
+ *
+ * @param fd The file to read
+ * @param length The length of the file
+ * @param padding The number of bytes to leave past the end
+ * @return The buffer or NULL
+ */
+uint8_t*
+read_file(int fd, uint64_t *length, uint64_t padding)
+{
+    struct stat file_stat;
+    uint64_t capacity;
+    uint8_t *buffer, *temp;
+    ssize_t bytes_read;
+
+    /* Pipes and other files without a size are grown as they are read */
+    capacity = 1 << 16;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        capacity = file_stat.st_size;
+    }
+
+    buffer = malloc(capacity + padding);
+    if (!buffer) {
+        return NULL;
+    }
+
+    *length = 0;
+    while ((bytes_read = hio_read(fd, buffer + *length, capacity - *length)) > 0) {
+        *length += bytes_read;
+        if (*length == capacity) {
+            capacity *= 2;
+            temp = realloc(buffer, capacity + padding);
+            if (!temp) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = temp;
+        }
+    }
+
+    if (bytes_read < 0) {
+        free(buffer);
+        return NULL;
+    }
+
+    memset(buffer + *length, 0, padding);
+    return buffer;
+}
+
+/**
+ * This function is used to read part of a file at an offset,
+ * through a direct window when there is one. A pipe cannot seek,
+ * so there the next bytes are read, which are at the offset as
+ * long as the file is read in order.
+ *
+ * @param fd The file to read
+ * @param direct The direct window over the file or NULL
+ * @param buffer The buffer to read into
+ * @param size The number of bytes to read
+ * @param offset The offset in the file
+ * @return The number of bytes read or an error
+ */
+ssize_t
+read_at(int fd, hdirect_t *direct, uint8_t *buffer, uint64_t size, uint64_t offset)
+{
+    ssize_t bytes_read;
+
+    if (direct) {
+        return hdirect_read(direct, buffer, size, offset);
+    }
+
+    bytes_read = hio_pread(fd, buffer, size, offset);
+    if (bytes_read < 0 && errno == ESPIPE) {
+        return hio_read(fd, buffer, size);
+    }
+    return bytes_read;
+}
+
+/**
+ * This function is used to write a buffer into a file at an
+ * offset. A pipe cannot seek, so there the buffer is written next,
+ * which is at the offset as long as the file is written in order.
+ *
+ * @param fd The file to write
+ * @param buffer The buffer to write from
+ * @param size The number of bytes to write
+ * @param offset The offset in the file
+ * @return The number of bytes written or -1
+ */
+ssize_t
+write_at(int fd, const uint8_t *buffer, uint64_t size, uint64_t offset)
+{
+    int ret;
+
+    ret = hio_pwrite(fd, buffer, size, offset);
+    if (ret && errno == ESPIPE) {
+        ret = hio_write(fd, buffer, size);
+    }
+    return ret ? -1 : (ssize_t)size;
+}
+
+/**
+ * This function is used to free an element along with every element
+ * below it. This function is not presented as an interface function.
+ *
+ * @param element The element to free
+ */
+static void
+_free_element(helement_t *element)
+{
+    if (element->left_child) {
+        _free_element(element->left_child);
+    }
+
+    if (element->right_child) {
+        _free_element(element->right_child);
+    }
+
+    helement_free(element);
+}
+
+/**
+ * This function is used to free the elements which are still held
+ * by a distribution list when the tree never received its root. The
+ * list itself is not free'd. This function is not presented as an
+ * interface function.
+ *
+ * @param distribution_list The list holding the elements
+ */
+static void
+_free_distribution(hlist_t *distribution_list)
+{
+    helement_t *element, *next;
+
+    if (!distribution_list) {
+        return;
+    }
+
+    for (element = distribution_list->list; element; element = next) {
+        next = element->next;
+        _free_element(element);
+    }
+    distribution_list->list = NULL;
+    distribution_list->count = 0;
+}
+
 /**
  * This function is used to perform huffman coding onto a file to compress
  * it. It can only be decompressed using this program and nothing else.
@@ -236,9 +725,16 @@ huffman_encode(int in_fd, int out_fd)
     ssize_t ret, offset;
     ssize_t bytes_read;
     ssize_t bytes_written;
+    ssize_t size_to_write;
+    uint64_t original_length;
+    uint64_t opcode_count;
     hlist_t *distribution_list;
     htree_t *distribution_tree;
+    hheader_t *header;
     helement_t *temp_ptr;
+    uint8_t prefix[HEADER_MIN_SIZE + TREE_PACK_MAX_SIZE];
+    struct iovec output[3];
+    int output_count;
 
     /*
      * We need to create a distribution list which maintains the frequency
@@ -250,40 +746,62 @@ huffman_encode(int in_fd, int out_fd)
     int8_t ascii_set = bvector_check_bit(flags, FLAG_ASCII);
     int8_t print_set = bvector_check_bit(flags, FLAG_PRINT);
 
+    another_input_fd = -1;
+    ascii_opcodes = NULL;
+    ascii_opcode_table = NULL;
+    vector_opcodes = NULL;
+    vector_opcode_table = NULL;
+    distribution_tree = NULL;
+    header = NULL;
+
     distribution_list = hlist_create();
     if (!distribution_list) {
-        ERROR_DEBUG("Error On Create {distribution_list}");
+        ERROR_DEBUG_DONE("Error On Create {distribution_list}");
     }
 
     /* We build the distribution by reading in byte by byte */
+    original_length = 0;
     while ((bytes_read = read(in_fd, &element, sizeof(uint8_t))) > 0) {
         temp_ptr = hlist_add_increment_element(distribution_list, element, SPECIAL_ELEMENT_FREQUENCY);
         if (!temp_ptr) {
-            ERROR_DEBUG("Error On Add/Increment {distribution_list: %u}", element);
+            ERROR_DEBUG_DONE("Error On Add/Increment {distribution_list: %u}", element);
         }
+        original_length += 1;
     }
     close(in_fd);
 
+    /*
+     * A tree needs at least two leaf nodes for every element to have
+     * an opcode. When only one element appears, a second one which
+     * never appears is added next to it.
+     */
+    if (distribution_list->count == 1) {
+        temp_ptr = hlist_add_element(distribution_list, element ^ 0x1, SPECIAL_ELEMENT_FREQUENCY);
+        if (!temp_ptr) {
+            ERROR_DEBUG_DONE("Error On Add {distribution_list: %u}", element ^ 0x1);
+        }
+    }
+
     /*
      * We traverse the list and acquire the two minimum elements in the
      * list and then we create a node with the combined frquency of the
      * two and add it back to the list. We then connect this new node with
      * its children.
      */
-    helement_t *parent, *min_first, *min_second;
+    helement_t *parent = NULL, *min_first, *min_second;
     while ((ret = hlist_get_two_min(distribution_list, &min_first, &min_second)) >= 0) {
         uint64_t combined_frequency = min_first->frequency + min_second->frequency;
 
         /* Add node to the list */
         parent = hlist_add_increment_element(distribution_list, LIST_SPECIAL_ELEMENT, combined_frequency);
         if (!parent) {
-            ERROR_DEBUG("Error On Add/Increment {distribution_list, frequency: %llu}", combined_frequency);
+            ERROR_DEBUG_DONE("Error On Add/Increment {distribution_list, frequency: %llu}", combined_frequency);
         }
 
         /* Connect element with its children */
         ret = htree_connect(parent, min_first, min_second);
         if (ret) {
-            ERROR_DEBUG("Error On Connection {parent, error: %ld}", ret);
+            ERROR_DEBUG_DONE("Error On Connection {parent, error: %ld}", ret);
         }
     }
 
@@ -295,24 +813,23 @@ huffman_encode(int in_fd, int out_fd)
      */
     distribution_tree = htree_create();
     if (!distribution_tree) {
-        ERROR_DEBUG("Error On Create {distribution_tree}");
+        ERROR_DEBUG_DONE("Error On Create {distribution_tree}");
     }
 
     /* Add the root element */
     temp_ptr = htree_add_element(distribution_tree, parent);
     if (!temp_ptr) {
-        ERROR_DEBUG("Error On Add {distribution_tree: parent}");
+        ERROR_DEBUG_DONE("Error On Add {distribution_tree: parent}");
     }
 
     /*
      * Parse the tree for the opcodes and then copy them over to
      * form vector opcodes as well
      */
-    ascii_opcodes = NULL;
     ascii_opcodes_size = 0;
     ascii_opcode_table = htree_parse(distribution_tree);
     if (!ascii_opcode_table) {
-        ERROR_DEBUG("Error On Parse {distribution_tree: ascii_opcode_table}");
+        ERROR_DEBUG_DONE("Error On Parse {distribution_tree: ascii_opcode_table}");
     }
 
     /* Form vector opcodes if ASCII mode is not set */
@@ -320,12 +837,12 @@ huffman_encode(int in_fd, int out_fd)
         /* This is used to concatenate all opcodes later */
         vector_opcodes = bvector_create(1);
         if (!vector_opcodes) {
-            ERROR_DEBUG("Error On Create {vector_opcodes: %llu}", (uint64_t)1);
+            ERROR_DEBUG_DONE("Error On Create {vector_opcodes: %llu}", (uint64_t)1);
         }
 
         vector_opcode_table = malloc(sizeof(bvector_t *) * TREE_MAX_TABLE_SIZE);
         if (!vector_opcode_table) {
-            ERROR_DEBUG("Error On Malloc {vector_opcode_table}");
+            ERROR_DEBUG_DONE("Error On Malloc {vector_opcode_table}");
         }
 
         int i;
@@ -339,21 +856,45 @@ huffman_encode(int in_fd, int out_fd)
             if (ascii_opcode_table[i]) {
                 vector_opcode_table[i] = bvector_convert(ascii_opcode_table[i]);
                 if (!vector_opcode_table[i]) {
-                    ERROR_DEBUG("Error On Convert {vector_opcode_table: %d}", i);
+                    ERROR_DEBUG_DONE("Error On Convert {vector_opcode_table: %d}", i);
                 }
             }
         }
     }
 
     /*
-     * We output the tree onto the output file since this tree will be
-     * needed during decompression. We get back an offset at which
-     * we can begin writing the opcodes.
+     * The container header records the mode, the original length and
+     * the longest opcode so that the decoder knows all of it up front.
      */
-    offset = htree_output(distribution_tree, out_fd, 0);
+    header = hheader_create();
+    if (!header) {
+        ERROR_DEBUG_DONE("Error On Create {header}");
+    }
+
+    header->engine = HEADER_ENGINE_TREE;
+    header->flags = (ascii_set == VECTOR_BIT_SET) ? HEADER_FLAG_ASCII : 0;
+    header->original_length = original_length;
+    for (int i = 0; i < TREE_MAX_TABLE_SIZE; i++) {
+        if (ascii_opcode_table[i] && strlen(ascii_opcode_table[i]) > header->code_limit) {
+            header->code_limit = strlen(ascii_opcode_table[i]);
+        }
+    }
+
+    offset = hheader_pack(header, prefix, sizeof(prefix));
     if (offset < 0) {
-        ERROR_DEBUG("Error On Output {distribution_tree: %ld}", offset);
+        ERROR_DEBUG_DONE("Error On Pack {header: %ld}", offset);
+    }
+
+    /*
+     * The tree is needed during decompression, so it is packed right
+     * after the header. Both are written out along with the opcodes
+     * once the opcodes are ready.
+     */
+    ret = htree_pack(distribution_tree, prefix + offset, sizeof(prefix) - offset);
+    if (ret < 0) {
+        ERROR_DEBUG_DONE("Error On Pack {distribution_tree: %ld}", ret);
     }
+    offset += ret;
 
     /*
      * Now, we need to read in the input file again and this time for each element we
@@ -361,7 +902,7 @@ huffman_encode(int in_fd, int out_fd)
      */
     another_input_fd = open(input_filename, O_RDONLY);
     if (another_input_fd < 0) {
-        ERROR_DEBUG("Error On Open {another_input_fd: %d}", another_input_fd);
+        ERROR_DEBUG_DONE("Error On Open {another_input_fd: %d}", another_input_fd);
     }
 
     /* Begin Reading */
@@ -384,39 +925,131 @@ huffman_encode(int in_fd, int out_fd)
     }
 
     /*
-     * Write out the opcodes to the file depending on the flag which
-     * was passed in by the user.
+     * Write out the header, the tree and the opcodes to the file in
+     * a single call. The opcode vector is laid out the way
+     * bvector_output would write it, its size and then its bytes.
      */
+    output[0].iov_base = prefix;
+    output[0].iov_len = offset;
     if (ascii_set == VECTOR_BIT_OFF) {
-        /* Write the opcode vector onto the file */
-        bvector_output(vector_opcodes, out_fd, offset, VECTOR_FLAG_STREAM);
+        opcode_count = bvector_get_size(vector_opcodes, VECTOR_FLAG_STREAM);
+        output[1].iov_base = &opcode_count;
+        output[1].iov_len = sizeof(opcode_count);
+        output[2].iov_base = vector_opcodes->vector;
+        output[2].iov_len = (opcode_count / VECTOR_BYTE_SIZE) + 1;
+        output_count = 3;
+    } else {
+        output[1].iov_base = ascii_opcodes;
+        output[1].iov_len = ascii_opcodes_size;
+        output_count = 2;
+    }
+
+    size_to_write = 0;
+    for (int i = 0; i < output_count; i++) {
+        size_to_write += output[i].iov_len;
+    }
 
+    bytes_written = pwritev(out_fd, output, output_count, 0);
+    if (bytes_written < size_to_write) {
+        ERROR_DEBUG_DONE("Error On Write {out_fd: %d}", out_fd);
+    }
+
+    if (ascii_set == VECTOR_BIT_OFF) {
         if (print_set == VECTOR_BIT_SET) {
             /* Print opcode vector onto stdout if flag set */
             printf("Character Encoding\n");
             bvector_print(vector_opcodes, VECTOR_FLAG_STREAM);
         }
-
-        free(vector_opcodes);
     } else {
-        /* Write the entire opcode buffer onto the file */
-        bytes_written = pwrite(out_fd, ascii_opcodes, ascii_opcodes_size, offset);
-        if (bytes_written < (ssize_t)ascii_opcodes_size) {
-            ERROR_DEBUG("Error On Write {out_fd: %d}", out_fd);
-        }
 
         /* Print opcode buffer onto stdout if flag set */
         if (print_set == VECTOR_BIT_SET) {
             printf("Character Encoding\n");
             printf("%s\n", (char *)ascii_opcodes);
         }
+    }
+    ret = 0;
+
+done:
+    /*
+     * The tree owns every element once it has the root. Until then
+     * the elements are still held by the distribution list.
+     */
+    if (!distribution_tree || !distribution_tree->root) {
+        _free_distribution(distribution_list);
+    }
+    htree_free(distribution_tree);
+    hlist_free(distribution_list);
+    hheader_free(header);
 
-        free(ascii_opcodes);
+    if (ascii_opcode_table) {
+        for (int i = 0; i < TREE_MAX_TABLE_SIZE; i++) {
+            free(ascii_opcode_table[i]);
+        }
+        free(ascii_opcode_table);
     }
 
-    // TODO: Garbage Collection
+    if (vector_opcode_table) {
+        for (int i = 0; i < TREE_MAX_TABLE_SIZE; i++) {
+            bvector_free(vector_opcode_table[i]);
+        }
+        free(vector_opcode_table);
+    }
 
-    return 0;
+    bvector_free(vector_opcodes);
+    free(ascii_opcodes);
+    if (another_input_fd >= 0) {
+        close(another_input_fd);
+    }
+    return ret;
+}
+
+/**
+ * This function is used to state step through the opcodes and write
+ * the decoded elements into a buffer provided by the caller. Decoding
+ * stops as soon as the exact number of elements has been produced so
+ * that the padding bits at the end of the opcodes are never stepped.
+ * Since that always happens on a leaf node, decoding can be resumed
+ * from the returned position with the next buffer.
+ *
+ * @param htree The huffman tree to step through
+ * @param ascii_opcodes The ASCII opcodes or NULL
+ * @param vector_opcodes The vector opcodes or NULL
+ * @param opcode_count The number of opcodes available
+ * @param position The opcode to begin at, updated to where decoding stopped
+ * @param out The buffer to decode into
+ * @param out_length The number of elements to decode
+ * @return The number of elements decoded
+ */
+uint64_t
+huffman_decode_opcodes(htree_t *htree, uint8_t *ascii_opcodes, bvector_t *vector_opcodes,
+                       uint64_t opcode_count, uint64_t *position, uint8_t *out, uint64_t out_length)
+{
+    int opcode;
+    int decoded_element;
+    uint64_t i, decoded_count;
+    helement_t *temp_ptr;
+
+    decoded_count = 0;
+    decoded_element = -1;
+    temp_ptr = htree->root;
+    for (i = *position; i < opcode_count && decoded_count < out_length; i++) {
+        if (ascii_opcodes) {
+            opcode = ascii_opcodes[i] - 48;
+        } else {
+            opcode = bvector_check_bit(vector_opcodes, i);
+        }
+
+        temp_ptr = htree_state_step(htree, temp_ptr, &decoded_element, opcode);
+        if (!temp_ptr) {
+            break;
+        } else if (decoded_element >= 0) {
+            out[decoded_count++] = decoded_element;
+        }
+    }
+
+    *position = i;
+    return decoded_count;
 }
 
 /**
@@ -426,26 +1059,29 @@ huffman_encode(int in_fd, int out_fd)
  *
  * @param in_fd The input file
  * @param out_fd The output file
+ * @param header The container header or NULL for older files
+ * @param prefix The beginning of the input file
+ * @param prefix_size The number of bytes in the prefix
  * @return 0 on success or error code
  */
 int
-huffman_decode(int in_fd, int out_fd)
+huffman_decode(int in_fd, int out_fd, hheader_t *header, const uint8_t *prefix, uint64_t prefix_size)
 {
     uint8_t *ascii_opcodes;
     uint64_t ascii_opcodes_size;
 
     uint8_t *decoded_string;
     uint64_t decoded_string_size;
+    uint64_t decoded_string_capacity;
+    uint64_t original_length;
 
-    int decoded_element;
-    int opcode;
-    uint64_t i, opcode_loop_size;
+    uint64_t opcode_loop_size;
+    uint64_t position;
     bvector_t *vector_opcodes;
     ssize_t bytes_read;
-    ssize_t bytes_written;
     ssize_t offset;
     htree_t *constructed_tree;
-    helement_t *temp_ptr;
+    int ret;
 
     /*
      * The concept of the decode function is quite simple. We need
@@ -455,26 +1091,59 @@ huffman_decode(int in_fd, int out_fd)
      * structures really help us do all of this.
      */
     ascii_opcodes = NULL;
+    vector_opcodes = NULL;
+    decoded_string = NULL;
+    constructed_tree = NULL;
     int8_t ascii_set = bvector_check_bit(flags, FLAG_ASCII);
     int8_t print_set = bvector_check_bit(flags, FLAG_PRINT);
+    int8_t test_set = bvector_check_bit(flags, FLAG_TEST);
 
-    /* Construct the huffman tree from the input file */
-    constructed_tree = htree_input(in_fd);
-    if (!constructed_tree) {
-        ERROR_DEBUG("Error On Input {constructed_tree}");
+    /* The container header knows the mode and the tree follows it */
+    offset = 0;
+    if (header) {
+        ascii_set = (header->flags & HEADER_FLAG_ASCII) ? VECTOR_BIT_SET : VECTOR_BIT_OFF;
+        offset = header->header_size;
     }
 
     /*
-     * Compute offset for readinf in the opcodes and then read in
-     * all the opcodes for the entire file. Decoding is done in
+     * Construct the huffman tree from the prefix, which holds all of
+     * it in any file that is not truncated, and compute the offset for
+     * reading in the opcodes for the entire file. Decoding is done in
      * a separate loop.
      */
-    offset = TREE_INPUT_OBJECT_OFFSET(constructed_tree->count);
+    if ((uint64_t)offset > prefix_size) {
+        errno = EINVAL;
+        ERROR_DEBUG_DONE("Error On Input {header_size: %ld}", offset);
+    }
+
+    constructed_tree = htree_create();
+    if (!constructed_tree) {
+        ERROR_DEBUG_DONE("Error On Create {constructed_tree}");
+    }
+
+    if (header && header->version > HEADER_VERSION_TREE_NODES) {
+        bytes_read = htree_unpack(constructed_tree, prefix + offset, prefix_size - offset);
+    } else {
+        bytes_read = htree_unpack_nodes(constructed_tree, prefix + offset, prefix_size - offset);
+    }
+    if (bytes_read < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG_DONE("Error On Unpack {constructed_tree: %ld}", bytes_read);
+    } else {
+        offset += bytes_read;
+    }
+
+    /*
+     * Only the container header records the original length. Files
+     * from before it are the tree followed by the opcodes, and are
+     * decoded until the opcodes run out.
+     */
+    original_length = header ? header->original_length : 0;
 
     if (ascii_set == VECTOR_BIT_OFF) {
         vector_opcodes = bvector_input(in_fd, offset);
         if (!vector_opcodes) {
-            ERROR_DEBUG("Error On Input {vector_opcodes}");
+            ERROR_DEBUG_DONE("Error On Input {vector_opcodes}");
         }
 
         if (print_set == VECTOR_BIT_SET) {
@@ -486,7 +1155,7 @@ huffman_decode(int in_fd, int out_fd)
         ascii_opcodes_size = 0;
 
         /* Begin reading */
-        while ((bytes_read = pread(in_fd, &element, sizeof(char), offset)) > 0) {
+        while ((bytes_read = hio_pread(in_fd, &element, sizeof(char), offset)) > 0) {
             ascii_opcodes = array_append(ascii_opcodes, &ascii_opcodes_size, &element, 1);
             offset += sizeof(char);
         }
@@ -504,38 +1173,1869 @@ huffman_decode(int in_fd, int out_fd)
         opcode_loop_size = bvector_get_size(vector_opcodes, VECTOR_FLAG_STREAM);
     }
 
-    decoded_string = NULL;
-    decoded_string_size = 0;
-    temp_ptr = constructed_tree->root;
-    decoded_element = -1;
-    for (i = 0; i < opcode_loop_size; i++) {
-        if (ascii_set) {
-            opcode = ascii_opcodes[i] - 48;
-        } else {
-            opcode = bvector_check_bit(vector_opcodes, i);
+    /*
+     * Every element takes at least one opcode, so a header which
+     * claims more elements than there are opcodes is not believed,
+     * and nothing is allocated for it.
+     */
+    if (original_length > opcode_loop_size) {
+        errno = EINVAL;
+        ERROR_DEBUG_DONE("Error On Input {original_length: %llu, opcodes: %llu}",
+                    (unsigned long long)original_length, (unsigned long long)opcode_loop_size);
+    }
+
+    /*
+     * In test mode the elements are decoded into a small scratch buffer
+     * which is reused until every element has been decoded. Nothing
+     * is written out.
+     */
+    position = 0;
+    if (test_set == VECTOR_BIT_SET) {
+        decoded_string = malloc(HUFFMAN_SCRATCH_SIZE);
+        if (!decoded_string) {
+            ERROR_DEBUG_DONE("Error On Malloc {decoded_string: %u}", HUFFMAN_SCRATCH_SIZE);
+        }
+
+        decoded_string_size = 0;
+        while (header ? decoded_string_size < original_length : position < opcode_loop_size) {
+            uint64_t chunk_length = HUFFMAN_SCRATCH_SIZE;
+            if (header && chunk_length > original_length - decoded_string_size) {
+                chunk_length = original_length - decoded_string_size;
+            }
+
+            chunk_length = huffman_decode_opcodes(constructed_tree, ascii_opcodes, vector_opcodes,
+                                                  opcode_loop_size, &position, decoded_string, chunk_length);
+            if (!chunk_length) {
+                break;
+            }
+            decoded_string_size += chunk_length;
         }
 
-        temp_ptr = htree_state_step(constructed_tree, temp_ptr, &decoded_element, opcode);
-        if (decoded_element >= 0) {
-            uint8_t element = decoded_element;
-            decoded_string = array_append(decoded_string, &decoded_string_size, &element, 1);
+        if (decoded_string_size < original_length) {
+            errno = EINVAL;
+            ERROR_DEBUG_DONE("Error On Decode {decoded: %llu, expected: %llu}",
+                        (unsigned long long)decoded_string_size, (unsigned long long)original_length);
+        } else if (position != opcode_loop_size) {
+            errno = EINVAL;
+            ERROR_DEBUG_DONE("Error On Decode {trailing opcodes: %llu}",
+                        (unsigned long long)(opcode_loop_size - position));
         }
+
+        ret = 0;
+        goto done;
     }
 
-    /* Write the decoded string onto the output file */
-    bytes_written = write(out_fd, decoded_string, decoded_string_size);
-    if (bytes_written < (ssize_t)decoded_string_size) {
-        ERROR_DEBUG("Error On Write {out_fd: %d}", out_fd);
+    /*
+     * The output buffer is allocated once at the exact size of the
+     * original file instead of growing it for every decoded element.
+     * Without a header the length is not known, so the buffer is
+     * doubled whenever it fills up until the opcodes run out.
+     */
+    decoded_string_capacity = header ? original_length + 1 : HUFFMAN_SCRATCH_SIZE;
+    decoded_string = malloc(decoded_string_capacity);
+    if (!decoded_string) {
+        ERROR_DEBUG_DONE("Error On Malloc {decoded_string: %llu}", (unsigned long long)decoded_string_capacity);
+    }
+
+    /*
+     * Vector opcodes can be decoded on several threads which begin at
+     * arbitrary offsets and are stitched back together afterwards,
+     * which needs the length to be known up front.
+     */
+    if (!header) {
+        decoded_string_size = 0;
+        while (position < opcode_loop_size) {
+            if (decoded_string_size == decoded_string_capacity) {
+                uint8_t *temp_string = realloc(decoded_string, decoded_string_capacity * 2);
+                if (!temp_string) {
+                    ERROR_DEBUG_DONE("Error On Realloc {decoded_string: %llu}",
+                                (unsigned long long)decoded_string_capacity * 2);
+                }
+                decoded_string = temp_string;
+                decoded_string_capacity *= 2;
+            }
+
+            uint64_t chunk_length = huffman_decode_opcodes(constructed_tree, ascii_opcodes, vector_opcodes,
+                                                           opcode_loop_size, &position,
+                                                           decoded_string + decoded_string_size,
+                                                           decoded_string_capacity - decoded_string_size);
+            if (!chunk_length) {
+                break;
+            }
+            decoded_string_size += chunk_length;
+        }
+
+        if (position != opcode_loop_size) {
+            errno = EINVAL;
+            ERROR_DEBUG_DONE("Error On Decode {undecoded opcodes: %llu}",
+                        (unsigned long long)(opcode_loop_size - position));
+        }
+        original_length = decoded_string_size;
+    } else if (ascii_set == VECTOR_BIT_OFF && thread_count > 1) {
+        int64_t parallel_size = hparallel_decode(constructed_tree, vector_opcodes, decoded_string,
+                                                 original_length, thread_count);
+        if (parallel_size < 0) {
+            errno = EINVAL;
+            ERROR_DEBUG_DONE("Error On Parallel Decode {%ld}", (long)parallel_size);
+        }
+        decoded_string_size = parallel_size;
+    } else {
+        decoded_string_size = huffman_decode_opcodes(constructed_tree, ascii_opcodes, vector_opcodes,
+                                                     opcode_loop_size, &position, decoded_string,
+                                                     original_length);
+    }
+    if (decoded_string_size < original_length) {
+        errno = EINVAL;
+        ERROR_DEBUG_DONE("Error On Decode {decoded: %llu, expected: %llu}",
+                    (unsigned long long)decoded_string_size, (unsigned long long)original_length);
     }
 
-    // TODO: Garbage Collection
+    /* Write the decoded string onto the output file */
+    if (hio_write(out_fd, decoded_string, decoded_string_size)) {
+        ERROR_DEBUG_DONE("Error On Write {out_fd: %d}", out_fd);
+    }
+    ret = 0;
 
-    return 0;
+done:
+    htree_free(constructed_tree);
+    bvector_free(vector_opcodes);
+    free(ascii_opcodes);
+    free(decoded_string);
+    return ret;
 }
 
 /**
- * The main function reads in all arguments from the command line
- * and performs huffman based encoding or decoding depending on the
+ * This function is used to compress a file into interleaved streams.
+ * A canonical code is built for the whole file and the file is cut
+ * into STREAM_DEFAULT_COUNT segments, or STREAM_WIDE_COUNT segments
+ * if the wide flag is set, which are encoded separately so that the
+ * decoder can work on all of them at once.
+ *
+ * @param in_fd The input file
+ * @param out_fd The output file
+ * @return 0 on success or error code
+ */
+int
+huffman_encode_streams(int in_fd, int out_fd)
+{
+    uint8_t *input, *output;
+    uint64_t original_length, capacity;
+    uint64_t frequencies[CODE_MAX_SYMBOLS];
+    ssize_t code_size, stream_size;
+    ssize_t header_size;
+    uint8_t stream_count;
+    hheader_t *header;
+    hcode_t *code;
+
+    stream_count = STREAM_DEFAULT_COUNT;
+    if (bvector_check_bit(flags, FLAG_WIDE) == VECTOR_BIT_SET) {
+        stream_count = STREAM_WIDE_COUNT;
+    }
+
+    input = read_file(in_fd, &original_length, 0);
+    if (!input) {
+        ERROR_DEBUG("Error On Read {in_fd: %d}", in_fd);
+    }
+    close(in_fd);
+
+    /* Build the code for the whole file */
+    code = hcode_create();
+    if (!code) {
+        ERROR_DEBUG("Error On Create {code}");
+    }
+
+    hcode_count(frequencies, input, original_length);
+    if (!hcode_build(code, frequencies)) {
+        ERROR_DEBUG("Error On Build {code}");
+    }
+
+    /*
+     * The output holds the container header, the packed code and the
+     * streams, and is written out in a single call.
+     */
+    capacity = HEADER_MIN_SIZE + CODE_PACK_MAX_SIZE + hstream_bound(original_length, stream_count);
+    output = malloc(capacity);
+    if (!output) {
+        ERROR_DEBUG("Error On Malloc {output: %llu}", (unsigned long long)capacity);
+    }
+
+    header = hheader_create();
+    if (!header) {
+        ERROR_DEBUG("Error On Create {header}");
+    }
+
+    header->engine = HEADER_ENGINE_STREAMS;
+    header->code_limit = CODE_MAX_LENGTH;
+    header->original_length = original_length;
+    header_size = hheader_pack(header, output, capacity);
+    if (header_size < 0) {
+        ERROR_DEBUG("Error On Pack {header: %ld}", header_size);
+    }
+    hheader_free(header);
+
+    code_size = hcode_pack(code, output + header_size, CODE_PACK_MAX_SIZE);
+    if (code_size < 0) {
+        ERROR_DEBUG("Error On Pack {code: %ld}", code_size);
+    }
+
+    stream_size = hstream_encode(code, input, original_length, stream_count,
+                                 output + header_size + code_size,
+                                 capacity - header_size - code_size);
+    if (stream_size < 0) {
+        ERROR_DEBUG("Error On Encode {streams: %ld}", stream_size);
+    }
+
+    capacity = header_size + code_size + stream_size;
+    if (hio_write(out_fd, output, capacity)) {
+        ERROR_DEBUG("Error On Write {out_fd: %d}", out_fd);
+    }
+
+    free(output);
+    free(input);
+    hcode_free(code);
+    return 0;
+}
+
+/**
+ * This function is used to decompress a file which was compressed
+ * into interleaved streams. The output is allocated once at the
+ * original length and all streams are decoded into it together.
+ * Wide sets of streams are decoded with AVX2 when it is available
+ * and faster, unless the reference scalar decoder has been asked for
+ * before decoding began.
+ *
+ * @param in_fd The input file
+ * @param out_fd The output file
+ * @param header The container header
+ * @return 0 on success or error code
+ */
+int
+huffman_decode_streams(int in_fd, int out_fd, hheader_t *header)
+{
+    int ret;
+    uint8_t *input, *output;
+    uint64_t input_length, original_length, offset;
+    ssize_t code_size;
+    hcode_t *code;
+
+    input = read_file(in_fd, &input_length, STREAM_PADDING);
+    if (!input) {
+        ERROR_DEBUG("Error On Read {in_fd: %d}", in_fd);
+    }
+
+    original_length = header->original_length;
+    offset = header->header_size;
+    if (input_length < offset) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Read {header: %llu}", (unsigned long long)input_length);
+    }
+
+    code = hcode_create();
+    if (!code) {
+        ERROR_DEBUG("Error On Create {code}");
+    }
+
+    code_size = hcode_unpack(code, input + offset, input_length - offset);
+    if (code_size < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Unpack {code: %ld}", code_size);
+    }
+
+    /* Every element takes at least one bit, so the length cannot be more than the bits */
+    if (original_length / VECTOR_BYTE_SIZE > input_length - offset - code_size) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Input {original_length: %llu}", (unsigned long long)original_length);
+    }
+
+    /* Test mode decodes every stream into its share of a scratch buffer */
+    if (bvector_check_bit(flags, FLAG_TEST) == VECTOR_BIT_SET) {
+        output = malloc(HUFFMAN_SCRATCH_SIZE);
+        if (!output) {
+            ERROR_DEBUG("Error On Malloc {output: %u}", HUFFMAN_SCRATCH_SIZE);
+        }
+
+        ret = hstream_verify(code, input + offset + code_size,
+                             input_length - offset - code_size, original_length,
+                             output, HUFFMAN_SCRATCH_SIZE, NULL);
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Verify {streams: %d}", ret);
+        }
+
+        free(output);
+        free(input);
+        hcode_free(code);
+        return 0;
+    }
+
+    output = malloc(original_length + 1);
+    if (!output) {
+        ERROR_DEBUG("Error On Malloc {output: %llu}", (unsigned long long)original_length);
+    }
+
+    ret = hstream_decode(code, input + offset + code_size,
+                         input_length - offset - code_size, output, original_length);
+    if (ret) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Decode {streams: %d}", ret);
+    }
+
+    if (hio_write(out_fd, output, original_length)) {
+        ERROR_DEBUG("Error On Write {out_fd: %d}", out_fd);
+    }
+
+    free(output);
+    free(input);
+    hcode_free(code);
+    return 0;
+}
+
+/**
+ * This function is used to pick up a file made of blocks so that
+ * more blocks can be added to its end. Only the container header
+ * and the index are read, and the blocks already in the file are
+ * never read or written. New blocks begin where the index does,
+ * or at the end of a file without one. The flags of the file are
+ * kept so that every block has the same header. An empty file is
+ * left to be written from the beginning.
+ *
+ * @param out_fd The file being appended to
+ * @param header The header to input into
+ * @param index The index to input into
+ * @param offset The offset the next block begins at
+ * @return 0 on success or error code
+ */
+int
+huffman_resume_blocks(int out_fd, hheader_t *header, hindex_t *index, uint64_t *offset)
+{
+    struct stat file_stat;
+    ssize_t ret;
+
+    if (fstat(out_fd, &file_stat)) {
+        ERROR_DEBUG("Error On Stat {out_fd: %d}", out_fd);
+    } else if (!file_stat.st_size) {
+        return 0;
+    }
+
+    ret = hheader_input(header, out_fd);
+    if (ret < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Input {header: %ld}", ret);
+    } else if (header->engine != HEADER_ENGINE_BLOCKS) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Append {engine: %u}", header->engine);
+    } else if (header->header_size != HEADER_SIZE(header->flags)) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Append {header_size: %u}", header->header_size);
+    }
+
+    if (!(header->flags & HEADER_FLAG_INDEX)) {
+        *offset = file_stat.st_size;
+        return 0;
+    }
+
+    ret = hindex_input(index, out_fd);
+    if (ret < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Input {index: %ld}", ret);
+    }
+
+    *offset = ret;
+    return 0;
+}
+
+/**
+ * This function is used to place a block which was just encoded
+ * right after the block before it. The entry of the block is added
+ * to the index and its checksum to the checksum of the whole
+ * content. Blocks must be placed in the order of the file.
+ *
+ * @param context The writer of the file.
+ * @param job The encoded block.
+ * @return The offset to write the block at or error code
+ */
+int64_t
+huffman_place_block(void *context, pjob_t *job)
+{
+    hwriter_t *writer = context;
+    hblock_t *block = job->block;
+    uint64_t offset;
+    int ret;
+
+    /* A block repeating a table points back at the block holding it */
+    if (block->type == BLOCK_TYPE_HUFFMAN && !block->repeat) {
+        writer->table = writer->index->count;
+    }
+
+    ret = hindex_add(writer->index, writer->original_length, writer->offset,
+                     (block->type == BLOCK_TYPE_HUFFMAN) ? writer->table : writer->index->count);
+    if (ret) {
+        ERROR_DEBUG("Error On Add {index: %d}", ret);
+    }
+
+    /* The whole content checksum is built from those of the blocks */
+    writer->checksum = hchecksum_combine(writer->checksum, block->checksum, block->length);
+    writer->original_length += block->length;
+
+    offset = writer->offset;
+    writer->offset += job->size;
+    return offset;
+}
+
+/**
+ * This function is used to write out a block which was just
+ * encoded, right after the block before it. A stored block which
+ * was passed through only had its header encoded, and its body is
+ * copied from the input inside the kernel. Whatever the kernel
+ * cannot copy is written from the elements of the block.
+ *
+ * @param writer The writer of the file.
+ * @param job The encoded block.
+ * @return 0 on success or error code
+ */
+int
+huffman_write_block(hwriter_t *writer, pjob_t *job)
+{
+    hblock_t *block = job->block;
+    ssize_t bytes_written;
+    int64_t offset, copied;
+    uint64_t source;
+
+    source = writer->in_offset;
+    writer->in_offset += block->length;
+
+    offset = huffman_place_block(writer, job);
+    if (block->passthrough && block->type == BLOCK_TYPE_STORED) {
+        bytes_written = write_at(writer->out_fd, job->out, block->header_size, offset);
+        if (bytes_written < block->header_size) {
+            ERROR_DEBUG("Error On Write {out_fd: %d}", writer->out_fd);
+        }
+        offset += block->header_size;
+
+        copied = hsplice_copy(writer->splice, writer->in_fd, source, writer->out_fd, offset, block->length);
+        if (copied < 0) {
+            ERROR_DEBUG("Error On Copy {splice: %lld}", (long long)copied);
+        }
+
+        bytes_written = write_at(writer->out_fd, job->in + copied, block->length - copied, offset + copied);
+        if (bytes_written < (ssize_t)(block->length - copied)) {
+            ERROR_DEBUG("Error On Write {out_fd: %d}", writer->out_fd);
+        }
+        return 0;
+    }
+
+    if (writer->direct) {
+        if (hdirect_write(writer->direct, job->out, job->size)) {
+            ERROR_DEBUG("Error On Write {direct: %d}", writer->out_fd);
+        }
+        return 0;
+    }
+
+    bytes_written = write_at(writer->out_fd, job->out, job->size, offset);
+    if (bytes_written < job->size) {
+        ERROR_DEBUG("Error On Write {out_fd: %d}", writer->out_fd);
+    }
+    return 0;
+}
+
+/**
+ * This function is used to read and encode the blocks of a file a
+ * batch at a time, one block on every thread, and write every
+ * batch out in order before the next one is read.
+ *
+ * @param in_fd The input file
+ * @param writer The writer of the output file
+ * @param job_count The number of blocks in a batch
+ * @param stream_count The number of streams every block is encoded into
+ * @param checksums Whether every block carries a checksum
+ * @param alignment The alignment of the input buffers for direct I/O or 0
+ * @return 0 on success or error code
+ */
+int
+huffman_batch_blocks(int in_fd, hwriter_t *writer, int job_count, uint8_t stream_count, uint8_t checksums,
+                     uint32_t alignment)
+{
+    uint64_t capacity;
+    ssize_t length;
+    hblock_t *previous;
+    pjob_t *jobs;
+    int i, ret, count;
+
+    jobs = calloc(job_count, sizeof(pjob_t));
+    if (!jobs) {
+        ERROR_DEBUG("Error On Malloc {jobs: %d}", job_count);
+    }
+
+    capacity = hblock_bound(block_size, stream_count);
+    for (i = 0; i < job_count; i++) {
+        jobs[i].block = hblock_create(stream_count, checksums);
+        jobs[i].in = alignment ? hdirect_alloc(alignment, block_size) : malloc(block_size);
+        jobs[i].out = malloc(capacity);
+        jobs[i].capacity = capacity;
+        if (!jobs[i].block || !jobs[i].in || !jobs[i].out) {
+            ERROR_DEBUG("Error On Malloc {block: %u}", block_size);
+        }
+        jobs[i].block->passthrough = (writer->splice != NULL);
+    }
+
+    previous = NULL;
+    while (1) {
+        length = 0;
+        for (count = 0; count < job_count; count++) {
+            length = hio_read(in_fd, jobs[count].in, block_size);
+            if (length <= 0) {
+                break;
+            }
+            jobs[count].length = length;
+        }
+
+        if (length < 0) {
+            ERROR_DEBUG("Error On Read {in_fd: %d}", in_fd);
+        } else if (!count) {
+            break;
+        }
+
+        ret = hparallel_encode(jobs, count, previous);
+        if (ret) {
+            ERROR_DEBUG("Error On Encode {block: %d}", ret);
+        }
+
+        /* The blocks of the batch are written out in order */
+        for (i = 0; i < count; i++) {
+            ret = huffman_write_block(writer, &jobs[i]);
+            if (ret) {
+                return ret;
+            }
+        }
+
+        previous = jobs[count - 1].block;
+        if (count < job_count) {
+            break;
+        }
+    }
+
+    for (i = 0; i < job_count; i++) {
+        hblock_free(jobs[i].block);
+        free(jobs[i].in);
+        free(jobs[i].out);
+    }
+    free(jobs);
+    return 0;
+}
+
+/**
+ * This function is used to read the next batch of blocks of a
+ * file, one block for every job.
+ *
+ * @param in_fd The input file
+ * @param jobs The jobs to read into
+ * @param job_count The number of jobs
+ * @param count Where to put the number of blocks read
+ * @return 0 on success or error code
+ */
+int
+huffman_read_batch(int in_fd, pjob_t *jobs, int job_count, int *count)
+{
+    ssize_t length;
+
+    for (*count = 0; *count < job_count; *count += 1) {
+        length = hio_read(in_fd, jobs[*count].in, block_size);
+        if (length < 0) {
+            ERROR_DEBUG("Error On Read {in_fd: %d}", in_fd);
+        } else if (!length) {
+            break;
+        }
+        jobs[*count].length = length;
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to work out the exact size of every block
+ * a file is encoded into, a batch at a time, without emitting any
+ * of them. The blocks are prepared and chosen just as they are when
+ * they are encoded, so they come out the same size again.
+ *
+ * @param in_fd The input file
+ * @param jobs The sized jobs to measure with
+ * @param job_count The number of jobs
+ * @param total Where to put the size of all the blocks
+ * @return 0 on success or error code
+ */
+int
+huffman_measure_blocks(int in_fd, pjob_t *jobs, int job_count, uint64_t *total)
+{
+    hblock_t *previous;
+    int i, ret, count;
+
+    *total = 0;
+    previous = NULL;
+    while (1) {
+        ret = huffman_read_batch(in_fd, jobs, job_count, &count);
+        if (ret) {
+            return ret;
+        } else if (!count) {
+            break;
+        }
+
+        ret = hparallel_size(jobs, count, previous);
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Size {block: %d}", ret);
+        }
+
+        for (i = 0; i < count; i++) {
+            *total += jobs[i].size;
+        }
+
+        previous = jobs[count - 1].block;
+        if (count < job_count) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to read and encode the blocks of a file a
+ * batch at a time, with the exact size of every block worked out
+ * from its frequencies and table before it is emitted. An input
+ * which can be read twice is measured whole first, and the space
+ * for every block is allocated in one piece before any is written,
+ * so the output is laid out as one piece however the blocks are
+ * written. Every block of a batch is then placed in the file in
+ * order and every thread writes its block at its own offset as
+ * soon as it is emitted, without waiting on the blocks before it.
+ * The output is the same as writing the blocks one by one.
+ *
+ * @param in_fd The input file
+ * @param writer The writer of the output file
+ * @param job_count The number of blocks in a batch
+ * @param stream_count The number of streams every block is encoded into
+ * @param checksums Whether every block carries a checksum
+ * @return 0 on success or error code
+ */
+int
+huffman_sized_blocks(int in_fd, hwriter_t *writer, int job_count, uint8_t stream_count, uint8_t checksums)
+{
+    uint64_t capacity, total;
+    off_t start;
+    hblock_t *previous;
+    pjob_t *jobs;
+    int i, ret, count;
+
+    jobs = calloc(job_count, sizeof(pjob_t));
+    if (!jobs) {
+        ERROR_DEBUG("Error On Malloc {jobs: %d}", job_count);
+    }
+
+    capacity = hblock_bound(block_size, stream_count);
+    for (i = 0; i < job_count; i++) {
+        jobs[i].block = hblock_create(stream_count, checksums);
+        jobs[i].in = malloc(block_size);
+        jobs[i].out = malloc(capacity);
+        jobs[i].capacity = capacity;
+        jobs[i].out_fd = writer->out_fd;
+        if (!jobs[i].block || !jobs[i].in || !jobs[i].out) {
+            ERROR_DEBUG("Error On Malloc {block: %u}", block_size);
+        }
+        jobs[i].block->sized = 1;
+    }
+
+    /* An input which cannot seek is only read once, and nothing is allocated ahead */
+    start = lseek(in_fd, 0, SEEK_CUR);
+    if (start >= 0) {
+        ret = huffman_measure_blocks(in_fd, jobs, job_count, &total);
+        if (ret) {
+            return ret;
+        } else if (lseek(in_fd, start, SEEK_SET) < 0) {
+            ERROR_DEBUG("Error On Seek {in_fd: %d}", in_fd);
+        }
+
+        /* A file system which cannot allocate ahead gets the blocks as they come */
+        ret = total ? posix_fallocate(writer->out_fd, writer->offset, total) : 0;
+        if (ret && ret != EOPNOTSUPP && ret != EINVAL) {
+            errno = ret;
+            ERROR_DEBUG("Error On Allocate {size: %llu}", (unsigned long long)total);
+        }
+    }
+
+    previous = NULL;
+    while (1) {
+        ret = huffman_read_batch(in_fd, jobs, job_count, &count);
+        if (ret) {
+            return ret;
+        } else if (!count) {
+            break;
+        }
+
+        ret = hparallel_size(jobs, count, previous);
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Size {block: %d}", ret);
+        }
+
+        /* The blocks of the batch are placed in order before any is written */
+        for (i = 0; i < count; i++) {
+            jobs[i].offset = huffman_place_block(writer, &jobs[i]);
+        }
+
+        ret = hparallel_emit_at(jobs, count);
+        if (ret) {
+            ERROR_DEBUG("Error On Encode {block: %d}", ret);
+        }
+
+        previous = jobs[count - 1].block;
+        if (count < job_count) {
+            break;
+        }
+    }
+
+    for (i = 0; i < job_count; i++) {
+        hblock_free(jobs[i].block);
+        free(jobs[i].in);
+        free(jobs[i].out);
+    }
+    free(jobs);
+    return 0;
+}
+
+/**
+ * This function is used to read and encode the blocks of a file
+ * with the two halves of encoding overlapped on two threads. Two
+ * jobs take turns: while one block is packed into bits on a thread
+ * of its own, the next one is read, counted and given its table on
+ * this thread. The output is the same as encoding the blocks one by
+ * one.
+ *
+ * @param in_fd The input file
+ * @param writer The writer of the output file
+ * @param stream_count The number of streams every block is encoded into
+ * @param checksums Whether every block carries a checksum
+ * @param alignment The alignment of the input buffers for direct I/O or 0
+ * @return 0 on success or error code
+ */
+int
+huffman_overlap_blocks(int in_fd, hwriter_t *writer, uint8_t stream_count, uint8_t checksums,
+                       uint32_t alignment)
+{
+    uint64_t capacity;
+    ssize_t length;
+    pjob_t jobs[2], *current, *next;
+    int i, ret;
+
+    memset(jobs, 0, sizeof(jobs));
+    capacity = hblock_bound(block_size, stream_count);
+    for (i = 0; i < 2; i++) {
+        jobs[i].block = hblock_create(stream_count, checksums);
+        jobs[i].in = alignment ? hdirect_alloc(alignment, block_size) : malloc(block_size);
+        jobs[i].out = malloc(capacity);
+        jobs[i].capacity = capacity;
+        if (!jobs[i].block || !jobs[i].in || !jobs[i].out) {
+            ERROR_DEBUG("Error On Malloc {block: %u}", block_size);
+        }
+        jobs[i].block->passthrough = (writer->splice != NULL);
+    }
+
+    current = NULL;
+    for (i = 0; ; i ^= 1) {
+        next = &jobs[i];
+        length = hio_read(in_fd, next->in, block_size);
+        if (length < 0) {
+            ERROR_DEBUG("Error On Read {in_fd: %d}", in_fd);
+        }
+        next->length = length;
+
+        ret = hparallel_overlap(current, length ? next : NULL);
+        if (ret) {
+            ERROR_DEBUG("Error On Encode {block: %d}", ret);
+        }
+
+        if (current) {
+            ret = huffman_write_block(writer, current);
+            if (ret) {
+                return ret;
+            }
+        }
+
+        if (!length) {
+            break;
+        }
+        current = next;
+    }
+
+    for (i = 0; i < 2; i++) {
+        hblock_free(jobs[i].block);
+        free(jobs[i].in);
+        free(jobs[i].out);
+    }
+    return 0;
+}
+
+/**
+ * This function is used to compress a file into independent blocks.
+ * Every block is read, encoded with a table of its own and written
+ * out before the next one is read, so memory does not grow with
+ * the size of the file. The container header is written last, once
+ * the original length and checksum are known. With more than one
+ * thread, a batch of blocks is read and encoded at once, one block
+ * on every thread, and the output is the same as with one thread.
+ * In pipeline mode reading, encoding and writing happen at the same
+ * time on threads of their own, again with the same output, and
+ * the pipeline may read and write through io_uring. Outside the
+ * pipeline, direct I/O can be asked for, which keeps the blocks out
+ * of the page cache, and the next block can be prepared while the
+ * current one is packed, and stored blocks can be copied from the
+ * input inside the kernel. Sized blocks are measured before they
+ * are emitted, so their space is allocated ahead and every thread
+ * writes its own block. An output which cannot seek, such as a
+ * pipe, gets the header first and a trailer with the length and
+ * checksum after the last block. When
+ * asked for, the index of the blocks is written after the last
+ * block. When appending, the blocks are added after those already
+ * in the output file and its header and index are brought up to
+ * date.
+ *
+ * @param in_fd The input file
+ * @param out_fd The output file
+ * @return 0 on success or error code
+ */
+int
+huffman_encode_blocks(int in_fd, int out_fd)
+{
+    ssize_t size;
+    uint8_t stream_count;
+    hheader_t *header;
+    hwriter_t writer;
+    hpipeline_t *pipeline;
+    uint32_t alignment;
+    uint8_t trailer[HEADER_TRAILER_SIZE];
+    struct stat file_stat;
+    struct timespec start, stop;
+    const char *loop;
+    double seconds;
+    int ret, job_count;
+
+    int8_t checksum_set = bvector_check_bit(flags, FLAG_CHECKSUM);
+    int8_t index_set = bvector_check_bit(flags, FLAG_INDEX);
+    int8_t append_set = bvector_check_bit(flags, FLAG_APPEND);
+    int8_t pipeline_set = bvector_check_bit(flags, FLAG_PIPELINE);
+    int8_t direct_set = bvector_check_bit(flags, FLAG_DIRECT);
+    int8_t overlap_set = bvector_check_bit(flags, FLAG_OVERLAP);
+    int8_t splice_set = bvector_check_bit(flags, FLAG_SPLICE);
+    int8_t sized_set = bvector_check_bit(flags, FLAG_SIZED);
+
+    stream_count = STREAM_DEFAULT_COUNT;
+    if (bvector_check_bit(flags, FLAG_WIDE) == VECTOR_BIT_SET) {
+        stream_count = STREAM_WIDE_COUNT;
+    }
+
+    header = hheader_create();
+    writer.index = hindex_create();
+    if (!header || !writer.index) {
+        ERROR_DEBUG("Error On Create {header}");
+    }
+
+    header->engine = HEADER_ENGINE_BLOCKS;
+    header->code_limit = CODE_MAX_LENGTH;
+    if (checksum_set == VECTOR_BIT_SET) {
+        header->flags |= HEADER_FLAG_CHECKSUM;
+    }
+    if (index_set == VECTOR_BIT_SET) {
+        header->flags |= HEADER_FLAG_INDEX;
+    }
+
+    writer.offset = HEADER_SIZE(header->flags);
+    if (append_set == VECTOR_BIT_SET) {
+        ret = huffman_resume_blocks(out_fd, header, writer.index, &writer.offset);
+        if (ret) {
+            return ret;
+        }
+    } else if (lseek(out_fd, 0, SEEK_CUR) < 0) {
+        /* Without seeking back, the header goes first and a trailer holds the totals */
+        if (index_set == VECTOR_BIT_SET || pipeline_set == VECTOR_BIT_SET || sized_set == VECTOR_BIT_SET) {
+            errno = ESPIPE;
+            ERROR_DEBUG("Error On Stream {index, pipeline and sized blocks need a seekable output}");
+        }
+
+        header->flags |= HEADER_FLAG_STREAM;
+        if (hheader_output(header, out_fd) < 0) {
+            ERROR_DEBUG("Error On Output {header}");
+        }
+    }
+
+    writer.out_fd = out_fd;
+    writer.direct = NULL;
+    writer.original_length = header->original_length;
+    writer.checksum = header->checksum;
+    writer.table = 0;
+
+    /* Stored blocks are only copied from an input which can be read at an offset */
+    writer.splice = NULL;
+    writer.in_fd = in_fd;
+    writer.in_offset = 0;
+    if (splice_set == VECTOR_BIT_SET && !fstat(in_fd, &file_stat) && S_ISREG(file_stat.st_mode)) {
+        writer.in_offset = lseek(in_fd, 0, SEEK_CUR);
+        writer.splice = hsplice_create();
+        if (!writer.splice) {
+            ERROR_DEBUG("Error On Create {splice}");
+        }
+    }
+
+    /* Every thread encodes one block of a batch at a time */
+    job_count = (thread_count < (int)PARALLEL_MAX_THREADS) ? thread_count : (int)PARALLEL_MAX_THREADS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (pipeline_set == VECTOR_BIT_SET) {
+        loop = "pipelined";
+        pipeline = hpipeline_create(pipeline_depth, job_count, block_size, stream_count,
+                                    (header->flags & HEADER_FLAG_CHECKSUM) != 0);
+        if (!pipeline) {
+            ERROR_DEBUG("Error On Create {pipeline: %u}", pipeline_depth);
+        }
+
+        pipeline->uring = (bvector_check_bit(flags, FLAG_URING) == VECTOR_BIT_SET);
+        ret = hpipeline_encode(pipeline, in_fd, out_fd, huffman_place_block, &writer);
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Encode {pipeline: %d}", ret);
+        }
+
+        if (bvector_check_bit(flags, FLAG_PRINT) == VECTOR_BIT_SET) {
+            hpipeline_report(pipeline, stdout);
+        }
+        hpipeline_free(pipeline);
+    } else {
+        /* Direct I/O is only used on the files which take it */
+        alignment = 0;
+        if (direct_set == VECTOR_BIT_SET) {
+            /* Every block is read at an aligned offset of the input */
+            if (!hdirect_set(in_fd, 1)) {
+                alignment = hdirect_alignment(in_fd);
+            }
+            if (alignment && block_size % alignment) {
+                errno = EINVAL;
+                ERROR_DEBUG("Error On Direct {block_size: %u, alignment: %u}", block_size, alignment);
+            }
+
+            if (!hdirect_set(out_fd, 1)) {
+                writer.direct = hdirect_create(out_fd, DIRECT_WINDOW_SIZE);
+                if (!writer.direct || hdirect_start(writer.direct, writer.offset)) {
+                    ERROR_DEBUG("Error On Create {direct: %d}", out_fd);
+                }
+            }
+        }
+
+        if (sized_set == VECTOR_BIT_SET) {
+            loop = "sized";
+            ret = huffman_sized_blocks(in_fd, &writer, job_count, stream_count,
+                                       (header->flags & HEADER_FLAG_CHECKSUM) != 0);
+        } else if (overlap_set == VECTOR_BIT_SET) {
+            loop = "overlapped";
+            ret = huffman_overlap_blocks(in_fd, &writer, stream_count,
+                                         (header->flags & HEADER_FLAG_CHECKSUM) != 0, alignment);
+        } else {
+            loop = "batched";
+            ret = huffman_batch_blocks(in_fd, &writer, job_count, stream_count,
+                                       (header->flags & HEADER_FLAG_CHECKSUM) != 0, alignment);
+        }
+        if (ret) {
+            return ret;
+        }
+
+        /* The unaligned tail is written once direct I/O is off again */
+        if (writer.direct && hdirect_finish(writer.direct) < 0) {
+            ERROR_DEBUG("Error On Write {direct: %d}", out_fd);
+        }
+        hdirect_free(writer.direct);
+        writer.direct = NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    /* The encoding loops are compared by their throughput */
+    if (bvector_check_bit(flags, FLAG_PRINT) == VECTOR_BIT_SET) {
+        seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+        printf("[BLOCKS] %llu bytes in %.3f s, %.1f MB/s, %s\n",
+               (unsigned long long)(writer.original_length - header->original_length), seconds,
+               seconds > 0 ? (writer.original_length - header->original_length) / seconds / 1e6 : 0.0, loop);
+        if (writer.splice) {
+            printf("[SPLICE] %llu bytes copied inside the kernel, %s\n",
+                   (unsigned long long)writer.splice->bytes, hsplice_name(writer.splice->method));
+        }
+    }
+    hsplice_free(writer.splice);
+
+    if (header->flags & HEADER_FLAG_INDEX) {
+        size = hindex_output(writer.index, out_fd, writer.offset);
+        if (size < 0) {
+            ERROR_DEBUG("Error On Output {index}");
+        }
+        writer.offset = size;
+    }
+
+    /* Anything past the new end is left over from before appending */
+    if (append_set == VECTOR_BIT_SET && ftruncate(out_fd, writer.offset)) {
+        ERROR_DEBUG("Error On Truncate {out_fd: %d}", out_fd);
+    }
+
+    header->original_length = writer.original_length;
+    header->checksum = writer.checksum;
+    if (header->flags & HEADER_FLAG_STREAM) {
+        size = hheader_pack_trailer(header, trailer, sizeof(trailer));
+        if (size < 0 || write_at(out_fd, trailer, size, writer.offset) < size) {
+            ERROR_DEBUG("Error On Output {trailer}");
+        }
+    } else if (hheader_output(header, out_fd) < 0) {
+        ERROR_DEBUG("Error On Output {header}");
+    }
+
+    hheader_free(header);
+    hindex_free(writer.index);
+    return 0;
+}
+
+/**
+ * This function is used to read the trailer which ends a streamed
+ * file made of blocks, once the start of it has been read in place
+ * of the header of a block. The length and checksum of the whole
+ * content are filled into the header.
+ *
+ * @param in_fd The input file
+ * @param direct The direct window over the input file or NULL
+ * @param header The container header
+ * @param start The start of the trailer which was read already
+ * @param start_size The size of the start of the trailer
+ * @param offset The offset of the rest of the trailer
+ * @return 0 on success or error code
+ */
+int
+huffman_read_trailer(int in_fd, hdirect_t *direct, hheader_t *header, const uint8_t *start,
+                     uint64_t start_size, uint64_t offset)
+{
+    uint8_t trailer[HEADER_TRAILER_SIZE];
+    ssize_t bytes_read;
+
+    memcpy(trailer, start, start_size);
+    bytes_read = read_at(in_fd, direct, trailer + start_size, sizeof(trailer) - start_size, offset);
+    if (bytes_read < (ssize_t)(sizeof(trailer) - start_size)) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Read {trailer: %llu}", (unsigned long long)offset);
+    }
+
+    if (hheader_unpack_trailer(header, trailer, sizeof(trailer)) < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Unpack {trailer}");
+    }
+    return 0;
+}
+
+/**
+ * This function is used to decompress a file made of independent
+ * blocks. A batch of blocks, one for every thread, is read and
+ * decoded at once, every block into a buffer of its own, and the
+ * buffers are then written out in order. Memory is bounded by the
+ * number of threads and never grows with the size of the file. In
+ * test mode every block is decoded into a small scratch buffer
+ * instead. When the file has checksums, every block and the whole
+ * content are checked against them. With direct I/O, the file is
+ * read and the output written through aligned windows which keep
+ * them out of the page cache. Stored blocks of a file without
+ * checksums can instead be copied to the output inside the kernel.
+ *
+ * @param in_fd The input file
+ * @param out_fd The output file
+ * @param header The container header
+ * @return 0 on success or error code
+ */
+int
+huffman_decode_blocks(int in_fd, int out_fd, hheader_t *header)
+{
+    uint8_t block_header[BLOCK_HEADER_MAX_SIZE];
+    uint64_t decoded_length, batch_length, offset, capacity;
+    uint32_t checksum;
+    ssize_t bytes_read;
+    uint64_t *bodies;
+    int64_t copied;
+    hblock_t *block, *previous;
+    hdirect_t *reader, *writer;
+    hsplice_t *splice;
+    struct stat file_stat;
+    pjob_t *jobs;
+    int i, ret, job_count, count;
+
+    int8_t test_set = bvector_check_bit(flags, FLAG_TEST);
+    int8_t direct_set = bvector_check_bit(flags, FLAG_DIRECT);
+    int8_t splice_set = bvector_check_bit(flags, FLAG_SPLICE);
+
+    /* Direct I/O is only used on the files which take it */
+    reader = NULL;
+    writer = NULL;
+    if (direct_set == VECTOR_BIT_SET) {
+        if (!hdirect_set(in_fd, 1)) {
+            reader = hdirect_create(in_fd, DIRECT_WINDOW_SIZE);
+            if (!reader) {
+                ERROR_DEBUG("Error On Create {direct: %d}", in_fd);
+            }
+        }
+
+        if (test_set == VECTOR_BIT_OFF && !hdirect_set(out_fd, 1)) {
+            writer = hdirect_create(out_fd, DIRECT_WINDOW_SIZE);
+            if (!writer || hdirect_start(writer, lseek(out_fd, 0, SEEK_CUR))) {
+                ERROR_DEBUG("Error On Create {direct: %d}", out_fd);
+            }
+        }
+    }
+
+    job_count = (thread_count < (int)PARALLEL_MAX_THREADS) ? thread_count : (int)PARALLEL_MAX_THREADS;
+    jobs = calloc(job_count, sizeof(pjob_t));
+    bodies = calloc(job_count, sizeof(uint64_t));
+    if (!jobs || !bodies) {
+        ERROR_DEBUG("Error On Malloc {jobs: %d}", job_count);
+    }
+
+    /*
+     * Stored blocks are copied from the input inside the kernel
+     * without being read in, which leaves nothing to check them
+     * against, so only files without checksums pass them through.
+     */
+    splice = NULL;
+    if (splice_set == VECTOR_BIT_SET && test_set == VECTOR_BIT_OFF && !(header->flags & HEADER_FLAG_CHECKSUM) &&
+        !fstat(in_fd, &file_stat) && S_ISREG(file_stat.st_mode)) {
+        splice = hsplice_create();
+        if (!splice) {
+            ERROR_DEBUG("Error On Create {splice}");
+        }
+    }
+
+    /*
+     * The body of a block is followed by padding for the stream
+     * decoder. Aligned blocks are written straight from aligned
+     * buffers through a direct window.
+     */
+    capacity = hblock_bound(BLOCK_MAX_SIZE, STREAM_MAX_COUNT);
+    for (i = 0; i < job_count; i++) {
+        jobs[i].block = hblock_create(STREAM_DEFAULT_COUNT, header->flags & HEADER_FLAG_CHECKSUM);
+        jobs[i].capacity = (test_set == VECTOR_BIT_SET) ? HUFFMAN_SCRATCH_SIZE : BLOCK_MAX_SIZE;
+        if (writer) {
+            jobs[i].in = hdirect_alloc(writer->alignment, capacity + STREAM_PADDING);
+            jobs[i].out = hdirect_alloc(writer->alignment, jobs[i].capacity);
+        } else {
+            jobs[i].in = malloc(capacity + STREAM_PADDING);
+            jobs[i].out = malloc(jobs[i].capacity);
+        }
+        jobs[i].verify = (test_set == VECTOR_BIT_SET);
+        if (!jobs[i].block || !jobs[i].in || !jobs[i].out) {
+            ERROR_DEBUG("Error On Malloc {block: %u}", BLOCK_MAX_SIZE);
+        }
+    }
+
+    /* A streamed file only says how long it is once it ends */
+    if (header->flags & HEADER_FLAG_STREAM) {
+        header->original_length = UINT64_MAX;
+    }
+
+    decoded_length = 0;
+    checksum = CHECKSUM_INITIAL;
+    offset = header->header_size;
+    previous = NULL;
+    while (decoded_length < header->original_length) {
+        batch_length = 0;
+        for (count = 0; count < job_count && decoded_length + batch_length < header->original_length; count++) {
+            block = jobs[count].block;
+            bytes_read = read_at(in_fd, reader, block_header, block->header_size, offset);
+            if (bytes_read < (ssize_t)block->header_size) {
+                errno = EINVAL;
+                ERROR_DEBUG("Error On Read {block_header: %llu}", (unsigned long long)offset);
+            }
+            offset += bytes_read;
+
+            if ((header->flags & HEADER_FLAG_STREAM) &&
+                !memcmp(block_header, HEADER_TRAILER_MAGIC, HEADER_MAGIC_SIZE)) {
+                ret = huffman_read_trailer(in_fd, reader, header, block_header, block->header_size, offset);
+                if (ret) {
+                    return ret;
+                } else if (header->original_length != decoded_length + batch_length) {
+                    errno = EINVAL;
+                    ERROR_DEBUG("Error On Trailer {length: %llu}", (unsigned long long)header->original_length);
+                }
+                break;
+            }
+
+            ret = hblock_parse(block, block_header, block->header_size);
+            if (ret) {
+                errno = EINVAL;
+                ERROR_DEBUG("Error On Parse {block: %d}", ret);
+            } else if (block->length > header->original_length - decoded_length - batch_length) {
+                errno = EINVAL;
+                ERROR_DEBUG("Error On Parse {block_length: %u}", block->length);
+            }
+
+            if (splice && block->type == BLOCK_TYPE_STORED) {
+                /* Only where the body is is kept until it is copied */
+                bodies[count] = offset;
+                bytes_read = block->size;
+            } else {
+                bytes_read = read_at(in_fd, reader, jobs[count].in, block->size, offset);
+                if (bytes_read < (ssize_t)block->size) {
+                    errno = EINVAL;
+                    ERROR_DEBUG("Error On Read {block: %u}", block->size);
+                }
+                memset(jobs[count].in + block->size, 0, STREAM_PADDING);
+            }
+            offset += bytes_read;
+            batch_length += block->length;
+        }
+
+        if (!count) {
+            break;
+        }
+
+        ret = hparallel_decode_blocks(jobs, count, previous);
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Decode {block: %d}", ret);
+        }
+
+        /* The blocks of the batch are written out in order */
+        for (i = 0; i < count; i++) {
+            block = jobs[i].block;
+            if (writer) {
+                ret = hdirect_write(writer, (block->type == BLOCK_TYPE_STORED) ? jobs[i].in : jobs[i].out,
+                                    block->length);
+                if (ret) {
+                    ERROR_DEBUG("Error On Write {direct: %d}", out_fd);
+                }
+            } else if (splice && block->type == BLOCK_TYPE_STORED) {
+                copied = hsplice_copy(splice, in_fd, bodies[i], out_fd, SPLICE_CURRENT, block->length);
+                if (copied < 0) {
+                    ERROR_DEBUG("Error On Copy {splice: %lld}", (long long)copied);
+                }
+
+                /* Whatever the kernel did not copy is read in and written out */
+                if ((uint64_t)copied < block->length) {
+                    bytes_read = read_at(in_fd, NULL, jobs[i].in, block->length - copied, bodies[i] + copied);
+                    if (bytes_read < (ssize_t)(block->length - copied)) {
+                        errno = EINVAL;
+                        ERROR_DEBUG("Error On Read {block: %u}", block->size);
+                    }
+
+                    if (hio_write(out_fd, jobs[i].in, bytes_read)) {
+                        ERROR_DEBUG("Error On Write {out_fd: %d}", out_fd);
+                    }
+                }
+            } else if (test_set == VECTOR_BIT_OFF) {
+                /* A stored block is written straight from where it was read */
+                if (hio_write(out_fd, (block->type == BLOCK_TYPE_STORED) ? jobs[i].in : jobs[i].out,
+                              block->length)) {
+                    ERROR_DEBUG("Error On Write {out_fd: %d}", out_fd);
+                }
+            }
+
+            checksum = hchecksum_combine(checksum, block->checksum, block->length);
+        }
+
+        decoded_length += batch_length;
+        previous = jobs[count - 1].block;
+    }
+
+    /* The unaligned tail is written once direct I/O is off again */
+    if (writer && hdirect_finish(writer) < 0) {
+        ERROR_DEBUG("Error On Write {direct: %d}", out_fd);
+    }
+    hdirect_free(writer);
+    hdirect_free(reader);
+
+    if (splice && bvector_check_bit(flags, FLAG_PRINT) == VECTOR_BIT_SET) {
+        printf("[SPLICE] %llu bytes copied inside the kernel, %s\n",
+               (unsigned long long)splice->bytes, hsplice_name(splice->method));
+    }
+    hsplice_free(splice);
+
+    if ((header->flags & HEADER_FLAG_CHECKSUM) && checksum != header->checksum) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Verify {checksum: %08x, expected: %08x}", checksum, header->checksum);
+    }
+
+    for (i = 0; i < job_count; i++) {
+        hblock_free(jobs[i].block);
+        free(jobs[i].in);
+        free(jobs[i].out);
+    }
+    free(jobs);
+    free(bodies);
+    return 0;
+}
+
+/**
+ * This function is used to decompress only a part of a file made
+ * of independent blocks. The index at the end of the file is used
+ * to find the block holding the beginning of the part, so only the
+ * blocks which overlap it are read and decoded. When that block
+ * repeats the table of an earlier block, only the table is read
+ * from the earlier block.
+ *
+ * @param in_fd The input file
+ * @param out_fd The output file
+ * @param header The container header
+ * @return 0 on success or error code
+ */
+int
+huffman_decode_range(int in_fd, int out_fd, hheader_t *header)
+{
+    uint8_t block_header[BLOCK_HEADER_MAX_SIZE];
+    uint8_t *input, *output;
+    uint64_t capacity, start, stop, first, last;
+    ssize_t bytes_read;
+    ssize_t footer;
+    int64_t entry;
+    hindex_t *index;
+    hblock_t *block;
+    int ret;
+
+    if (!(header->flags & HEADER_FLAG_INDEX)) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Range {index: none}");
+    }
+
+    index = hindex_create();
+    block = hblock_create(STREAM_DEFAULT_COUNT, header->flags & HEADER_FLAG_CHECKSUM);
+    if (!index || !block) {
+        ERROR_DEBUG("Error On Create {block}");
+    }
+
+    /* The index starts past the end of the blocks, which may be past 2 GiB */
+    footer = hindex_input(index, in_fd);
+    if (footer < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Input {index: %zd}", footer);
+    }
+
+    /* The range is cut short at the end of the original file */
+    start = range_offset;
+    stop = (range_length > header->original_length - start) ? header->original_length : start + range_length;
+    if (start >= header->original_length || !range_length) {
+        hindex_free(index);
+        hblock_free(block);
+        return 0;
+    }
+
+    capacity = hblock_bound(BLOCK_MAX_SIZE, STREAM_MAX_COUNT);
+    input = malloc(capacity + STREAM_PADDING);
+    output = malloc(BLOCK_MAX_SIZE);
+    if (!input || !output) {
+        ERROR_DEBUG("Error On Malloc {block: %u}", BLOCK_MAX_SIZE);
+    }
+
+    entry = hindex_find(index, start);
+    if (entry < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Find {range: %llu}", (unsigned long long)start);
+    }
+
+    /* Load the table the first block repeats from the block holding it */
+    if (index->entries[entry].table != entry) {
+        bytes_read = hio_pread(in_fd, input, block->header_size + CODE_PACK_MAX_SIZE,
+                           index->entries[index->entries[entry].table].offset);
+        if (bytes_read < (ssize_t)block->header_size) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Read {table: %u}", index->entries[entry].table);
+        }
+
+        ret = hblock_parse(block, input, bytes_read);
+        if (!ret) {
+            ret = hblock_prime(block, input + block->header_size, bytes_read - block->header_size);
+        }
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Prime {block: %d}", ret);
+        }
+    }
+
+    for (; (uint64_t)entry < index->count && index->entries[entry].original_offset < stop; entry++) {
+        bytes_read = hio_pread(in_fd, block_header, block->header_size, index->entries[entry].offset);
+        if (bytes_read < (ssize_t)block->header_size) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Read {block_header: %llu}",
+                        (unsigned long long)index->entries[entry].offset);
+        }
+
+        ret = hblock_parse(block, block_header, block->header_size);
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Parse {block: %d}", ret);
+        }
+
+        bytes_read = hio_pread(in_fd, input, block->size, index->entries[entry].offset + block->header_size);
+        if (bytes_read < (ssize_t)block->size) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Read {block: %u}", block->size);
+        }
+        memset(input + block->size, 0, STREAM_PADDING);
+
+        ret = hblock_decode(block, input, output, BLOCK_MAX_SIZE);
+        if (ret) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Decode {block: %d}", ret);
+        }
+
+        /* Only the part of the block inside the range is written */
+        first = (start > index->entries[entry].original_offset) ?
+                start - index->entries[entry].original_offset : 0;
+        last = stop - index->entries[entry].original_offset;
+        if (last > block->length) {
+            last = block->length;
+        }
+
+        if (hio_write(out_fd, output + first, last - first)) {
+            ERROR_DEBUG("Error On Write {out_fd: %d}", out_fd);
+        }
+    }
+
+    hindex_free(index);
+    hblock_free(block);
+    free(input);
+    free(output);
+    return 0;
+}
+
+/**
+ * This function is used to decompress a file with whichever engine
+ * its container header names. Files from before the header existed
+ * are always huffman trees followed by their opcodes. The header and everything up to
+ * the opcodes are read in a single call.
+ *
+ * @param in_fd The input file
+ * @param out_fd The output file
+ * @return 0 on success or error code
+ */
+int
+huffman_decode_file(int in_fd, int out_fd)
+{
+    int ret;
+    ssize_t header_size;
+    ssize_t prefix_size;
+    hheader_t *header;
+    uint8_t prefix[HUFFMAN_PREFIX_SIZE];
+
+    header = hheader_create();
+    if (!header) {
+        ERROR_DEBUG("Error On Create {header}");
+    }
+
+    prefix_size = hio_pread(in_fd, prefix, sizeof(prefix), 0);
+    if (prefix_size < 0 && errno == ESPIPE) {
+        /* A pipe is only read in order, which only the block decoder does */
+        header_size = hheader_input(header, in_fd);
+        if (header_size < 0 || header->engine != HEADER_ENGINE_BLOCKS ||
+            bvector_check_bit(flags, FLAG_RANGE) == VECTOR_BIT_SET) {
+            errno = EINVAL;
+            ERROR_DEBUG("Error On Input {stream: %ld}", header_size);
+        }
+
+        ret = huffman_decode_blocks(in_fd, out_fd, header);
+        hheader_free(header);
+        return ret;
+    } else if (prefix_size < 0) {
+        ERROR_DEBUG("Error On Read {prefix}");
+    }
+
+    header_size = hheader_unpack(header, prefix, prefix_size);
+    if (header_size == HEADER_ERROR_MAGIC || header_size == HEADER_ERROR_SHORT) {
+        hheader_free(header);
+        header = NULL;
+    } else if (header_size < 0) {
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Input {header: %ld}", header_size);
+    }
+
+    /* Only blocks carry the index which a range is decoded through */
+    if (bvector_check_bit(flags, FLAG_RANGE) == VECTOR_BIT_SET &&
+        (!header || header->engine != HEADER_ENGINE_BLOCKS)) {
+        hheader_free(header);
+        errno = EINVAL;
+        ERROR_DEBUG("Error On Input {range: not a block file}");
+    }
+
+    if (header && header->engine == HEADER_ENGINE_BLOCKS &&
+        bvector_check_bit(flags, FLAG_RANGE) == VECTOR_BIT_SET) {
+        ret = huffman_decode_range(in_fd, out_fd, header);
+    } else if (header && header->engine == HEADER_ENGINE_BLOCKS) {
+        ret = huffman_decode_blocks(in_fd, out_fd, header);
+    } else if (header && header->engine == HEADER_ENGINE_STREAMS) {
+        ret = huffman_decode_streams(in_fd, out_fd, header);
+    } else if (header) {
+        ret = huffman_decode(in_fd, out_fd, header, prefix, prefix_size);
+    } else {
+        ret = huffman_decode(in_fd, out_fd, NULL, prefix, prefix_size);
+    }
+
+    hheader_free(header);
+    return ret;
+}
+
+/**
+ * This function is used to test a compressed file. The file is
+ * decoded without writing any output and the result is reported
+ * along with the throughput of decoding, so that it doubles as a
+ * benchmark of how decoding scales with the number of threads.
+ *
+ * @param in_fd The input file
+ * @param name The name of the input file
+ * @return 0 on success or error code
+ */
+int
+huffman_test(int in_fd, const char *name)
+{
+    int ret;
+    double elapsed;
+    struct stat file_stat;
+    struct timespec start, stop;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = huffman_decode_file(in_fd, -1);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (ret) {
+        printf("%s: FAIL\n", name);
+        return ret;
+    }
+
+    /* Throughput is measured against the compressed size */
+    elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    file_stat.st_size = 0;
+    fstat(in_fd, &file_stat);
+    printf("%s: PASS (%lld bytes in %.3f s, %.1f MB/s, %d threads)\n", name,
+           (long long)file_stat.st_size, elapsed,
+           elapsed > 0 ? file_stat.st_size / elapsed / 1e6 : 0.0, thread_count);
+    return 0;
+}
+
+/**
+ * This function is used to tell whether a file name ends with a
+ * suffix.
+ *
+ * @param name The file name
+ * @param suffix The suffix
+ * @return 1 if it does or 0
+ */
+int
+has_suffix(const char *name, const char *suffix)
+{
+    size_t name_length = strlen(name);
+    size_t suffix_length = strlen(suffix);
+
+    return name_length > suffix_length && !strcmp(name + name_length - suffix_length, suffix);
+}
+
+/**
+ * This function is used to add a copy of a file name to the end of
+ * the names of a batch, growing the names as needed.
+ *
+ * @param names The names of the batch
+ * @param count The number of names
+ * @param capacity The number of names there is room for
+ * @param name The name to add
+ * @param name_length The length of the name
+ * @return 0 on success or error code
+ */
+int
+huffman_batch_add(char ***names, uint32_t *count, uint32_t *capacity, const char *name, size_t name_length)
+{
+    char **temp;
+
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        temp = realloc(*names, *capacity * sizeof(char*));
+        if (!temp) {
+            ERROR_DEBUG("Error On Malloc {names: %u}", *capacity);
+        }
+        *names = temp;
+    }
+
+    (*names)[*count] = strndup(name, name_length);
+    if (!(*names)[*count]) {
+        ERROR_DEBUG("Error On Malloc {name: %s}", name);
+    }
+    *count += 1;
+    return 0;
+}
+
+/**
+ * This function is used to find the files of a batch. A directory
+ * gives every regular file right inside it, which when decoding or
+ * testing are the files ending in HUFFMAN_SUFFIX and when encoding
+ * all the others. Anything else is a list with a file name on every
+ * line, where - is a list on standard input, and every name on it is
+ * taken as it is.
+ *
+ * @param name The list or directory
+ * @param names Where to put the names of the files
+ * @param count Where to put the number of files
+ * @return 0 on success or error code
+ */
+int
+huffman_batch_names(const char *name, char ***names, uint32_t *count)
+{
+    struct stat file_stat;
+    struct dirent *entry;
+    char path[PATH_MAX];
+    uint8_t *list;
+    uint64_t length, start, end, stop;
+    uint32_t capacity;
+    DIR *directory;
+    int fd, ret, compressed;
+
+    *names = NULL;
+    *count = 0;
+    capacity = 0;
+
+    if (strcmp(name, STANDARD_STREAM_NAME) && !stat(name, &file_stat) && S_ISDIR(file_stat.st_mode)) {
+        directory = opendir(name);
+        if (!directory) {
+            ERROR_DEBUG("Error On Open {directory: %s}", name);
+        }
+
+        while ((entry = readdir(directory))) {
+            if (snprintf(path, sizeof(path), "%s/%s", name, entry->d_name) >= (int)sizeof(path) ||
+                stat(path, &file_stat) || !S_ISREG(file_stat.st_mode)) {
+                continue;
+            }
+
+            /* Files which were compressed already are only ever decoded */
+            compressed = has_suffix(entry->d_name, HUFFMAN_SUFFIX);
+            if (compressed != (bvector_check_bit(flags, FLAG_DECODE) == VECTOR_BIT_SET)) {
+                continue;
+            }
+
+            ret = huffman_batch_add(names, count, &capacity, path, strlen(path));
+            if (ret) {
+                closedir(directory);
+                return ret;
+            }
+        }
+
+        closedir(directory);
+        return 0;
+    }
+
+    fd = strcmp(name, STANDARD_STREAM_NAME) ? open(name, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        ERROR_DEBUG("Error On Open {list: %s}", name);
+    }
+
+    list = read_file(fd, &length, 0);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (!list) {
+        ERROR_DEBUG("Error On Read {list: %s}", name);
+    }
+
+    for (start = 0; start < length; start = end + 1) {
+        for (end = start; end < length && list[end] != '\n'; end++);
+
+        /* Lines may end in a carriage return and empty ones are skipped */
+        stop = end;
+        if (stop > start && list[stop - 1] == '\r') {
+            stop -= 1;
+        }
+        if (stop == start) {
+            continue;
+        }
+
+        ret = huffman_batch_add(names, count, &capacity, (char*)list + start, stop - start);
+        if (ret) {
+            free(list);
+            return ret;
+        }
+    }
+
+    free(list);
+    return 0;
+}
+
+/**
+ * This function is used to work out where a file of a batch is
+ * written. An encoded file gets HUFFMAN_SUFFIX added and a decoded
+ * one gets it taken off. With an output directory the file is
+ * written there under the last part of its name, and otherwise it
+ * is written next to the file it comes from.
+ *
+ * @param name The name of the file of the batch
+ * @param path Where to put the name of the output file
+ * @param size The size of the name of the output file
+ * @return 0 on success or error code
+ */
+int
+huffman_batch_output(const char *name, char *path, size_t size)
+{
+    const char *base;
+    size_t length;
+    int written;
+
+    base = name;
+    if (output_filename != NULL) {
+        base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    }
+
+    length = strlen(base);
+    if (bvector_check_bit(flags, FLAG_ENCODE) == VECTOR_BIT_SET) {
+        written = snprintf(path, size, "%s%s%.*s%s", output_filename ? output_filename : "",
+                           output_filename ? "/" : "", (int)length, base, HUFFMAN_SUFFIX);
+    } else if (has_suffix(base, HUFFMAN_SUFFIX)) {
+        written = snprintf(path, size, "%s%s%.*s", output_filename ? output_filename : "",
+                           output_filename ? "/" : "", (int)(length - strlen(HUFFMAN_SUFFIX)), base);
+    } else {
+        written = snprintf(path, size, "%s%s%.*s%s", output_filename ? output_filename : "",
+                           output_filename ? "/" : "", (int)length, base, HUFFMAN_DECODED_SUFFIX);
+    }
+
+    if (written < 0 || (size_t)written >= size) {
+        errno = ENAMETOOLONG;
+        ERROR_DEBUG("Error On Output {name: %s}", name);
+    }
+    return 0;
+}
+
+/**
+ * This function is run by the workers of the pool for every file
+ * of a batch. The file is encoded, decoded or tested just as a
+ * single file is, and whatever was written of a file which failed
+ * is removed again.
+ *
+ * @param context The names of the files of the batch
+ * @param task The index of the file
+ * @return 0 on success or error code
+ */
+int
+huffman_batch_file(void *context, uint32_t task)
+{
+    char **names = context;
+    char path[PATH_MAX];
+    int in_fd, out_fd, ret;
+
+    in_fd = open(names[task], O_RDONLY);
+    if (in_fd < 0) {
+        ERROR_DEBUG("Error On Open {input: %s}", names[task]);
+    }
+
+    if (bvector_check_bit(flags, FLAG_TEST) == VECTOR_BIT_SET) {
+        ret = huffman_test(in_fd, names[task]);
+        close(in_fd);
+        return ret;
+    }
+
+    ret = huffman_batch_output(names[task], path, sizeof(path));
+    if (ret) {
+        close(in_fd);
+        return ret;
+    }
+
+    out_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        close(in_fd);
+        ERROR_DEBUG("Error On Open {output: %s}", path);
+    }
+
+    if (bvector_check_bit(flags, FLAG_DECODE) == VECTOR_BIT_SET) {
+        ret = huffman_decode_file(in_fd, out_fd);
+    } else {
+        ret = huffman_encode_blocks(in_fd, out_fd);
+    }
+
+    close(in_fd);
+    close(out_fd);
+    if (ret) {
+        printf("[BATCH] %s: FAIL\n", names[task]);
+        unlink(path);
+    }
+    return ret;
+}
+
+/**
+ * This function is used to encode, decode or test every file of a
+ * batch in one process. The files are run on a pool of as many
+ * workers as there are threads, one file on every worker at a
+ * time, so a single file is never split over threads. The files are
+ * dealt out by size, and workers which run out of files steal them
+ * from the others, which keeps every worker busy however the sizes
+ * of the files are mixed. Everything which is picked once for the
+ * whole process is picked by main before the workers start.
+ *
+ * @return 0 on success or error code
+ */
+int
+huffman_batch(void)
+{
+    struct stat file_stat;
+    struct timespec start, stop;
+    hpool_t *pool;
+    uint64_t *weights;
+    uint32_t i, count, worker_count;
+    char **names;
+    double seconds;
+    int ret;
+
+    ret = huffman_batch_names(batch_name, &names, &count);
+    if (ret) {
+        return ret;
+    }
+
+    weights = calloc(count ? count : 1, sizeof(uint64_t));
+    if (!weights) {
+        ERROR_DEBUG("Error On Malloc {weights: %u}", count);
+    }
+
+    /* Files are weighed by their size, and a file which is gone weighs nothing */
+    for (i = 0; i < count; i++) {
+        if (!stat(names[i], &file_stat)) {
+            weights[i] = file_stat.st_size;
+        }
+    }
+
+    /* Every worker works on a file of its own with one thread */
+    worker_count = ((uint32_t)thread_count < POOL_MAX_WORKERS) ? (uint32_t)thread_count : POOL_MAX_WORKERS;
+    thread_count = 1;
+
+    pool = hpool_create(worker_count);
+    if (!pool) {
+        ERROR_DEBUG("Error On Create {pool: %u}", worker_count);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = hpool_run(pool, count, weights, huffman_batch_file, names);
+    if (ret) {
+        ERROR_DEBUG("Error On Run {pool: %d}", ret);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (bvector_check_bit(flags, FLAG_PRINT) == VECTOR_BIT_SET) {
+        seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+        printf("[BATCH] %u files in %.3f s, %.1f files/s\n", count, seconds,
+               seconds > 0 ? count / seconds : 0.0);
+        hpool_report(pool, stdout);
+    }
+
+    ret = 0;
+    if (pool->failed) {
+        printf("[BATCH] %llu of %u files failed\n", (unsigned long long)pool->failed, count);
+        ret = EINVAL;
+    }
+
+    hpool_free(pool);
+    for (i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(weights);
+    return ret;
+}
+
+/**
+ * The main function reads in all arguments from the command line
+ * and performs huffman based encoding or decoding depending on the
  * flags given.
  *
  * @param argc The number of arguments passed.
@@ -559,21 +3059,68 @@ main(int argc, char *argv[])
         print_usage(-1);
     }
 
-    /* Open input and output file as required */
-    input_fd = open(input_filename, O_RDONLY);
+    /* The checksums are picked once, before any thread computes one */
+    hchecksum_select(CHECKSUM_AUTO);
+
+    /* The decoder is picked once, before any thread decodes */
+    if (bvector_check_bit(flags, FLAG_DECODE) == VECTOR_BIT_SET) {
+        hstream_select((bvector_check_bit(flags, FLAG_SCALAR) == VECTOR_BIT_SET) ?
+                       STREAM_DECODER_SCALAR : STREAM_DECODER_AUTO);
+    }
+
+    if (bvector_check_bit(flags, FLAG_BATCH) == VECTOR_BIT_SET) {
+        return huffman_batch();
+    }
+
+    /* Open input and output file as required, where - is a standard stream */
+    if (!strcmp(input_filename, STANDARD_STREAM_NAME)) {
+        input_fd = STDIN_FILENO;
+    } else {
+        input_fd = open(input_filename, O_RDONLY);
+    }
     if (input_fd < 0) {
         ERROR_DEBUG("Error On Open {input_fd: %d}", input_fd);
     }
 
-    output_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    /* Test mode never opens anything for writing */
+    if (bvector_check_bit(flags, FLAG_TEST) == VECTOR_BIT_SET) {
+        ret = huffman_test(input_fd, input_filename);
+        close(input_fd);
+        return ret;
+    }
+
+    /*
+     * Appending keeps what is already in the output file. Direct
+     * writes may have to read back the start of a partial chunk.
+     */
+    if (!strcmp(output_filename, STANDARD_STREAM_NAME)) {
+        output_fd = STDOUT_FILENO;
+    } else if (bvector_check_bit(flags, FLAG_APPEND) == VECTOR_BIT_SET) {
+        output_fd = open(output_filename, O_RDWR | O_CREAT, 0644);
+    } else if (bvector_check_bit(flags, FLAG_DIRECT) == VECTOR_BIT_SET) {
+        output_fd = open(output_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    } else {
+        output_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
     if (output_fd < 0) {
         ERROR_DEBUG("Error On Open {output_fd: %d}", output_fd);
     }
 
-    /* Run Encoding or Decoding */
-    if (bvector_check_bit(flags, FLAG_ENCODE) == VECTOR_BIT_SET) {
-        return huffman_encode(input_fd, output_fd);
+    /*
+     * Run Encoding or Decoding. The tree and stream encoders close
+     * the input as soon as they have read it, and the others leave it
+     * open, just as every file of a batch is.
+     */
+    if (bvector_check_bit(flags, FLAG_DECODE) == VECTOR_BIT_SET) {
+        ret = huffman_decode_file(input_fd, output_fd);
+    } else if (bvector_check_bit(flags, FLAG_BLOCKS) == VECTOR_BIT_SET) {
+        ret = huffman_encode_blocks(input_fd, output_fd);
+    } else if (bvector_check_bit(flags, FLAG_STREAMS) == VECTOR_BIT_SET) {
+        return huffman_encode_streams(input_fd, output_fd);
     } else {
-        return huffman_decode(input_fd, output_fd);
+        return huffman_encode(input_fd, output_fd);
     }
+
+    close(input_fd);
+    return ret;
 }
@@ -0,0 +1,657 @@
+/*
+ * This file defines the interface for using blocks. The input is
+ * cut into independent blocks which each carry their own compact
+ * table, so that every block can be encoded and decoded on its own
+ * with a bounded amount of memory.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_block.h"
+#include "huffman_endian.h"
+
+/**
+ * This function computes the number of bits the opcodes of a
+ * block take up when coded with a table. This function is not
+ * presented as an interface function.
+ *
+ * @param hcode The table to code with.
+ * @param frequencies The frequencies of the elements of the block.
+ * @return The number of bits or UINT64_MAX if an element is missing
+ */
+static uint64_t
+_cost(hcode_t *hcode, uint64_t *frequencies)
+{
+    int i;
+    uint64_t bits = 0;
+
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        if (!frequencies[i]) {
+            continue;
+        } else if (!hcode->lengths[i]) {
+            return UINT64_MAX;
+        }
+        bits += frequencies[i] * hcode->lengths[i];
+    }
+
+    return bits;
+}
+
+/**
+ * This function counts the elements of a block once for every
+ * stream it is split into, along with the whole block. This
+ * function is not presented as an interface function.
+ *
+ * @param hblock The block state.
+ * @param in The elements of the block.
+ * @param length The number of elements.
+ */
+static void
+_count_segments(hblock_t *hblock, const uint8_t *in, uint64_t length)
+{
+    uint64_t segment, start, end;
+    int i, j;
+
+    memset(hblock->frequencies, 0, sizeof(hblock->frequencies));
+    segment = STREAM_SEGMENT(length, hblock->stream_count);
+    for (i = 0; i < hblock->stream_count; i++) {
+        start = ((uint64_t)i * segment < length) ? (uint64_t)i * segment : length;
+        end = (start + segment < length) ? start + segment : length;
+
+        hcode_count(hblock->segments[i], in + start, end - start);
+        for (j = 0; j < CODE_MAX_SYMBOLS; j++) {
+            hblock->frequencies[j] += hblock->segments[i][j];
+        }
+    }
+}
+
+/**
+ * This function writes the header of the block which was just
+ * encoded in front of its body. This function is not presented
+ * as an interface function.
+ *
+ * @param hblock The block state.
+ * @param out The buffer the block was encoded into.
+ * @return The size of the block with its header
+ */
+static ssize_t
+_header(hblock_t *hblock, uint8_t *out)
+{
+    out[BLOCK_TYPE_OFFSET] = hblock->type | (hblock->repeat ? BLOCK_FLAG_REPEAT : 0);
+    hendian_put(out + BLOCK_LENGTH_OFFSET, hblock->length, sizeof(uint32_t));
+    hendian_put(out + BLOCK_SIZE_OFFSET, hblock->size, sizeof(uint32_t));
+    if (hblock->checksums) {
+        hendian_put(out + BLOCK_CHECKSUM_OFFSET, hblock->checksum, sizeof(uint32_t));
+    }
+    return hblock->header_size + hblock->size;
+}
+
+/**
+ * This function is used to build a new block state which
+ * encodes blocks into a number of streams. The same state is
+ * used for every block of a file.
+ *
+ * @param stream_count The number of streams to encode into.
+ * @param checksums Whether every block carries a checksum.
+ * @return A block state or NULL
+ */
+hblock_t*
+hblock_create(uint8_t stream_count, uint8_t checksums)
+{
+    hblock_t *temp;
+
+    if (stream_count < 1 || stream_count > STREAM_MAX_COUNT) {
+        return NULL;
+    }
+
+    temp = calloc(1, sizeof(hblock_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    temp->code = hcode_create();
+    temp->fresh = hcode_create();
+    if (!temp->code || !temp->fresh) {
+        hcode_free(temp->code);
+        hcode_free(temp->fresh);
+        free(temp);
+        return NULL;
+    }
+
+    temp->stream_count = stream_count;
+    temp->table_size = BLOCK_TABLE_UNLOADED;
+    temp->checksums = checksums ? 1 : 0;
+    temp->header_size = checksums ? BLOCK_HEADER_MAX_SIZE : BLOCK_HEADER_SIZE;
+    return temp;
+}
+
+/**
+ * This function is used to free a block state.
+ *
+ * @param hblock The block state to free
+ */
+void
+hblock_free(hblock_t *hblock)
+{
+    if (!hblock) {
+        return;
+    }
+
+    hcode_free(hblock->code);
+    hcode_free(hblock->fresh);
+    free(hblock);
+}
+
+/**
+ * This function is used to compute the largest size that
+ * encoding a block of a length can produce, header included.
+ *
+ * @param length The number of elements in the block.
+ * @param stream_count The number of streams.
+ * @return The largest encoded size
+ */
+uint64_t
+hblock_bound(uint64_t length, uint8_t stream_count)
+{
+    return BLOCK_HEADER_MAX_SIZE + CODE_PACK_MAX_SIZE + hstream_bound(length, stream_count);
+}
+
+/**
+ * This function is used to take the first look at the elements
+ * of a block. They are counted and a fresh table is built from
+ * them, but nothing depends on any other block, so the blocks of
+ * a file can be prepared in any order. A block in which only one
+ * element appears is marked as a run. The checksum of the block
+ * is computed while the block is still in cache from being counted.
+ *
+ * @param hblock The block state.
+ * @param in The elements of the block.
+ * @param length The number of elements, at most BLOCK_MAX_SIZE.
+ * @return 0 on success or error code
+ */
+int
+hblock_prepare(hblock_t *hblock, const uint8_t *in, uint64_t length)
+{
+    if (!hblock || !in) {
+        return BLOCK_ERROR_ARGUMENT;
+    } else if (length < 1 || length > BLOCK_MAX_SIZE) {
+        return BLOCK_ERROR_LENGTH;
+    }
+
+    if (hblock->sized) {
+        _count_segments(hblock, in, length);
+    } else {
+        hcode_count(hblock->frequencies, in, length);
+    }
+    hblock->length = length;
+    hblock->repeat = 0;
+    if (hblock->checksums) {
+        hblock->checksum = hchecksum_update(CHECKSUM_INITIAL, in, length);
+    }
+
+    if (hblock->frequencies[in[0]] == length) {
+        hblock->type = BLOCK_TYPE_RLE;
+        return 0;
+    }
+
+    if (!hcode_build(hblock->fresh, hblock->frequencies)) {
+        return BLOCK_ERROR_TABLE;
+    }
+
+    hblock->type = BLOCK_TYPE_HUFFMAN;
+    return 0;
+}
+
+/**
+ * This function is used to choose how a prepared block is coded,
+ * given the block before it. The table of the previous block is
+ * reused instead of the fresh one when it costs at most
+ * BLOCK_REPEAT_THRESHOLD 1024ths more, so that the block carries
+ * no table at all. When the cost of the chosen table is no smaller
+ * than the block, the block is stored as it is. Blocks must be
+ * chosen in the order of the file, but this only looks at the
+ * frequencies so it costs next to nothing.
+ *
+ * @param hblock The prepared block state.
+ * @param previous The block before it, itself or NULL for the first.
+ * @return 0 on success or error code
+ */
+int
+hblock_choose(hblock_t *hblock, hblock_t *previous)
+{
+    uint64_t fresh_cost, repeat_cost, estimate;
+    hcode_t *temp;
+
+    if (!hblock) {
+        return BLOCK_ERROR_ARGUMENT;
+    }
+
+    /* The table of the previous block is carried on to the next one */
+    if (!previous) {
+        hblock->code->present = 0;
+    } else if (previous != hblock) {
+        memcpy(hblock->code, previous->code, sizeof(hcode_t));
+    }
+
+    if (hblock->type == BLOCK_TYPE_RLE) {
+        return 0;
+    }
+
+    /* A block without a table before it always gets a fresh one */
+    repeat_cost = UINT64_MAX;
+    if (hblock->code->present) {
+        repeat_cost = _cost(hblock->code, hblock->frequencies);
+    }
+    fresh_cost = _cost(hblock->fresh, hblock->frequencies) + CODE_PACK_SIZE(hblock->fresh->present) * 8;
+
+    hblock->repeat = (repeat_cost != UINT64_MAX &&
+                      repeat_cost <= fresh_cost + (fresh_cost * BLOCK_REPEAT_THRESHOLD) / 1024);
+
+    /* Data which does not compress is copied through verbatim */
+    estimate = ((hblock->repeat ? repeat_cost : fresh_cost) + 7) / 8 + STREAM_HEADER_SIZE(hblock->stream_count);
+    if (estimate >= hblock->length) {
+        hblock->type = BLOCK_TYPE_STORED;
+        hblock->repeat = 0;
+        return 0;
+    }
+
+    if (!hblock->repeat) {
+        temp = hblock->code;
+        hblock->code = hblock->fresh;
+        hblock->fresh = temp;
+    }
+
+    hblock->type = BLOCK_TYPE_HUFFMAN;
+    return 0;
+}
+
+/**
+ * This function is used to compute the exact number of bytes a
+ * chosen block is emitted into, its header included. Every stream
+ * takes the bits of the elements it was counted with, rounded up to
+ * a whole byte, so the size is known from the frequencies and the
+ * chosen table alone. Blocks which are stored, passed through or
+ * not, take the size of their elements.
+ *
+ * @param hblock The chosen block state, prepared as a sized block.
+ * @return The number of bytes the block is emitted into or error code
+ */
+ssize_t
+hblock_size(hblock_t *hblock)
+{
+    uint64_t size, bits;
+    int i;
+
+    if (!hblock || !hblock->sized) {
+        return BLOCK_ERROR_ARGUMENT;
+    }
+
+    if (hblock->type == BLOCK_TYPE_RLE) {
+        return hblock->header_size + BLOCK_RLE_SIZE;
+    } else if (hblock->type == BLOCK_TYPE_STORED) {
+        return hblock->header_size + hblock->length;
+    }
+
+    size = hblock->header_size + STREAM_HEADER_SIZE(hblock->stream_count);
+    if (!hblock->repeat) {
+        size += CODE_PACK_SIZE(hblock->code->present);
+    }
+
+    for (i = 0; i < hblock->stream_count; i++) {
+        bits = _cost(hblock->code, hblock->segments[i]);
+        if (bits == UINT64_MAX) {
+            return BLOCK_ERROR_TABLE;
+        }
+        size += (bits + 7) / 8;
+    }
+
+    return size;
+}
+
+/**
+ * This function is used to encode a chosen block along with its
+ * header into a buffer. Nothing depends on any other block, so
+ * the blocks of a file can be emitted in any order. When the state
+ * passes stored blocks through, only the header of a stored block
+ * is written and its body is left for the caller.
+ *
+ * @param hblock The chosen block state.
+ * @param in The elements of the block.
+ * @param out The buffer to encode into.
+ * @param capacity The size of the buffer.
+ * @return The number of bytes encoded or error code
+ */
+ssize_t
+hblock_emit(hblock_t *hblock, const uint8_t *in, uint8_t *out, uint64_t capacity)
+{
+    ssize_t code_size, stream_size;
+
+    if (!hblock || !in || !out) {
+        return BLOCK_ERROR_ARGUMENT;
+    } else if (capacity < hblock->header_size) {
+        return BLOCK_ERROR_SHORT;
+    }
+
+    if (hblock->type == BLOCK_TYPE_RLE) {
+        if (capacity < hblock->header_size + BLOCK_RLE_SIZE) {
+            return BLOCK_ERROR_SHORT;
+        }
+
+        out[hblock->header_size] = in[0];
+        hblock->size = BLOCK_RLE_SIZE;
+        return _header(hblock, out);
+    } else if (hblock->type == BLOCK_TYPE_STORED) {
+        if (capacity < hblock->header_size + hblock->length) {
+            return BLOCK_ERROR_SHORT;
+        }
+
+        if (!hblock->passthrough) {
+            memcpy(out + hblock->header_size, in, hblock->length);
+        }
+        hblock->size = hblock->length;
+        return _header(hblock, out);
+    }
+
+    code_size = 0;
+    if (!hblock->repeat) {
+        code_size = hcode_pack(hblock->code, out + hblock->header_size, capacity - hblock->header_size);
+        if (code_size < 0) {
+            return BLOCK_ERROR_SHORT;
+        }
+    }
+
+    stream_size = hstream_encode(hblock->code, in, hblock->length, hblock->stream_count,
+                                 out + hblock->header_size + code_size,
+                                 capacity - hblock->header_size - code_size);
+    if (stream_size < 0) {
+        return BLOCK_ERROR_SHORT;
+    }
+
+    hblock->size = code_size + stream_size;
+    return _header(hblock, out);
+}
+
+/**
+ * This function is used to encode a block along with its
+ * header into a buffer. It prepares, chooses and emits the block
+ * in one go, with the block before it being the one this state
+ * last encoded.
+ *
+ * @param hblock The block state.
+ * @param in The elements of the block.
+ * @param length The number of elements, at most BLOCK_MAX_SIZE.
+ * @param out The buffer to encode into.
+ * @param capacity The size of the buffer.
+ * @return The number of bytes encoded or error code
+ */
+ssize_t
+hblock_encode(hblock_t *hblock, const uint8_t *in, uint64_t length, uint8_t *out, uint64_t capacity)
+{
+    int ret;
+
+    ret = hblock_prepare(hblock, in, length);
+    if (ret) {
+        return ret;
+    }
+
+    ret = hblock_choose(hblock, hblock);
+    if (ret) {
+        return ret;
+    }
+
+    return hblock_emit(hblock, in, out, capacity);
+}
+
+/**
+ * This function is used to read the header of a block so that
+ * the caller knows how much of the file the body takes up and
+ * how large the decoded block is.
+ *
+ * @param hblock The block state to read into.
+ * @param in The header of the block.
+ * @param size The number of bytes available.
+ * @return 0 on success or error code
+ */
+int
+hblock_parse(hblock_t *hblock, const uint8_t *in, uint64_t size)
+{
+    if (!hblock || !in) {
+        return BLOCK_ERROR_ARGUMENT;
+    } else if (size < hblock->header_size) {
+        return BLOCK_ERROR_SHORT;
+    }
+
+    hblock->type = in[BLOCK_TYPE_OFFSET] & BLOCK_TYPE_MASK;
+    hblock->repeat = (in[BLOCK_TYPE_OFFSET] & BLOCK_FLAG_REPEAT) ? 1 : 0;
+    hblock->length = hendian_get(in + BLOCK_LENGTH_OFFSET, sizeof(uint32_t));
+    hblock->size = hendian_get(in + BLOCK_SIZE_OFFSET, sizeof(uint32_t));
+    hblock->table_size = BLOCK_TABLE_UNLOADED;
+    if (hblock->checksums) {
+        hblock->checksum = hendian_get(in + BLOCK_CHECKSUM_OFFSET, sizeof(uint32_t));
+    }
+
+    if (hblock->type >= BLOCK_TYPE_COUNT) {
+        return BLOCK_ERROR_TYPE;
+    } else if (hblock->length < 1 || hblock->length > BLOCK_MAX_SIZE) {
+        return BLOCK_ERROR_LENGTH;
+    } else if (hblock->size > hblock_bound(hblock->length, STREAM_MAX_COUNT)) {
+        return BLOCK_ERROR_LENGTH;
+    } else if (hblock->type == BLOCK_TYPE_STORED && (hblock->repeat || hblock->size != hblock->length)) {
+        return BLOCK_ERROR_LENGTH;
+    } else if (hblock->type == BLOCK_TYPE_RLE && (hblock->repeat || hblock->size != BLOCK_RLE_SIZE)) {
+        return BLOCK_ERROR_LENGTH;
+    }
+
+    return 0;
+}
+
+/**
+ * This function reads the table at the beginning of the body of
+ * a block and returns where the payload begins. A block which
+ * repeats the previous table has none, and a table which was loaded
+ * already by hblock_prime or hblock_follow is not loaded again. In
+ * both cases the table is left as it is. This function is not
+ * presented as an interface function.
+ *
+ * @param hblock The block state.
+ * @param in The body of the block.
+ * @return The size of the table or error code
+ */
+static ssize_t
+_table(hblock_t *hblock, const uint8_t *in)
+{
+    ssize_t code_size;
+
+    if (hblock->repeat) {
+        return hblock->code->present ? 0 : BLOCK_ERROR_TABLE;
+    } else if (hblock->table_size != BLOCK_TABLE_UNLOADED) {
+        return hblock->table_size;
+    }
+
+    code_size = hcode_unpack(hblock->code, in, hblock->size);
+    if (code_size < 0) {
+        return BLOCK_ERROR_TABLE;
+    }
+
+    hblock->table_size = code_size;
+    return code_size;
+}
+
+/**
+ * This function compares the checksum of what a block decoded
+ * to with the checksum in its header, when blocks carry one.
+ * This function is not presented as an interface function.
+ *
+ * @param hblock The block state.
+ * @param checksum The checksum of the decoded block.
+ * @return 0 on success or error code
+ */
+static int
+_checksum(hblock_t *hblock, uint32_t checksum)
+{
+    if (hblock->checksums && checksum != hblock->checksum) {
+        return BLOCK_ERROR_CHECKSUM;
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to decode the body of a block whose
+ * header was read by hblock_parse and check its checksum. The
+ * body must be followed by STREAM_PADDING readable bytes.
+ *
+ * @param hblock The block state.
+ * @param in The body of the block.
+ * @param out The buffer to decode into.
+ * @param capacity The size of the buffer.
+ * @return 0 on success or error code
+ */
+int
+hblock_decode(hblock_t *hblock, const uint8_t *in, uint8_t *out, uint64_t capacity)
+{
+    ssize_t code_size;
+
+    if (!hblock || !in || !out) {
+        return BLOCK_ERROR_ARGUMENT;
+    } else if (capacity < hblock->length) {
+        return BLOCK_ERROR_SHORT;
+    }
+
+    if (hblock->type == BLOCK_TYPE_STORED) {
+        memcpy(out, in, hblock->length);
+    } else if (hblock->type == BLOCK_TYPE_RLE) {
+        memset(out, in[0], hblock->length);
+        return _checksum(hblock, hchecksum_run(CHECKSUM_INITIAL, in[0], hblock->length));
+    } else {
+        code_size = _table(hblock, in);
+        if (code_size < 0) {
+            return code_size;
+        }
+
+        if (hstream_decode(hblock->code, in + code_size, hblock->size - code_size, out, hblock->length)) {
+            return BLOCK_ERROR_PAYLOAD;
+        }
+    }
+
+    if (!hblock->checksums) {
+        return 0;
+    }
+
+    return _checksum(hblock, hchecksum_update(CHECKSUM_INITIAL, out, hblock->length));
+}
+
+/**
+ * This function is used to check that the body of a block
+ * decodes correctly and matches its checksum, using only a
+ * small scratch buffer. The body must be followed by
+ * STREAM_PADDING readable bytes.
+ *
+ * @param hblock The block state.
+ * @param in The body of the block.
+ * @param scratch The scratch buffer.
+ * @param scratch_size The size of the scratch buffer.
+ * @return 0 on success or error code
+ */
+int
+hblock_verify(hblock_t *hblock, const uint8_t *in, uint8_t *scratch, uint64_t scratch_size)
+{
+    ssize_t code_size;
+    uint32_t checksum;
+
+    if (!hblock || !in || !scratch) {
+        return BLOCK_ERROR_ARGUMENT;
+    }
+
+    /* Stored and run blocks are their own output */
+    if (hblock->type == BLOCK_TYPE_STORED) {
+        return hblock->checksums ? _checksum(hblock, hchecksum_update(CHECKSUM_INITIAL, in, hblock->length)) : 0;
+    } else if (hblock->type == BLOCK_TYPE_RLE) {
+        return _checksum(hblock, hchecksum_run(CHECKSUM_INITIAL, in[0], hblock->length));
+    }
+
+    code_size = _table(hblock, in);
+    if (code_size < 0) {
+        return code_size;
+    }
+
+    if (hstream_verify(hblock->code, in + code_size, hblock->size - code_size,
+                       hblock->length, scratch, scratch_size,
+                       hblock->checksums ? &checksum : NULL)) {
+        return BLOCK_ERROR_PAYLOAD;
+    }
+
+    return hblock->checksums ? _checksum(hblock, checksum) : 0;
+}
+
+/**
+ * This function is used to load the table of a block whose
+ * header was read by hblock_parse without decoding the block,
+ * so that a later block which repeats the table can be decoded
+ * without decoding every block before it. Only the beginning of
+ * the body which holds the table needs to be given.
+ *
+ * @param hblock The block state.
+ * @param in The beginning of the body of the block.
+ * @param size The number of bytes available.
+ * @return 0 on success or error code
+ */
+int
+hblock_prime(hblock_t *hblock, const uint8_t *in, uint64_t size)
+{
+    ssize_t code_size;
+
+    if (!hblock || !in) {
+        return BLOCK_ERROR_ARGUMENT;
+    } else if (hblock->type != BLOCK_TYPE_HUFFMAN || hblock->repeat) {
+        return BLOCK_ERROR_TYPE;
+    }
+
+    if (size > hblock->size) {
+        size = hblock->size;
+    }
+
+    code_size = hcode_unpack(hblock->code, in, size);
+    if (code_size < 0) {
+        return BLOCK_ERROR_TABLE;
+    }
+
+    /* Decoding the block later on starts right after the table */
+    hblock->table_size = code_size;
+    return 0;
+}
+
+/**
+ * This function is used to carry the table of the block before
+ * over to a block whose header was read by hblock_parse. A block
+ * with a table of its own loads it instead, so that the block after
+ * it can follow it in turn. Once every block of a batch has followed
+ * the one before it in the order of the file, the blocks can be
+ * decoded in any order.
+ *
+ * @param hblock The block state.
+ * @param previous The block before it, itself or NULL for the first.
+ * @param in The body of the block.
+ * @return 0 on success or error code
+ */
+int
+hblock_follow(hblock_t *hblock, hblock_t *previous, const uint8_t *in)
+{
+    if (!hblock || !in) {
+        return BLOCK_ERROR_ARGUMENT;
+    }
+
+    if (!previous) {
+        hblock->code->present = 0;
+    } else if (previous != hblock) {
+        memcpy(hblock->code, previous->code, sizeof(hcode_t));
+    }
+
+    if (hblock->type != BLOCK_TYPE_HUFFMAN) {
+        return 0;
+    } else if (hblock->repeat) {
+        return hblock->code->present ? 0 : BLOCK_ERROR_TABLE;
+    }
+
+    return hblock_prime(hblock, in, hblock->size);
+}
@@ -0,0 +1,220 @@
+/*
+ * This file declares the interface for using blocks. The input is
+ * cut into independent blocks which each carry their own compact
+ * table, so that every block can be encoded and decoded on its own
+ * with a bounded amount of memory.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "huffman_code.h"
+#include "huffman_stream.h"
+#include "huffman_checksum.h"
+
+#ifndef HUFFMAN_BLOCK_H
+#define HUFFMAN_BLOCK_H
+
+/* Block Sizes */
+#define BLOCK_MIN_SIZE                  (1U << 17)
+#define BLOCK_DEFAULT_SIZE              (1U << 20)
+#define BLOCK_MAX_SIZE                  (1U << 22)
+
+/* Block Types */
+#define BLOCK_TYPE_HUFFMAN              (0U)
+#define BLOCK_TYPE_STORED               (1U)
+#define BLOCK_TYPE_RLE                  (2U)
+#define BLOCK_TYPE_COUNT                (3U)
+
+/* The body of a run length block is the single element it repeats */
+#define BLOCK_RLE_SIZE                  (sizeof(uint8_t))
+#define BLOCK_TYPE_MASK                 (0x7FU)
+
+/*
+ * This flag is set in the type of a huffman block which has no
+ * table of its own and reuses the table of the block before it.
+ */
+#define BLOCK_FLAG_REPEAT               (0x80U)
+
+/*
+ * The table of the previous block is reused when coding a block
+ * with it costs at most this many 1024ths more than coding it with
+ * a fresh table, the fresh table itself included.
+ */
+#define BLOCK_REPEAT_THRESHOLD          (16U)
+
+/* The size of the table of a block whose table was not loaded yet */
+#define BLOCK_TABLE_UNLOADED            (-1)
+
+/*
+ * These are the macros for the header of a block in a file. The
+ * size is the number of bytes which follow the header, so that a
+ * block can be skipped without being decoded.
+ */
+#define BLOCK_TYPE_OFFSET               (0U)
+#define BLOCK_LENGTH_OFFSET             (BLOCK_TYPE_OFFSET + sizeof(uint8_t))
+#define BLOCK_SIZE_OFFSET               (BLOCK_LENGTH_OFFSET + sizeof(uint32_t))
+#define BLOCK_HEADER_SIZE               (BLOCK_SIZE_OFFSET + sizeof(uint32_t))
+
+/* The checksum of the block follows when checksums are on */
+#define BLOCK_CHECKSUM_OFFSET           (BLOCK_HEADER_SIZE)
+#define BLOCK_HEADER_MAX_SIZE           (BLOCK_CHECKSUM_OFFSET + CHECKSUM_SIZE)
+
+/* Block Errors */
+#define BLOCK_ERROR_ARGUMENT            (-1)
+#define BLOCK_ERROR_SHORT               (-2)
+#define BLOCK_ERROR_TYPE                (-3)
+#define BLOCK_ERROR_LENGTH              (-4)
+#define BLOCK_ERROR_TABLE               (-5)
+#define BLOCK_ERROR_PAYLOAD             (-6)
+#define BLOCK_ERROR_CHECKSUM            (-7)
+
+typedef struct huffman_block {
+    /* This is the type of the block */
+    uint8_t type;
+
+    /* This is set when the block reuses the previous table */
+    uint8_t repeat;
+
+    /* This is the number of original elements in the block */
+    uint32_t length;
+
+    /* This is the number of bytes following the block header */
+    uint32_t size;
+
+    /* This is the CRC32C of the original elements of the block */
+    uint32_t checksum;
+
+    /* This is set when every block carries a checksum */
+    uint8_t checksums;
+
+    /* This is the size of the header of every block */
+    uint8_t header_size;
+
+    /* This is the number of streams a block is encoded into */
+    uint8_t stream_count;
+
+    /*
+     * This is set when the body of a stored block is left out when
+     * it is encoded, for the caller to copy from the input itself.
+     */
+    uint8_t passthrough;
+
+    /*
+     * This is set when the exact size of a block is computed before
+     * it is emitted, which needs the elements of every stream to be
+     * counted on their own.
+     */
+    uint8_t sized;
+
+    /* This is the table of the block last encoded or decoded */
+    hcode_t *code;
+
+    /*
+     * This is the size of the table of the block being decoded once
+     * it was loaded, so that it is not loaded again, or
+     * BLOCK_TABLE_UNLOADED until then.
+     */
+    int32_t table_size;
+
+    /* This is where a fresh table is built to compare against */
+    hcode_t *fresh;
+
+    /* These are the frequencies of the block being encoded */
+    uint64_t frequencies[CODE_MAX_SYMBOLS];
+
+    /* These are the frequencies of every stream of a sized block */
+    uint64_t segments[STREAM_MAX_COUNT][CODE_MAX_SYMBOLS];
+} hblock_t;
+
+/**
+ * This function is used to build a new block state which
+ * encodes blocks into a number of streams, with or without
+ * checksums.
+ */
+hblock_t* hblock_create(uint8_t, uint8_t);
+
+/**
+ * This function is used to free a block state.
+ */
+void hblock_free(hblock_t*);
+
+/**
+ * This function is used to compute the largest size that
+ * encoding a block of a length can produce.
+ */
+uint64_t hblock_bound(uint64_t, uint8_t);
+
+/**
+ * This function is used to count the elements of a block and
+ * build a fresh table for it, independently of any other block.
+ */
+int hblock_prepare(hblock_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to choose how a prepared block is
+ * coded given the block before it, reusing the previous table
+ * when it is nearly as good as a fresh one and storing the block
+ * as it is when coding would not make it smaller.
+ */
+int hblock_choose(hblock_t*, hblock_t*);
+
+/**
+ * This function is used to compute the exact number of bytes a
+ * chosen block is emitted into, before emitting it.
+ */
+ssize_t hblock_size(hblock_t*);
+
+/**
+ * This function is used to encode a chosen block along with
+ * its header into a buffer, independently of any other block.
+ */
+ssize_t hblock_emit(hblock_t*, const uint8_t*, uint8_t*, uint64_t);
+
+/**
+ * This function is used to encode a block along with its
+ * header into a buffer, reusing the previous table when it
+ * is nearly as good as a fresh one and storing the block as
+ * it is when coding would not make it smaller. A block of a
+ * single element is stored as a run.
+ */
+ssize_t hblock_encode(hblock_t*, const uint8_t*, uint64_t, uint8_t*, uint64_t);
+
+/**
+ * This function is used to read the header of a block.
+ */
+int hblock_parse(hblock_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to decode the body of a block whose
+ * header was read by hblock_parse and check its checksum.
+ */
+int hblock_decode(hblock_t*, const uint8_t*, uint8_t*, uint64_t);
+
+/**
+ * This function is used to check that the body of a block
+ * decodes correctly and matches its checksum, using only a
+ * small scratch buffer.
+ */
+int hblock_verify(hblock_t*, const uint8_t*, uint8_t*, uint64_t);
+
+/**
+ * This function is used to load the table of a block whose
+ * header was read by hblock_parse without decoding it, so that
+ * a later block which repeats the table can be decoded alone.
+ */
+int hblock_prime(hblock_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to carry the table of the block before
+ * over to a block whose header was read by hblock_parse, so that
+ * the block can be decoded on its own.
+ */
+int hblock_follow(hblock_t*, hblock_t*, const uint8_t*);
+
+#endif
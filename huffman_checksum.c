@@ -0,0 +1,292 @@
+/*
+ * This file defines the interface for computing CRC32C checksums
+ * of the original elements. The SSE4.2 crc32 instruction is used
+ * when the processor has it, and a slice-by-8 table otherwise.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_checksum.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CHECKSUM_HAVE_SSE42
+#endif
+
+/* The size of the piece a run is built up from */
+#define CHECKSUM_RUN_SIZE               (256U)
+
+/* This is the implementation which was selected */
+static int checksum_implementation = -1;
+
+/* These are the slice-by-8 tables, table[0] being the plain table */
+static uint32_t checksum_table[8][256];
+
+/*
+ * These are x to the power of every power of two, modulo the
+ * polynomial, which are used to combine checksums.
+ */
+static uint32_t checksum_powers[32];
+
+/**
+ * This function multiplies two polynomials modulo the polynomial,
+ * both of them bit reflected the way the checksum is. This function
+ * is not presented as an interface function.
+ *
+ * @param a The first polynomial.
+ * @param b The second polynomial.
+ * @return The product
+ */
+static uint32_t
+_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t m, p;
+
+    m = 1U << 31;
+    p = 0;
+    while (m) {
+        if (a & m) {
+            p ^= b;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CHECKSUM_POLYNOMIAL : b >> 1;
+    }
+
+    return p;
+}
+
+/**
+ * This function computes x to the power of n times two to the
+ * power of k, modulo the polynomial. This function is not presented
+ * as an interface function.
+ *
+ * @param n The multiple.
+ * @param k The power of two.
+ * @return The power of x
+ */
+static uint32_t
+_power(uint64_t n, int k)
+{
+    uint32_t p;
+
+    /* This is x to the power of 0 */
+    p = 1U << 31;
+    while (n) {
+        if (n & 1) {
+            p = _multiply(checksum_powers[k & 31], p);
+        }
+        n >>= 1;
+        k += 1;
+    }
+
+    return p;
+}
+
+/**
+ * This function builds the slice-by-8 tables and the powers of x
+ * used to combine checksums. This function is not presented as an
+ * interface function.
+ */
+static void
+_setup()
+{
+    int i, j;
+    uint32_t crc;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CHECKSUM_POLYNOMIAL : crc >> 1;
+        }
+        checksum_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc = checksum_table[0][i];
+        for (j = 1; j < 8; j++) {
+            crc = checksum_table[0][crc & 0xFF] ^ (crc >> 8);
+            checksum_table[j][i] = crc;
+        }
+    }
+
+    /* This is x to the power of 1 */
+    checksum_powers[0] = 1U << 30;
+    for (i = 1; i < 32; i++) {
+        checksum_powers[i] = _multiply(checksum_powers[i - 1], checksum_powers[i - 1]);
+    }
+}
+
+/**
+ * This function continues a checksum, without its final inversion,
+ * eight elements at a time using the slice-by-8 tables. This
+ * function is not presented as an interface function.
+ *
+ * @param crc The checksum so far.
+ * @param buffer The elements.
+ * @param length The number of elements.
+ * @return The checksum
+ */
+static uint32_t
+_update_table(uint32_t crc, const uint8_t *buffer, uint64_t length)
+{
+    uint64_t word;
+
+    while (length >= 8) {
+        memcpy(&word, buffer, sizeof(word));
+        word ^= crc;
+        crc = checksum_table[7][word & 0xFF] ^
+              checksum_table[6][(word >> 8) & 0xFF] ^
+              checksum_table[5][(word >> 16) & 0xFF] ^
+              checksum_table[4][(word >> 24) & 0xFF] ^
+              checksum_table[3][(word >> 32) & 0xFF] ^
+              checksum_table[2][(word >> 40) & 0xFF] ^
+              checksum_table[1][(word >> 48) & 0xFF] ^
+              checksum_table[0][word >> 56];
+        buffer += 8;
+        length -= 8;
+    }
+
+    while (length--) {
+        crc = checksum_table[0][(crc ^ *buffer++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef CHECKSUM_HAVE_SSE42
+/**
+ * This function continues a checksum, without its final inversion,
+ * eight elements at a time using the SSE4.2 crc32 instruction. This
+ * function is not presented as an interface function.
+ *
+ * @param crc The checksum so far.
+ * @param buffer The elements.
+ * @param length The number of elements.
+ * @return The checksum
+ */
+__attribute__((target("sse4.2")))
+static uint32_t
+_update_sse42(uint32_t crc, const uint8_t *buffer, uint64_t length)
+{
+    uint64_t word, wide;
+
+    wide = crc;
+    while (length >= 8) {
+        memcpy(&word, buffer, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+        buffer += 8;
+        length -= 8;
+    }
+
+    crc = wide;
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *buffer++);
+    }
+
+    return crc;
+}
+#endif
+
+/**
+ * This function is used to pick the implementation used for
+ * every checksum. The SSE4.2 implementation is only used if the
+ * processor supports it. Both give the same checksums. Without it
+ * the first checksum picks one, which is not safe once several
+ * threads compute checksums, so it is called before they start.
+ *
+ * @param implementation The implementation which is wanted.
+ * @return The implementation which was selected
+ */
+int
+hchecksum_select(int implementation)
+{
+    _setup();
+    checksum_implementation = CHECKSUM_TABLE;
+
+#ifdef CHECKSUM_HAVE_SSE42
+    if (implementation != CHECKSUM_TABLE && __builtin_cpu_supports("sse4.2")) {
+        checksum_implementation = CHECKSUM_SSE42;
+    }
+#endif
+
+    return checksum_implementation;
+}
+
+/**
+ * This function is used to continue a checksum over more
+ * elements. A checksum begins at CHECKSUM_INITIAL.
+ *
+ * @param crc The checksum so far.
+ * @param buffer The elements.
+ * @param length The number of elements.
+ * @return The checksum
+ */
+uint32_t
+hchecksum_update(uint32_t crc, const uint8_t *buffer, uint64_t length)
+{
+    if (checksum_implementation < 0) {
+        hchecksum_select(CHECKSUM_AUTO);
+    }
+
+    crc = ~crc;
+#ifdef CHECKSUM_HAVE_SSE42
+    if (checksum_implementation == CHECKSUM_SSE42) {
+        return ~_update_sse42(crc, buffer, length);
+    }
+#endif
+
+    return ~_update_table(crc, buffer, length);
+}
+
+/**
+ * This function is used to continue a checksum over a run of
+ * the same element. The run is built by doubling up a small piece
+ * of it, so it costs far less than the run is long.
+ *
+ * @param crc The checksum so far.
+ * @param element The element which is repeated.
+ * @param length The length of the run.
+ * @return The checksum
+ */
+uint32_t
+hchecksum_run(uint32_t crc, uint8_t element, uint64_t length)
+{
+    uint8_t piece[CHECKSUM_RUN_SIZE];
+    uint32_t piece_crc;
+    uint64_t piece_length, count;
+
+    memset(piece, element, sizeof(piece));
+    piece_crc = hchecksum_update(CHECKSUM_INITIAL, piece, sizeof(piece));
+    piece_length = sizeof(piece);
+
+    /* Every piece is the same, so the order they are added in does not matter */
+    for (count = length / sizeof(piece); count; count >>= 1) {
+        if (count & 1) {
+            crc = hchecksum_combine(crc, piece_crc, piece_length);
+        }
+        piece_crc = hchecksum_combine(piece_crc, piece_crc, piece_length);
+        piece_length *= 2;
+    }
+
+    return hchecksum_update(crc, piece, length % sizeof(piece));
+}
+
+/**
+ * This function is used to compute the checksum of two pieces
+ * put together from the checksums of each piece and the length
+ * of the second piece.
+ *
+ * @param first The checksum of the first piece.
+ * @param second The checksum of the second piece.
+ * @param length The length of the second piece.
+ * @return The checksum of both pieces
+ */
+uint32_t
+hchecksum_combine(uint32_t first, uint32_t second, uint64_t length)
+{
+    if (checksum_implementation < 0) {
+        hchecksum_select(CHECKSUM_AUTO);
+    }
+
+    return _multiply(_power(length, 3), first) ^ second;
+}
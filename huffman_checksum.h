@@ -0,0 +1,54 @@
+/*
+ * This file declares the interface for computing CRC32C checksums
+ * of the original elements. The SSE4.2 crc32 instruction is used
+ * when the processor has it, and a slice-by-8 table otherwise.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef HUFFMAN_CHECKSUM_H
+#define HUFFMAN_CHECKSUM_H
+
+/* The reflected Castagnoli polynomial */
+#define CHECKSUM_POLYNOMIAL             (0x82F63B78U)
+
+/* The checksum of nothing, which every checksum begins from */
+#define CHECKSUM_INITIAL                (0U)
+#define CHECKSUM_SIZE                   (sizeof(uint32_t))
+
+/* Implementations */
+#define CHECKSUM_TABLE                  (0)
+#define CHECKSUM_SSE42                  (1)
+#define CHECKSUM_AUTO                   (2)
+
+/**
+ * This function is used to pick the implementation used for
+ * every checksum. The SSE4.2 implementation is only used if the
+ * processor supports it.
+ */
+int hchecksum_select(int);
+
+/**
+ * This function is used to continue a checksum over more
+ * elements.
+ */
+uint32_t hchecksum_update(uint32_t, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to continue a checksum over a run of
+ * the same element.
+ */
+uint32_t hchecksum_run(uint32_t, uint8_t, uint64_t);
+
+/**
+ * This function is used to compute the checksum of two pieces
+ * put together from the checksums of each piece.
+ */
+uint32_t hchecksum_combine(uint32_t, uint32_t, uint64_t);
+
+#endif
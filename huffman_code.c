@@ -0,0 +1,374 @@
+/*
+ * This file defines the interface for using a canonical huffman
+ * code. The code is derived from a huffman tree but its lengths are
+ * limited so that every opcode can be resolved with a single lookup
+ * into a decode table.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_code.h"
+
+/**
+ * This function builds a huffman tree for a table of frequencies
+ * in the same way huffman_encode does and stores the depth of every
+ * leaf into the lengths table. The tree is free'd once the lengths
+ * are known. This function is not presented as an interface function.
+ *
+ * @param frequencies The frequency of every element.
+ * @param lengths The table which holds the lengths.
+ * @return The maximum length or error code
+ */
+static int
+_tree_lengths(uint64_t *frequencies, uint8_t *lengths)
+{
+    int i, ret;
+    hlist_t *distribution_list;
+    htree_t *distribution_tree;
+    helement_t *min_first, *min_second, *parent;
+
+    distribution_list = hlist_create();
+    if (!distribution_list) {
+        return -1;
+    }
+
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        lengths[i] = 0;
+        if (frequencies[i]) {
+            if (!hlist_add_element(distribution_list, i, frequencies[i])) {
+                return -1;
+            }
+        }
+    }
+
+    /* Combine the two minimums until only the root is left */
+    while (hlist_get_two_min(distribution_list, &min_first, &min_second) >= 0) {
+        parent = hlist_add_increment_element(distribution_list, LIST_SPECIAL_ELEMENT,
+                                             min_first->frequency + min_second->frequency);
+        if (!parent) {
+            return -1;
+        }
+
+        if (htree_connect(parent, min_first, min_second)) {
+            return -1;
+        }
+    }
+
+    distribution_tree = htree_create();
+    if (!distribution_tree) {
+        return -1;
+    }
+
+    htree_add_element(distribution_tree, distribution_list->list);
+    ret = htree_lengths(distribution_tree, lengths);
+
+    /*
+     * A tree with a single leaf gives that leaf a depth of 0, but
+     * every element needs at least one bit to be represented.
+     */
+    if (ret == 0) {
+        lengths[distribution_tree->root->element] = 1;
+        ret = 1;
+    }
+
+    htree_free(distribution_tree);
+    hlist_free(distribution_list);
+    return ret;
+}
+
+/**
+ * This function reverses the lowest bits of an opcode so that it
+ * can be emitted least significant bit first. This function is not
+ * presented as an interface function.
+ *
+ * @param code The opcode to reverse.
+ * @param length The length of the opcode.
+ * @return The reversed opcode
+ */
+static uint16_t
+_reverse(uint16_t code, uint8_t length)
+{
+    uint16_t reversed = 0;
+
+    while (length--) {
+        reversed = (reversed << 1) | (code & 0x1);
+        code >>= 1;
+    }
+
+    return reversed;
+}
+
+/**
+ * This function assigns canonical opcodes to every element from
+ * the lengths of the code and fills in the decode table. Shorter
+ * opcodes come first and elements of the same length are ordered by
+ * their value. This function is not presented as an interface function.
+ *
+ * @param hcode The code to assign opcodes for.
+ * @return 0 on success or error code
+ */
+static int
+_assign(hcode_t *hcode)
+{
+    int i;
+    uint8_t length;
+    uint32_t entry, step;
+    uint32_t kraft_sum;
+    uint16_t length_count[CODE_MAX_LENGTH + 1];
+    uint16_t next_code[CODE_MAX_LENGTH + 1];
+
+    memset(length_count, 0, sizeof(length_count));
+    hcode->present = 0;
+    hcode->max_length = 0;
+    kraft_sum = 0;
+
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        length = hcode->lengths[i];
+        if (length > CODE_MAX_LENGTH) {
+            return -1;
+        } else if (length) {
+            length_count[length] += 1;
+            kraft_sum += CODE_TABLE_SIZE >> length;
+            hcode->present += 1;
+            if (length > hcode->max_length) {
+                hcode->max_length = length;
+            }
+        }
+    }
+
+    /* An oversubscribed code cannot be decoded */
+    if (kraft_sum > CODE_TABLE_SIZE) {
+        return -2;
+    }
+
+    next_code[0] = 0;
+    length_count[0] = 0;
+    for (i = 1; i <= (int)CODE_MAX_LENGTH; i++) {
+        next_code[i] = (next_code[i - 1] + length_count[i - 1]) << 1;
+    }
+
+    /*
+     * Every entry of the table whose lowest bits match an opcode
+     * decodes to that element. Entries which no opcode reaches are
+     * left with a length of 0.
+     */
+    memset(hcode->table, 0, sizeof(hcode->table));
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        length = hcode->lengths[i];
+        if (!length) {
+            hcode->codes[i] = 0;
+            continue;
+        }
+
+        hcode->codes[i] = _reverse(next_code[length]++, length);
+        step = 1U << length;
+        for (entry = hcode->codes[i]; entry < CODE_TABLE_SIZE; entry += step) {
+            hcode->table[entry] = CODE_ENTRY(i, length);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to build a new canonical code
+ * with no elements present.
+ *
+ * @return A canonical code or NULL
+ */
+hcode_t*
+hcode_create()
+{
+    hcode_t *temp;
+
+    temp = calloc(1, sizeof(hcode_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    return temp;
+}
+
+/**
+ * This function is used to free a canonical code.
+ *
+ * @param hcode The code to free
+ */
+void
+hcode_free(hcode_t *hcode)
+{
+    free(hcode);
+}
+
+/**
+ * This function is used to count the frequency of every
+ * element in a buffer. Four tables are used in rotation so
+ * that repeated elements do not stall on the same counter.
+ *
+ * @param frequencies The table of frequencies to fill in.
+ * @param buffer The buffer to count.
+ * @param length The length of the buffer.
+ */
+void
+hcode_count(uint64_t *frequencies, const uint8_t *buffer, uint64_t length)
+{
+    int i;
+    uint64_t j;
+    uint64_t partial[4][CODE_MAX_SYMBOLS];
+
+    memset(partial, 0, sizeof(partial));
+    for (j = 0; j + 4 <= length; j += 4) {
+        partial[0][buffer[j]] += 1;
+        partial[1][buffer[j + 1]] += 1;
+        partial[2][buffer[j + 2]] += 1;
+        partial[3][buffer[j + 3]] += 1;
+    }
+
+    for (; j < length; j++) {
+        partial[0][buffer[j]] += 1;
+    }
+
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        frequencies[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+    }
+}
+
+/**
+ * This function is used to build the code for a table of
+ * frequencies. The lengths come from a huffman tree and in
+ * case the tree is deeper than CODE_MAX_LENGTH, the frequencies
+ * are flattened and the tree is built again until it fits.
+ *
+ * @param hcode The code to build.
+ * @param frequencies The frequency of every element.
+ * @return The code or NULL
+ */
+hcode_t*
+hcode_build(hcode_t *hcode, uint64_t *frequencies)
+{
+    int i, ret;
+    uint64_t shift;
+    uint64_t scaled[CODE_MAX_SYMBOLS];
+
+    if (!hcode || !frequencies) {
+        return NULL;
+    }
+
+    memset(hcode->lengths, 0, sizeof(hcode->lengths));
+    for (shift = 0; shift < 64; shift++) {
+        ret = 0;
+        for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+            scaled[i] = frequencies[i] ? ((frequencies[i] - 1) >> shift) + 1 : 0;
+            ret |= !!scaled[i];
+        }
+
+        /* Nothing is present so every length stays 0 */
+        if (!ret) {
+            break;
+        }
+
+        ret = _tree_lengths(scaled, hcode->lengths);
+        if (ret < 0) {
+            return NULL;
+        } else if (ret <= (int)CODE_MAX_LENGTH) {
+            break;
+        }
+    }
+
+    if (_assign(hcode)) {
+        return NULL;
+    }
+
+    return hcode;
+}
+
+/**
+ * This function is used to pack the code lengths into a
+ * buffer so that the code can be stored in a header.
+ *
+ * @param hcode The code to pack.
+ * @param buffer The buffer to pack into.
+ * @param capacity The size of the buffer.
+ * @return The number of bytes packed or error code
+ */
+ssize_t
+hcode_pack(hcode_t *hcode, uint8_t *buffer, uint64_t capacity)
+{
+    int i;
+    uint64_t size, nibble;
+
+    if (!hcode || !buffer) {
+        return -1;
+    }
+
+    size = CODE_PACK_SIZE(hcode->present);
+    if (size > capacity) {
+        return -2;
+    }
+
+    memset(buffer, 0, size);
+    nibble = 0;
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        if (!hcode->lengths[i]) {
+            continue;
+        }
+
+        buffer[i / 8] |= 1 << (i & 0x7);
+        buffer[CODE_PACK_BITMAP_SIZE + (nibble / 2)] |= hcode->lengths[i] << ((nibble & 0x1) * 4);
+        nibble += 1;
+    }
+
+    return size;
+}
+
+/**
+ * This function is used to unpack code lengths written by
+ * hcode_pack and rebuild the opcodes and decode table.
+ *
+ * @param hcode The code to unpack into.
+ * @param buffer The buffer to unpack from.
+ * @param size The number of bytes available in the buffer.
+ * @return The number of bytes consumed or error code
+ */
+ssize_t
+hcode_unpack(hcode_t *hcode, const uint8_t *buffer, uint64_t size)
+{
+    int i;
+    uint64_t present, packed_size, nibble;
+
+    if (!hcode || !buffer) {
+        return -1;
+    } else if (size < CODE_PACK_BITMAP_SIZE) {
+        return -2;
+    }
+
+    present = 0;
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        present += !!(buffer[i / 8] & (1 << (i & 0x7)));
+    }
+
+    packed_size = CODE_PACK_SIZE(present);
+    if (size < packed_size) {
+        return -2;
+    }
+
+    nibble = 0;
+    for (i = 0; i < CODE_MAX_SYMBOLS; i++) {
+        hcode->lengths[i] = 0;
+        if (buffer[i / 8] & (1 << (i & 0x7))) {
+            hcode->lengths[i] = (buffer[CODE_PACK_BITMAP_SIZE + (nibble / 2)] >> ((nibble & 0x1) * 4)) & 0xF;
+            nibble += 1;
+
+            /* A present element always has an opcode */
+            if (!hcode->lengths[i]) {
+                return -3;
+            }
+        }
+    }
+
+    if (_assign(hcode)) {
+        return -4;
+    }
+
+    return packed_size;
+}
@@ -0,0 +1,108 @@
+/*
+ * This file declares the interface for using a canonical huffman
+ * code. The code is derived from a huffman tree but its lengths are
+ * limited so that every opcode can be resolved with a single lookup
+ * into a decode table.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "huffman_element.h"
+#include "huffman_list.h"
+#include "huffman_tree.h"
+
+#ifndef HUFFMAN_CODE_H
+#define HUFFMAN_CODE_H
+
+/* Sizes */
+#define CODE_MAX_SYMBOLS            (TREE_MAX_TABLE_SIZE)
+#define CODE_MAX_LENGTH             (11U)
+#define CODE_TABLE_SIZE             (1U << CODE_MAX_LENGTH)
+#define CODE_TABLE_MASK             (CODE_TABLE_SIZE - 1)
+#define CODE_TABLE_PADDING          (2U)
+
+/* A decode table entry holds the element and the opcode length */
+#define CODE_ENTRY(element, length) ((uint16_t)((element) | ((length) << 8)))
+#define CODE_ENTRY_ELEMENT(entry)   ((uint8_t)((entry) & 0xFF))
+#define CODE_ENTRY_LENGTH(entry)    ((entry) >> 8)
+
+/*
+ * A packed code is a bitmap of the elements which are present
+ * followed by a nibble holding the length of every present element.
+ */
+#define CODE_PACK_BITMAP_SIZE       (CODE_MAX_SYMBOLS / 8)
+#define CODE_PACK_SIZE(present)     (CODE_PACK_BITMAP_SIZE + (((present) + 1) / 2))
+#define CODE_PACK_MAX_SIZE          (CODE_PACK_SIZE(CODE_MAX_SYMBOLS))
+
+typedef struct huffman_code {
+    /*
+     * This is the length of the opcode of every element. A length
+     * of 0 means that the element does not appear in the input.
+     */
+    uint8_t lengths[CODE_MAX_SYMBOLS];
+
+    /*
+     * These are the canonical opcodes of every element. They are
+     * stored bit reversed so that they can be emitted least
+     * significant bit first, the same order a bit vector uses.
+     */
+    uint16_t codes[CODE_MAX_SYMBOLS];
+
+    /*
+     * This is the decode table. Indexing it with the next
+     * CODE_MAX_LENGTH bits of a stream gives the element and the
+     * length of its opcode. The padding allows wide loads of the
+     * last entry.
+     */
+    uint16_t table[CODE_TABLE_SIZE + CODE_TABLE_PADDING];
+
+    /* This is the number of elements which are present */
+    uint16_t present;
+
+    /* This is the length of the longest opcode */
+    uint8_t max_length;
+} hcode_t;
+
+/**
+ * This function is used to build a new canonical code
+ * with no elements present.
+ */
+hcode_t* hcode_create();
+
+/**
+ * This function is used to free a canonical code.
+ */
+void hcode_free(hcode_t*);
+
+/**
+ * This function is used to count the frequency of every
+ * element in a buffer.
+ */
+void hcode_count(uint64_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to build the code for a table of
+ * frequencies. The lengths come from a huffman tree and are
+ * limited to CODE_MAX_LENGTH.
+ */
+hcode_t* hcode_build(hcode_t*, uint64_t*);
+
+/**
+ * This function is used to pack the code lengths into a
+ * buffer so that the code can be stored in a header.
+ */
+ssize_t hcode_pack(hcode_t*, uint8_t*, uint64_t);
+
+/**
+ * This function is used to unpack code lengths written by
+ * hcode_pack and rebuild the opcodes and decode table.
+ */
+ssize_t hcode_unpack(hcode_t*, const uint8_t*, uint64_t);
+
+#endif
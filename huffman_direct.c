@@ -0,0 +1,334 @@
+/*
+ * This file defines the interface for reading and writing files
+ * with direct I/O, which goes around the page cache. Direct I/O
+ * needs buffers, offsets and lengths aligned to the block size of
+ * the device, so reads and writes of any size at any offset go
+ * through an aligned window which only ever moves whole aligned
+ * chunks, and whatever unaligned tail is left at the end is written
+ * without direct I/O.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#define _GNU_SOURCE
+#include "huffman_direct.h"
+#include "huffman_io.h"
+
+/**
+ * This function is used to find the alignment direct I/O on a
+ * file needs. The block size the file system reports is used where
+ * it is a sensible power of two, and a page otherwise.
+ *
+ * @param fd The file.
+ * @return The alignment
+ */
+uint32_t
+hdirect_alignment(int fd)
+{
+    struct stat st;
+    uint64_t size;
+
+    if (fstat(fd, &st) < 0) {
+        return DIRECT_DEFAULT_ALIGNMENT;
+    }
+
+    size = st.st_blksize;
+    if (size < DIRECT_MIN_ALIGNMENT || size > DIRECT_MAX_ALIGNMENT || (size & (size - 1))) {
+        return DIRECT_DEFAULT_ALIGNMENT;
+    }
+    return size;
+}
+
+/**
+ * This function is used to allocate a buffer aligned for direct
+ * I/O. The size is rounded up to the alignment so that a whole
+ * chunk can always be read into the end of the buffer.
+ *
+ * @param alignment The alignment, a power of two.
+ * @param size The number of bytes needed.
+ * @return The buffer or NULL
+ */
+void*
+hdirect_alloc(uint32_t alignment, uint64_t size)
+{
+    void *buffer;
+
+    if (!alignment || (alignment & (alignment - 1))) {
+        return NULL;
+    }
+
+    size = (size + alignment - 1) & ~((uint64_t)alignment - 1);
+    if (posix_memalign(&buffer, alignment, size ? size : alignment)) {
+        return NULL;
+    }
+    return buffer;
+}
+
+/**
+ * This function is used to turn direct I/O on a file on or off.
+ * It is only turned on for regular files, since pipes take it to
+ * mean something else, and file systems without direct I/O refuse
+ * it. The file is then left as it was.
+ *
+ * @param fd The file.
+ * @param enable Whether to turn direct I/O on.
+ * @return 0 on success or error code
+ */
+int
+hdirect_set(int fd, uint8_t enable)
+{
+#ifdef O_DIRECT
+    struct stat st;
+    int fd_flags;
+
+    if (enable && (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))) {
+        return DIRECT_ERROR_UNSUPPORTED;
+    }
+
+    fd_flags = fcntl(fd, F_GETFL);
+    if (fd_flags < 0) {
+        return DIRECT_ERROR_ARGUMENT;
+    }
+
+    fd_flags = enable ? (fd_flags | O_DIRECT) : (fd_flags & ~O_DIRECT);
+    if (fcntl(fd, F_SETFL, fd_flags) < 0) {
+        return DIRECT_ERROR_UNSUPPORTED;
+    }
+    return 0;
+#else
+    (void)fd;
+    return enable ? DIRECT_ERROR_UNSUPPORTED : 0;
+#endif
+}
+
+/**
+ * This function is used to build a new empty window over a file
+ * which has direct I/O turned on.
+ *
+ * @param fd The file.
+ * @param capacity The size of the window, rounded up to the alignment.
+ * @return A window or NULL
+ */
+hdirect_t*
+hdirect_create(int fd, uint64_t capacity)
+{
+    hdirect_t *temp;
+
+    if (!capacity) {
+        return NULL;
+    }
+
+    temp = calloc(1, sizeof(hdirect_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    temp->fd = fd;
+    temp->alignment = hdirect_alignment(fd);
+    temp->capacity = (capacity + temp->alignment - 1) & ~((uint64_t)temp->alignment - 1);
+    temp->window = hdirect_alloc(temp->alignment, temp->capacity);
+    if (!temp->window) {
+        free(temp);
+        return NULL;
+    }
+
+    return temp;
+}
+
+/**
+ * This function is used to free a window. Nothing left in it is
+ * written out.
+ *
+ * @param hdirect The window to free
+ */
+void
+hdirect_free(hdirect_t *hdirect)
+{
+    if (!hdirect) {
+        return;
+    }
+
+    free(hdirect->window);
+    free(hdirect);
+}
+
+/**
+ * This function is used to read from a file at an offset through
+ * a window, like pread. Whenever the offset is outside the window,
+ * the window is moved to the aligned chunk holding it and filled in
+ * one read, so reading a file from start to end reads every chunk
+ * once.
+ *
+ * @param hdirect The window.
+ * @param buffer The buffer to read into.
+ * @param size The number of bytes to read.
+ * @param offset The offset in the file.
+ * @return The number of bytes read or error code
+ */
+ssize_t
+hdirect_read(hdirect_t *hdirect, uint8_t *buffer, uint64_t size, uint64_t offset)
+{
+    uint64_t total, count;
+    ssize_t bytes_read;
+
+    if (!hdirect || !buffer) {
+        return DIRECT_ERROR_ARGUMENT;
+    }
+
+    total = 0;
+    while (total < size) {
+        if (offset < hdirect->offset || offset >= hdirect->offset + hdirect->fill) {
+            hdirect->offset = offset & ~((uint64_t)hdirect->alignment - 1);
+            hdirect->fill = 0;
+
+            bytes_read = hio_pread_aligned(hdirect->fd, hdirect->window, hdirect->capacity,
+                                           hdirect->offset, hdirect->alignment);
+            if (bytes_read < 0) {
+                return DIRECT_ERROR_READ;
+            }
+            hdirect->fill = bytes_read;
+
+            /* The file ends before the offset */
+            if (offset >= hdirect->offset + hdirect->fill) {
+                break;
+            }
+        }
+
+        count = hdirect->offset + hdirect->fill - offset;
+        if (count > size - total) {
+            count = size - total;
+        }
+
+        memcpy(buffer + total, hdirect->window + (offset - hdirect->offset), count);
+        offset += count;
+        total += count;
+    }
+
+    return total;
+}
+
+/**
+ * This function is used to start writing a file through a window
+ * at an offset. When the offset is not aligned, the bytes of the
+ * file before it in the same chunk are read in first, so that they
+ * are written back as they were.
+ *
+ * @param hdirect The window.
+ * @param offset The offset in the file.
+ * @return 0 on success or error code
+ */
+int
+hdirect_start(hdirect_t *hdirect, uint64_t offset)
+{
+    ssize_t bytes_read;
+    uint64_t head;
+
+    if (!hdirect) {
+        return DIRECT_ERROR_ARGUMENT;
+    }
+
+    hdirect->offset = offset & ~((uint64_t)hdirect->alignment - 1);
+    hdirect->fill = 0;
+
+    head = offset - hdirect->offset;
+    if (head) {
+        bytes_read = hio_pread_aligned(hdirect->fd, hdirect->window, hdirect->alignment,
+                                       hdirect->offset, hdirect->alignment);
+        if (bytes_read < 0) {
+            return DIRECT_ERROR_READ;
+        } else if ((uint64_t)bytes_read < head) {
+            memset(hdirect->window + bytes_read, 0, head - bytes_read);
+        }
+        hdirect->fill = head;
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to write to a file through a window,
+ * right after what was written before. The window is written out
+ * whenever it is full. While the window is empty, the aligned part
+ * of an aligned buffer is written straight from the buffer.
+ *
+ * @param hdirect The window.
+ * @param buffer The buffer to write from.
+ * @param size The number of bytes to write.
+ * @return 0 on success or error code
+ */
+int
+hdirect_write(hdirect_t *hdirect, const uint8_t *buffer, uint64_t size)
+{
+    uint64_t count;
+
+    if (!hdirect || (!buffer && size)) {
+        return DIRECT_ERROR_ARGUMENT;
+    }
+
+    while (size) {
+        count = size & ~((uint64_t)hdirect->alignment - 1);
+        if (!hdirect->fill && count && !((uintptr_t)buffer & (hdirect->alignment - 1))) {
+            if (hio_pwrite(hdirect->fd, buffer, count, hdirect->offset)) {
+                return DIRECT_ERROR_WRITE;
+            }
+            hdirect->offset += count;
+            buffer += count;
+            size -= count;
+            continue;
+        }
+
+        count = hdirect->capacity - hdirect->fill;
+        if (count > size) {
+            count = size;
+        }
+
+        memcpy(hdirect->window + hdirect->fill, buffer, count);
+        hdirect->fill += count;
+        buffer += count;
+        size -= count;
+
+        if (hdirect->fill == hdirect->capacity) {
+            if (hio_pwrite(hdirect->fd, hdirect->window, hdirect->capacity, hdirect->offset)) {
+                return DIRECT_ERROR_WRITE;
+            }
+            hdirect->offset += hdirect->capacity;
+            hdirect->fill = 0;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to write out whatever is left in a window
+ * and turn direct I/O on the file off. The aligned part is still
+ * written directly, but the unaligned tail can only be written
+ * once direct I/O is off. Anything written to the file afterwards
+ * goes through the page cache again.
+ *
+ * @param hdirect The window.
+ * @return The offset right after the last byte written or error code
+ */
+int64_t
+hdirect_finish(hdirect_t *hdirect)
+{
+    uint64_t aligned;
+
+    if (!hdirect) {
+        return DIRECT_ERROR_ARGUMENT;
+    }
+
+    aligned = hdirect->fill & ~((uint64_t)hdirect->alignment - 1);
+    if (aligned && hio_pwrite(hdirect->fd, hdirect->window, aligned, hdirect->offset)) {
+        return DIRECT_ERROR_WRITE;
+    }
+
+    if (hdirect_set(hdirect->fd, 0) ||
+        hio_pwrite(hdirect->fd, hdirect->window + aligned, hdirect->fill - aligned, hdirect->offset + aligned)) {
+        return DIRECT_ERROR_WRITE;
+    }
+
+    hdirect->offset += hdirect->fill;
+    hdirect->fill = 0;
+    return hdirect->offset;
+}
@@ -0,0 +1,107 @@
+/*
+ * This file declares the interface for reading and writing files
+ * with direct I/O, which goes around the page cache. Direct I/O
+ * needs buffers, offsets and lengths aligned to the block size of
+ * the device, so reads and writes of any size at any offset go
+ * through an aligned window which only ever moves whole aligned
+ * chunks, and whatever unaligned tail is left at the end is written
+ * without direct I/O.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef HUFFMAN_DIRECT_H
+#define HUFFMAN_DIRECT_H
+
+/* Alignments */
+#define DIRECT_MIN_ALIGNMENT            (512U)
+#define DIRECT_DEFAULT_ALIGNMENT        (4096U)
+#define DIRECT_MAX_ALIGNMENT            (65536U)
+
+/* Defaults */
+#define DIRECT_WINDOW_SIZE              (1U << 22)
+
+/* Direct Errors */
+#define DIRECT_ERROR_ARGUMENT           (-1)
+#define DIRECT_ERROR_UNSUPPORTED        (-2)
+#define DIRECT_ERROR_READ               (-3)
+#define DIRECT_ERROR_WRITE              (-4)
+
+typedef struct huffman_direct {
+    /* The file and the alignment it needs */
+    int fd;
+    uint32_t alignment;
+
+    /*
+     * This is the aligned window. It holds the bytes of the file
+     * from the offset on, which is always aligned, and fill is the
+     * number of those bytes it holds.
+     */
+    uint8_t *window;
+    uint64_t capacity;
+    uint64_t offset;
+    uint64_t fill;
+} hdirect_t;
+
+/**
+ * This function is used to find the alignment direct I/O on a
+ * file needs.
+ */
+uint32_t hdirect_alignment(int);
+
+/**
+ * This function is used to allocate a buffer aligned for direct
+ * I/O, which is freed with free.
+ */
+void* hdirect_alloc(uint32_t, uint64_t);
+
+/**
+ * This function is used to turn direct I/O on a file on or off.
+ */
+int hdirect_set(int, uint8_t);
+
+/**
+ * This function is used to build a new window over a file which
+ * has direct I/O turned on.
+ */
+hdirect_t* hdirect_create(int, uint64_t);
+
+/**
+ * This function is used to free a window.
+ */
+void hdirect_free(hdirect_t*);
+
+/**
+ * This function is used to read from a file at an offset through
+ * a window.
+ */
+ssize_t hdirect_read(hdirect_t*, uint8_t*, uint64_t, uint64_t);
+
+/**
+ * This function is used to start writing a file through a window
+ * at an offset.
+ */
+int hdirect_start(hdirect_t*, uint64_t);
+
+/**
+ * This function is used to write to a file through a window,
+ * right after what was written before.
+ */
+int hdirect_write(hdirect_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to write out whatever is left in a window
+ * and turn direct I/O on the file off.
+ */
+int64_t hdirect_finish(hdirect_t*);
+
+#endif
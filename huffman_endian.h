@@ -0,0 +1,94 @@
+/*
+ * This file defines the helpers for storing integers in the
+ * formats of the header, the blocks, the index and the streams,
+ * and for loading the bits of a stream. Integers are
+ * stored least significant byte first, so that files are the same
+ * on every machine. The helpers are small enough to be inlined into
+ * every module which stores integers.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <string.h>
+
+#ifndef HUFFMAN_ENDIAN_H
+#define HUFFMAN_ENDIAN_H
+
+/**
+ * This function stores an integer into a buffer least significant
+ * byte first.
+ *
+ * @param buffer The buffer to store into.
+ * @param value The integer to store.
+ * @param size The number of bytes to store.
+ */
+static inline void
+hendian_put(uint8_t *buffer, uint64_t value, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        buffer[i] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+/**
+ * This function loads an integer which was stored by hendian_put.
+ *
+ * @param buffer The buffer to load from.
+ * @param size The number of bytes to load.
+ * @return The integer
+ */
+static inline uint64_t
+hendian_get(const uint8_t *buffer, int size)
+{
+    int i;
+    uint64_t value = 0;
+
+    for (i = size - 1; i >= 0; i--) {
+        value = (value << 8) | buffer[i];
+    }
+
+    return value;
+}
+
+/**
+ * This function loads 8 bytes from a buffer as a little endian
+ * integer so that the first bit of the buffer ends up as the lowest
+ * bit. It is a single load on little endian machines, which is what
+ * bit streams are read with.
+ *
+ * @param buffer The buffer to load from.
+ * @return The loaded bits
+ */
+static inline uint64_t
+hendian_load64(const uint8_t *buffer)
+{
+    uint64_t bits;
+
+    memcpy(&bits, buffer, sizeof(bits));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bits = __builtin_bswap64(bits);
+#endif
+    return bits;
+}
+
+/**
+ * This function stores 8 bytes into a buffer as a little endian
+ * integer, the way hendian_load64 loads them.
+ *
+ * @param buffer The buffer to store into.
+ * @param bits The bits to store.
+ */
+static inline void
+hendian_store64(uint8_t *buffer, uint64_t bits)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bits = __builtin_bswap64(bits);
+#endif
+    memcpy(buffer, &bits, sizeof(bits));
+}
+
+#endif
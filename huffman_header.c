@@ -0,0 +1,258 @@
+/*
+ * This file defines the interface for using the container header
+ * which begins every compressed file. The header records how the
+ * file was compressed so the decoder does not need to be told.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_header.h"
+#include "huffman_endian.h"
+#include "huffman_io.h"
+
+/**
+ * This function is used to build a new header for the
+ * current version with all other values set to defaults.
+ *
+ * @return A header or NULL
+ */
+hheader_t*
+hheader_create()
+{
+    hheader_t *temp;
+
+    temp = calloc(1, sizeof(hheader_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    temp->version = HEADER_VERSION;
+    temp->engine = HEADER_ENGINE_TREE;
+    temp->header_size = HEADER_MIN_SIZE;
+    return temp;
+}
+
+/**
+ * This function is used to free a header.
+ *
+ * @param hheader The header to free
+ */
+void
+hheader_free(hheader_t *hheader)
+{
+    free(hheader);
+}
+
+/**
+ * This function is used to pack a header into a buffer
+ * in the byte order it is stored in a file.
+ *
+ * @param hheader The header to pack.
+ * @param buffer The buffer to pack into.
+ * @param capacity The size of the buffer.
+ * @return The number of bytes packed or error code
+ */
+ssize_t
+hheader_pack(hheader_t *hheader, uint8_t *buffer, uint64_t capacity)
+{
+    if (!hheader || !buffer) {
+        return HEADER_ERROR_FIELD;
+    } else if (capacity < HEADER_SIZE(hheader->flags)) {
+        return HEADER_ERROR_SHORT;
+    }
+
+    memcpy(buffer + HEADER_MAGIC_OFFSET, HEADER_MAGIC, HEADER_MAGIC_SIZE);
+    buffer[HEADER_VERSION_OFFSET] = hheader->version;
+    buffer[HEADER_ENGINE_OFFSET] = hheader->engine;
+    buffer[HEADER_FLAGS_OFFSET] = hheader->flags;
+    buffer[HEADER_CODE_LIMIT_OFFSET] = hheader->code_limit;
+    hendian_put(buffer + HEADER_SIZE_OFFSET, HEADER_SIZE(hheader->flags), sizeof(uint32_t));
+    hendian_put(buffer + HEADER_LENGTH_OFFSET, hheader->original_length, sizeof(uint64_t));
+    if (hheader->flags & HEADER_FLAG_CHECKSUM) {
+        hendian_put(buffer + HEADER_CHECKSUM_OFFSET, hheader->checksum, sizeof(uint32_t));
+    }
+
+    hheader->header_size = HEADER_SIZE(hheader->flags);
+    return hheader->header_size;
+}
+
+/**
+ * This function is used to unpack a header from a buffer
+ * and validate it. A buffer without the magic is most likely
+ * a file from before the header existed.
+ *
+ * @param hheader The header to unpack into.
+ * @param buffer The buffer to unpack from.
+ * @param size The number of bytes in the buffer.
+ * @return The size of the header or error code
+ */
+ssize_t
+hheader_unpack(hheader_t *hheader, const uint8_t *buffer, uint64_t size)
+{
+    if (!hheader || !buffer) {
+        return HEADER_ERROR_FIELD;
+    } else if (size < HEADER_MAGIC_SIZE) {
+        return HEADER_ERROR_SHORT;
+    } else if (memcmp(buffer + HEADER_MAGIC_OFFSET, HEADER_MAGIC, HEADER_MAGIC_SIZE)) {
+        return HEADER_ERROR_MAGIC;
+    } else if (size < HEADER_MIN_SIZE) {
+        return HEADER_ERROR_SHORT;
+    }
+
+    hheader->version = buffer[HEADER_VERSION_OFFSET];
+    hheader->engine = buffer[HEADER_ENGINE_OFFSET];
+    hheader->flags = buffer[HEADER_FLAGS_OFFSET];
+    hheader->code_limit = buffer[HEADER_CODE_LIMIT_OFFSET];
+    hheader->header_size = hendian_get(buffer + HEADER_SIZE_OFFSET, sizeof(uint32_t));
+    hheader->original_length = hendian_get(buffer + HEADER_LENGTH_OFFSET, sizeof(uint64_t));
+
+    /* Files from a newer version might not be understood */
+    if (hheader->version == 0 || hheader->version > HEADER_VERSION) {
+        return HEADER_ERROR_VERSION;
+    } else if (hheader->engine >= HEADER_ENGINE_COUNT) {
+        return HEADER_ERROR_FIELD;
+    } else if (hheader->header_size < HEADER_SIZE(hheader->flags)) {
+        return HEADER_ERROR_FIELD;
+    }
+
+    if (hheader->flags & HEADER_FLAG_CHECKSUM) {
+        if (size < HEADER_MAX_SIZE) {
+            return HEADER_ERROR_SHORT;
+        }
+        hheader->checksum = hendian_get(buffer + HEADER_CHECKSUM_OFFSET, sizeof(uint32_t));
+    }
+
+    return hheader->header_size;
+}
+
+/**
+ * This function is used to pack the length and checksum of a
+ * header into the trailer which ends a streamed file. The checksum
+ * is always there and is zero when the file has none.
+ *
+ * @param hheader The header to pack.
+ * @param buffer The buffer to pack into.
+ * @param capacity The size of the buffer.
+ * @return The size of the trailer or error code
+ */
+ssize_t
+hheader_pack_trailer(hheader_t *hheader, uint8_t *buffer, uint64_t capacity)
+{
+    if (!hheader || !buffer) {
+        return HEADER_ERROR_FIELD;
+    } else if (capacity < HEADER_TRAILER_SIZE) {
+        return HEADER_ERROR_SHORT;
+    }
+
+    memcpy(buffer, HEADER_TRAILER_MAGIC, HEADER_MAGIC_SIZE);
+    hendian_put(buffer + HEADER_TRAILER_LENGTH_OFFSET, hheader->original_length, sizeof(uint64_t));
+    hendian_put(buffer + HEADER_TRAILER_CHECKSUM_OFFSET,
+                (hheader->flags & HEADER_FLAG_CHECKSUM) ? hheader->checksum : 0, sizeof(uint32_t));
+    return HEADER_TRAILER_SIZE;
+}
+
+/**
+ * This function is used to unpack the trailer which ends a
+ * streamed file, filling in the length and checksum of its header.
+ *
+ * @param hheader The header to fill in.
+ * @param buffer The buffer holding the trailer.
+ * @param size The size of the buffer.
+ * @return The size of the trailer or error code
+ */
+ssize_t
+hheader_unpack_trailer(hheader_t *hheader, const uint8_t *buffer, uint64_t size)
+{
+    if (!hheader || !buffer) {
+        return HEADER_ERROR_FIELD;
+    } else if (size < HEADER_MAGIC_SIZE) {
+        return HEADER_ERROR_SHORT;
+    } else if (memcmp(buffer, HEADER_TRAILER_MAGIC, HEADER_MAGIC_SIZE)) {
+        return HEADER_ERROR_MAGIC;
+    } else if (size < HEADER_TRAILER_SIZE) {
+        return HEADER_ERROR_SHORT;
+    }
+
+    hheader->original_length = hendian_get(buffer + HEADER_TRAILER_LENGTH_OFFSET, sizeof(uint64_t));
+    if (hheader->flags & HEADER_FLAG_CHECKSUM) {
+        hheader->checksum = hendian_get(buffer + HEADER_TRAILER_CHECKSUM_OFFSET, sizeof(uint32_t));
+    }
+    return HEADER_TRAILER_SIZE;
+}
+
+/**
+ * This function is used to output a header onto a file
+ * at the beginning of the file. A pipe cannot seek back, so
+ * there the header is only ever written before anything else.
+ *
+ * @param hheader The header to output.
+ * @param fd The file to output to.
+ * @return The offset after the header or error code
+ */
+ssize_t
+hheader_output(hheader_t *hheader, int fd)
+{
+    int ret;
+    ssize_t size;
+    uint8_t buffer[HEADER_MAX_SIZE];
+
+    size = hheader_pack(hheader, buffer, sizeof(buffer));
+    if (size < 0) {
+        return size;
+    }
+
+    ret = hio_pwrite(fd, buffer, size, HEADER_MAGIC_OFFSET);
+    if (ret && errno == ESPIPE) {
+        ret = hio_write(fd, buffer, size);
+    }
+    if (ret) {
+        return HEADER_ERROR_SHORT;
+    }
+
+    return size;
+}
+
+/**
+ * This function is used to input a header from the
+ * beginning of a file. A pipe cannot seek, so there the header
+ * is read in order and the pipe is left right after it, including
+ * any fields of a newer version which are skipped.
+ *
+ * @param hheader The header to input into.
+ * @param fd The file to input from.
+ * @return The size of the header or error code
+ */
+ssize_t
+hheader_input(hheader_t *hheader, int fd)
+{
+    ssize_t bytes_read, size, rest, skip;
+    uint8_t buffer[HEADER_MAX_SIZE];
+
+    bytes_read = hio_pread(fd, buffer, sizeof(buffer), HEADER_MAGIC_OFFSET);
+    if (bytes_read >= 0) {
+        return hheader_unpack(hheader, buffer, bytes_read);
+    } else if (errno != ESPIPE) {
+        return HEADER_ERROR_SHORT;
+    }
+
+    /* The flags say how much of the header there is to read */
+    bytes_read = hio_read(fd, buffer, HEADER_MIN_SIZE);
+    if (bytes_read == (ssize_t)HEADER_MIN_SIZE) {
+        rest = HEADER_SIZE(buffer[HEADER_FLAGS_OFFSET]) - HEADER_MIN_SIZE;
+        if (hio_read(fd, buffer + HEADER_MIN_SIZE, rest) == rest) {
+            bytes_read += rest;
+        }
+    } else if (bytes_read < 0) {
+        return HEADER_ERROR_SHORT;
+    }
+
+    /* Fields of a newer version which are not understood are skipped */
+    size = hheader_unpack(hheader, buffer, bytes_read);
+    for (rest = size - bytes_read; rest > 0; rest -= skip) {
+        skip = (rest < (ssize_t)sizeof(buffer)) ? rest : (ssize_t)sizeof(buffer);
+        if (hio_read(fd, buffer, skip) != skip) {
+            return HEADER_ERROR_SHORT;
+        }
+    }
+    return size;
+}
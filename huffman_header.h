@@ -0,0 +1,158 @@
+/*
+ * This file declares the interface for using the container header
+ * which begins every compressed file. The header records how the
+ * file was compressed so the decoder does not need to be told.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef HUFFMAN_HEADER_H
+#define HUFFMAN_HEADER_H
+
+/* Identification */
+#define HEADER_MAGIC                    "HUFZ"
+#define HEADER_MAGIC_SIZE               (4U)
+#define HEADER_VERSION                  (2U)
+
+/*
+ * Version 1 files store the huffman tree node by node as it is
+ * written by htree_output. Later versions store it bit packed.
+ */
+#define HEADER_VERSION_TREE_NODES       (1U)
+
+/* Engines */
+#define HEADER_ENGINE_TREE              (0U)
+#define HEADER_ENGINE_STREAMS           (1U)
+#define HEADER_ENGINE_BLOCKS            (2U)
+#define HEADER_ENGINE_COUNT             (3U)
+
+/* Mode Flags */
+#define HEADER_FLAG_ASCII               (0x1U)
+#define HEADER_FLAG_CHECKSUM            (0x2U)
+
+/* The file ends with an index footer, see huffman_index.h */
+#define HEADER_FLAG_INDEX               (0x4U)
+
+/*
+ * The file was written in order without seeking back, so the header
+ * holds no length or checksum and a trailer after the last block
+ * holds them instead.
+ */
+#define HEADER_FLAG_STREAM              (0x8U)
+
+/* These are the macros for the fields of a header in a file */
+#define HEADER_MAGIC_OFFSET             (0U)
+#define HEADER_VERSION_OFFSET           (HEADER_MAGIC_OFFSET + HEADER_MAGIC_SIZE)
+#define HEADER_ENGINE_OFFSET            (HEADER_VERSION_OFFSET + sizeof(uint8_t))
+#define HEADER_FLAGS_OFFSET             (HEADER_ENGINE_OFFSET + sizeof(uint8_t))
+#define HEADER_CODE_LIMIT_OFFSET        (HEADER_FLAGS_OFFSET + sizeof(uint8_t))
+#define HEADER_SIZE_OFFSET              (HEADER_CODE_LIMIT_OFFSET + sizeof(uint8_t))
+#define HEADER_LENGTH_OFFSET            (HEADER_SIZE_OFFSET + sizeof(uint32_t))
+#define HEADER_MIN_SIZE                 (HEADER_LENGTH_OFFSET + sizeof(uint64_t))
+
+/* The checksum of the whole content follows when its flag is set */
+#define HEADER_CHECKSUM_OFFSET          (HEADER_MIN_SIZE)
+#define HEADER_MAX_SIZE                 (HEADER_CHECKSUM_OFFSET + sizeof(uint32_t))
+#define HEADER_SIZE(flags)              (((flags) & HEADER_FLAG_CHECKSUM) ? HEADER_MAX_SIZE : HEADER_MIN_SIZE)
+
+/*
+ * These are the macros for the trailer of a streamed file. No
+ * block begins with the byte the magic begins with, so a trailer
+ * is told apart from the header of a block by its first byte.
+ */
+#define HEADER_TRAILER_MAGIC            "HUFE"
+#define HEADER_TRAILER_LENGTH_OFFSET    (HEADER_MAGIC_SIZE)
+#define HEADER_TRAILER_CHECKSUM_OFFSET  (HEADER_TRAILER_LENGTH_OFFSET + sizeof(uint64_t))
+#define HEADER_TRAILER_SIZE             (HEADER_TRAILER_CHECKSUM_OFFSET + sizeof(uint32_t))
+
+/* Unpack Errors */
+#define HEADER_ERROR_SHORT              (-1)
+#define HEADER_ERROR_MAGIC              (-2)
+#define HEADER_ERROR_VERSION            (-3)
+#define HEADER_ERROR_FIELD              (-4)
+
+typedef struct huffman_header {
+    /* This is the version of the format the file was written in */
+    uint8_t version;
+
+    /* This is the engine which compressed the payload */
+    uint8_t engine;
+
+    /* These are the mode flags, such as ASCII opcodes */
+    uint8_t flags;
+
+    /*
+     * This is the length of the longest opcode the payload may
+     * contain, which lets the decoder size its tables up front.
+     */
+    uint8_t code_limit;
+
+    /*
+     * This is the size of the header. The payload begins right
+     * after it, so newer versions can add fields which older
+     * versions simply skip.
+     */
+    uint32_t header_size;
+
+    /* This is the length of the original uncompressed file */
+    uint64_t original_length;
+
+    /* This is the CRC32C of the whole original file, if flagged */
+    uint32_t checksum;
+} hheader_t;
+
+/**
+ * This function is used to build a new header for the
+ * current version with all other values set to defaults.
+ */
+hheader_t* hheader_create();
+
+/**
+ * This function is used to free a header.
+ */
+void hheader_free(hheader_t*);
+
+/**
+ * This function is used to pack a header into a buffer
+ * in the byte order it is stored in a file.
+ */
+ssize_t hheader_pack(hheader_t*, uint8_t*, uint64_t);
+
+/**
+ * This function is used to unpack a header from a buffer
+ * and validate it.
+ */
+ssize_t hheader_unpack(hheader_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to pack the length and checksum of a
+ * header into the trailer of a streamed file.
+ */
+ssize_t hheader_pack_trailer(hheader_t*, uint8_t*, uint64_t);
+
+/**
+ * This function is used to unpack the trailer of a streamed
+ * file into a header.
+ */
+ssize_t hheader_unpack_trailer(hheader_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to output a header onto a file
+ * at the beginning of the file.
+ */
+ssize_t hheader_output(hheader_t*, int);
+
+/**
+ * This function is used to input a header from the
+ * beginning of a file.
+ */
+ssize_t hheader_input(hheader_t*, int);
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * This file defines the interface for using the index footer of
+ * a file made of blocks. The index maps offsets in the original
+ * file to the blocks which hold them, so that any part of the file
+ * can be decoded without decoding everything before it.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_index.h"
+#include "huffman_endian.h"
+#include "huffman_io.h"
+
+/**
+ * This function is used to build a new empty index.
+ *
+ * @return An index or NULL
+ */
+hindex_t*
+hindex_create()
+{
+    hindex_t *temp;
+
+    temp = calloc(1, sizeof(hindex_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    temp->entries = malloc(DEFAULT_INDEX_CAPACITY * sizeof(hentry_t));
+    if (!temp->entries) {
+        free(temp);
+        return NULL;
+    }
+
+    temp->capacity = DEFAULT_INDEX_CAPACITY;
+    return temp;
+}
+
+/**
+ * This function is used to free an index.
+ *
+ * @param hindex The index to free
+ */
+void
+hindex_free(hindex_t *hindex)
+{
+    if (!hindex) {
+        return;
+    }
+
+    free(hindex->entries);
+    free(hindex);
+}
+
+/**
+ * This function is used to add the entry of the next block to
+ * an index. Blocks must be added in the order they are in the
+ * file.
+ *
+ * @param hindex The index to add to.
+ * @param original_offset The offset of the block in the original file.
+ * @param offset The offset of the block in the compressed file.
+ * @param table The entry of the block holding the table.
+ * @return 0 on success or error code
+ */
+int
+hindex_add(hindex_t *hindex, uint64_t original_offset, uint64_t offset, uint32_t table)
+{
+    hentry_t *temp;
+
+    if (!hindex) {
+        return INDEX_ERROR_ARGUMENT;
+    } else if (table > hindex->count) {
+        return INDEX_ERROR_ENTRY;
+    } else if (hindex->count && (original_offset <= hindex->entries[hindex->count - 1].original_offset ||
+                                 offset <= hindex->entries[hindex->count - 1].offset)) {
+        return INDEX_ERROR_ENTRY;
+    }
+
+    if (hindex->count == hindex->capacity) {
+        temp = realloc(hindex->entries, 2 * hindex->capacity * sizeof(hentry_t));
+        if (!temp) {
+            return INDEX_ERROR_MEMORY;
+        }
+        hindex->entries = temp;
+        hindex->capacity *= 2;
+    }
+
+    hindex->entries[hindex->count].original_offset = original_offset;
+    hindex->entries[hindex->count].offset = offset;
+    hindex->entries[hindex->count].table = table;
+    hindex->count += 1;
+    return 0;
+}
+
+/**
+ * This function is used to find the entry of the block which
+ * holds an offset of the original file, with a binary search
+ * over the entries.
+ *
+ * @param hindex The index to search.
+ * @param original_offset The offset in the original file.
+ * @return The number of the entry or -1
+ */
+int64_t
+hindex_find(hindex_t *hindex, uint64_t original_offset)
+{
+    int64_t low, high, middle;
+
+    if (!hindex || !hindex->count || original_offset < hindex->entries[0].original_offset) {
+        return -1;
+    }
+
+    /* Find the last entry which begins at or before the offset */
+    low = 0;
+    high = hindex->count - 1;
+    while (low < high) {
+        middle = low + (high - low + 1) / 2;
+        if (hindex->entries[middle].original_offset <= original_offset) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * This function is used to output an index as the footer of a
+ * file in a single write. The footer is the entries followed by
+ * the trailer.
+ *
+ * @param hindex The index to output.
+ * @param fd The file to output to.
+ * @param offset The offset the footer begins at.
+ * @return The offset after the footer or error code
+ */
+ssize_t
+hindex_output(hindex_t *hindex, int fd, uint64_t offset)
+{
+    uint8_t *buffer, *entry;
+    uint64_t size;
+    uint32_t i;
+    int ret;
+
+    if (!hindex) {
+        return INDEX_ERROR_ARGUMENT;
+    }
+
+    size = INDEX_FOOTER_SIZE(hindex->count);
+    buffer = malloc(size);
+    if (!buffer) {
+        return INDEX_ERROR_MEMORY;
+    }
+
+    for (i = 0; i < hindex->count; i++) {
+        entry = buffer + (uint64_t)i * INDEX_ENTRY_SIZE;
+        hendian_put(entry + INDEX_ORIGINAL_OFFSET, hindex->entries[i].original_offset, sizeof(uint64_t));
+        hendian_put(entry + INDEX_OFFSET_OFFSET, hindex->entries[i].offset, sizeof(uint64_t));
+        hendian_put(entry + INDEX_TABLE_OFFSET, hindex->entries[i].table, sizeof(uint32_t));
+    }
+
+    entry = buffer + (uint64_t)hindex->count * INDEX_ENTRY_SIZE;
+    hendian_put(entry + INDEX_COUNT_OFFSET, hindex->count, sizeof(uint32_t));
+    memcpy(entry + INDEX_MAGIC_OFFSET, INDEX_MAGIC, INDEX_MAGIC_SIZE);
+
+    ret = hio_pwrite(fd, buffer, size, offset);
+    free(buffer);
+    if (ret) {
+        return INDEX_ERROR_SHORT;
+    }
+
+    return offset + size;
+}
+
+/**
+ * This function is used to input the index from the footer at
+ * the end of a file. The end of the file is read in a single call
+ * which holds the whole footer unless the file has a great many
+ * blocks, in which case the rest of it is read in a second call.
+ *
+ * @param hindex The empty index to input into.
+ * @param fd The file to input from.
+ * @return The offset the footer begins at or error code
+ */
+ssize_t
+hindex_input(hindex_t *hindex, int fd)
+{
+    struct stat file_stat;
+    uint8_t *buffer, *entry;
+    uint64_t size, footer_size, start;
+    uint32_t i, count;
+    ssize_t bytes_read;
+    int ret;
+
+    if (!hindex || hindex->count) {
+        return INDEX_ERROR_ARGUMENT;
+    } else if (fstat(fd, &file_stat) || file_stat.st_size < (off_t)INDEX_TRAILER_SIZE) {
+        return INDEX_ERROR_SHORT;
+    }
+
+    size = (file_stat.st_size < INDEX_READ_SIZE) ? (uint64_t)file_stat.st_size : INDEX_READ_SIZE;
+    buffer = malloc(size);
+    if (!buffer) {
+        return INDEX_ERROR_MEMORY;
+    }
+
+    bytes_read = hio_pread(fd, buffer, size, file_stat.st_size - size);
+    if (bytes_read < (ssize_t)size) {
+        free(buffer);
+        return INDEX_ERROR_SHORT;
+    }
+
+    entry = buffer + size - INDEX_TRAILER_SIZE;
+    if (memcmp(entry + INDEX_MAGIC_OFFSET, INDEX_MAGIC, INDEX_MAGIC_SIZE)) {
+        free(buffer);
+        return INDEX_ERROR_MAGIC;
+    }
+
+    count = hendian_get(entry + INDEX_COUNT_OFFSET, sizeof(uint32_t));
+    footer_size = INDEX_FOOTER_SIZE(count);
+    if (footer_size > (uint64_t)file_stat.st_size) {
+        free(buffer);
+        return INDEX_ERROR_SHORT;
+    }
+
+    /* A footer larger than what was read is read again whole */
+    start = file_stat.st_size - footer_size;
+    if (footer_size > size) {
+        free(buffer);
+        buffer = malloc(footer_size);
+        if (!buffer) {
+            return INDEX_ERROR_MEMORY;
+        }
+
+        bytes_read = hio_pread(fd, buffer, footer_size, start);
+        if (bytes_read < (ssize_t)footer_size) {
+            free(buffer);
+            return INDEX_ERROR_SHORT;
+        }
+        size = footer_size;
+    }
+
+    entry = buffer + size - footer_size;
+    for (i = 0; i < count; i++, entry += INDEX_ENTRY_SIZE) {
+        ret = hindex_add(hindex, hendian_get(entry + INDEX_ORIGINAL_OFFSET, sizeof(uint64_t)),
+                         hendian_get(entry + INDEX_OFFSET_OFFSET, sizeof(uint64_t)),
+                         hendian_get(entry + INDEX_TABLE_OFFSET, sizeof(uint32_t)));
+        if (ret) {
+            free(buffer);
+            return ret;
+        }
+    }
+
+    free(buffer);
+    return start;
+}
@@ -0,0 +1,118 @@
+/*
+ * This file declares the interface for using the index footer of
+ * a file made of blocks. The index maps offsets in the original
+ * file to the blocks which hold them, so that any part of the file
+ * can be decoded without decoding everything before it.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef HUFFMAN_INDEX_H
+#define HUFFMAN_INDEX_H
+
+/* Identification */
+#define INDEX_MAGIC                     "HUFX"
+#define INDEX_MAGIC_SIZE                (4U)
+
+/* Defaults */
+#define DEFAULT_INDEX_CAPACITY          (64U)
+
+/*
+ * These are the macros for an entry of the index in a file. The
+ * table is the number of the entry whose block holds the table
+ * this block is coded with, which is the entry itself unless the
+ * block repeats the table of an earlier one.
+ */
+#define INDEX_ORIGINAL_OFFSET           (0U)
+#define INDEX_OFFSET_OFFSET             (INDEX_ORIGINAL_OFFSET + sizeof(uint64_t))
+#define INDEX_TABLE_OFFSET              (INDEX_OFFSET_OFFSET + sizeof(uint64_t))
+#define INDEX_ENTRY_SIZE                (INDEX_TABLE_OFFSET + sizeof(uint32_t))
+
+/*
+ * These are the macros for the trailer which ends the file. The
+ * footer is the entries followed by the trailer, so the number of
+ * entries tells where the footer begins.
+ */
+#define INDEX_COUNT_OFFSET              (0U)
+#define INDEX_MAGIC_OFFSET              (INDEX_COUNT_OFFSET + sizeof(uint32_t))
+#define INDEX_TRAILER_SIZE              (INDEX_MAGIC_OFFSET + INDEX_MAGIC_SIZE)
+#define INDEX_FOOTER_SIZE(count)        (((uint64_t)(count) * INDEX_ENTRY_SIZE) + INDEX_TRAILER_SIZE)
+
+/*
+ * This much of the end of a file is read at once, which holds the
+ * whole footer of any file with fewer than about 3000 blocks.
+ */
+#define INDEX_READ_SIZE                 (1U << 16)
+
+/* Index Errors */
+#define INDEX_ERROR_ARGUMENT            (-1)
+#define INDEX_ERROR_SHORT               (-2)
+#define INDEX_ERROR_MAGIC               (-3)
+#define INDEX_ERROR_MEMORY              (-4)
+#define INDEX_ERROR_ENTRY               (-5)
+
+typedef struct index_entry {
+    /* This is the offset of the block in the original file */
+    uint64_t original_offset;
+
+    /* This is the offset of the block in the compressed file */
+    uint64_t offset;
+
+    /* This is the entry of the block holding the table */
+    uint32_t table;
+} hentry_t;
+
+typedef struct huffman_index {
+    /* These are the entries in the order of their blocks */
+    hentry_t *entries;
+
+    /* This is the number of entries */
+    uint32_t count;
+
+    /* This is the number of entries there is room for */
+    uint32_t capacity;
+} hindex_t;
+
+/**
+ * This function is used to build a new empty index.
+ */
+hindex_t* hindex_create();
+
+/**
+ * This function is used to free an index.
+ */
+void hindex_free(hindex_t*);
+
+/**
+ * This function is used to add the entry of the next block
+ * to an index.
+ */
+int hindex_add(hindex_t*, uint64_t, uint64_t, uint32_t);
+
+/**
+ * This function is used to find the entry of the block which
+ * holds an offset of the original file.
+ */
+int64_t hindex_find(hindex_t*, uint64_t);
+
+/**
+ * This function is used to output an index as the footer of
+ * a file in a single write.
+ */
+ssize_t hindex_output(hindex_t*, int, uint64_t);
+
+/**
+ * This function is used to input the index from the footer
+ * at the end of a file.
+ */
+ssize_t hindex_input(hindex_t*, int);
+
+#endif
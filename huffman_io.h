@@ -0,0 +1,154 @@
+/*
+ * This file defines the helpers for reading and writing whole
+ * buffers. A read or a write may move fewer bytes than it was asked
+ * to or be interrupted by a signal, so the helpers retry until the
+ * buffer is done, the file ends or a real error comes up. They are
+ * small enough to be inlined into every module which does I/O.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef HUFFMAN_IO_H
+#define HUFFMAN_IO_H
+
+/**
+ * This function reads from a file in order until a buffer is full
+ * or the file ends.
+ *
+ * @param fd The file to read.
+ * @param buffer The buffer to read into.
+ * @param size The size of the buffer.
+ * @return The number of bytes read or -1
+ */
+static inline ssize_t
+hio_read(int fd, uint8_t *buffer, uint64_t size)
+{
+    ssize_t bytes_read;
+    uint64_t total = 0;
+
+    while (total < size) {
+        bytes_read = read(fd, buffer + total, size - total);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes_read < 0) {
+            return -1;
+        } else if (bytes_read == 0) {
+            break;
+        }
+        total += bytes_read;
+    }
+
+    return total;
+}
+
+/**
+ * This function reads from a file at an offset until a buffer is
+ * full or the file ends. Reading stops as well once the bytes read
+ * are no longer a multiple of the alignment, which is where a file
+ * opened for direct I/O ends, since it cannot be read any further
+ * from an unaligned offset.
+ *
+ * @param fd The file to read.
+ * @param buffer The buffer to read into.
+ * @param size The size of the buffer.
+ * @param offset The offset in the file.
+ * @param alignment The alignment of every read, a power of 2.
+ * @return The number of bytes read or -1
+ */
+static inline ssize_t
+hio_pread_aligned(int fd, uint8_t *buffer, uint64_t size, uint64_t offset, uint64_t alignment)
+{
+    ssize_t bytes_read;
+    uint64_t total = 0;
+
+    while (total < size && !(total & (alignment - 1))) {
+        bytes_read = pread(fd, buffer + total, size - total, offset + total);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes_read < 0) {
+            return -1;
+        } else if (bytes_read == 0) {
+            break;
+        }
+        total += bytes_read;
+    }
+
+    return total;
+}
+
+/**
+ * This function reads from a file at an offset until a buffer is
+ * full or the file ends.
+ *
+ * @param fd The file to read.
+ * @param buffer The buffer to read into.
+ * @param size The size of the buffer.
+ * @param offset The offset in the file.
+ * @return The number of bytes read or -1
+ */
+static inline ssize_t
+hio_pread(int fd, uint8_t *buffer, uint64_t size, uint64_t offset)
+{
+    return hio_pread_aligned(fd, buffer, size, offset, 1);
+}
+
+/**
+ * This function writes a whole buffer into a file in order.
+ *
+ * @param fd The file to write.
+ * @param buffer The buffer to write from.
+ * @param size The size of the buffer.
+ * @return 0 on success or -1
+ */
+static inline int
+hio_write(int fd, const uint8_t *buffer, uint64_t size)
+{
+    ssize_t bytes_written;
+    uint64_t total = 0;
+
+    while (total < size) {
+        bytes_written = write(fd, buffer + total, size - total);
+        if (bytes_written < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes_written <= 0) {
+            return -1;
+        }
+        total += bytes_written;
+    }
+
+    return 0;
+}
+
+/**
+ * This function writes a whole buffer into a file at an offset.
+ *
+ * @param fd The file to write.
+ * @param buffer The buffer to write from.
+ * @param size The size of the buffer.
+ * @param offset The offset in the file.
+ * @return 0 on success or -1
+ */
+static inline int
+hio_pwrite(int fd, const uint8_t *buffer, uint64_t size, uint64_t offset)
+{
+    ssize_t bytes_written;
+    uint64_t total = 0;
+
+    while (total < size) {
+        bytes_written = pwrite(fd, buffer + total, size - total, offset + total);
+        if (bytes_written < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes_written <= 0) {
+            return -1;
+        }
+        total += bytes_written;
+    }
+
+    return 0;
+}
+
+#endif
@@ -270,6 +270,38 @@ hlist_add_increment_element(hlist_t *hlist, uint8_t element, uint64_t frequency)
     return helement_node;
 }
 
+/**
+ * This function is used to add a new leaf element with a known
+ * frequency to the huffman list. Unlike add/increment, the element
+ * is never mistaken for a special element, which matters for the
+ * element 0xFF when the frequency has already been counted.
+ *
+ * @param hlist The huffman list where we want to add the element
+ * @param element The element to be added.
+ * @param frequency The frequency of this element.
+ * @return The newly created element or NULL.
+ */
+helement_t*
+hlist_add_element(hlist_t *hlist, uint8_t element, uint64_t frequency)
+{
+    int err;
+    helement_t *helement_node;
+
+    if (!hlist) {
+        return NULL;
+    }
+
+    err = _add(hlist, element, 1, frequency);
+    if (err) {
+        return NULL;
+    }
+
+    /* New elements are added to the front so the order needs fixing */
+    helement_node = hlist->list;
+    _fix_order(hlist, helement_node);
+    return helement_node;
+}
+
 /**
  * This function is used to return the count of the elements in
  * the list.
@@ -60,6 +60,13 @@ void hlist_free(hlist_t*);
  */
 helement_t* hlist_add_increment_element(hlist_t*, uint8_t, uint64_t);
 
+/**
+ * This function is used to add a new leaf element with a known
+ * frequency to the huffman list. Unlike add/increment, the element
+ * is never mistaken for a special element.
+ */
+helement_t* hlist_add_element(hlist_t*, uint8_t, uint64_t);
+
 /**
  * This function is used to return the count of the elements in
  * the list.
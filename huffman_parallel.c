@@ -0,0 +1,676 @@
+/*
+ * This file defines the interface for decoding a single huffman
+ * bit stream on several threads at once. Threads begin at arbitrary
+ * bit offsets and rely on huffman codes synchronizing themselves
+ * after a short distance. Batches of blocks are also encoded and
+ * decoded on several threads at once.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_parallel.h"
+#include "huffman_io.h"
+
+/*
+ * This structure holds everything a thread needs to decode its
+ * segment of the opcodes, along with what was learnt about the
+ * segment while stitching the segments together.
+ */
+typedef struct parallel_segment {
+    /* The tree and the opcodes shared by every segment */
+    htree_t *htree;
+    const uint8_t *vector;
+    uint64_t bit_count;
+
+    /*
+     * The thread begins decoding at start, which might be in the
+     * middle of an opcode, and keeps going until the first element
+     * boundary at or after stop. It then holds the boundary it
+     * stopped at, the number of elements it decoded and the first
+     * few boundaries it came across.
+     */
+    uint64_t start;
+    uint64_t stop;
+    uint64_t end;
+    uint64_t count;
+    uint64_t boundary_count;
+    uint64_t boundaries[PARALLEL_SYNC_WINDOW];
+
+    /*
+     * Once stitched, a valid segment knows the first true boundary
+     * within it, how many of its speculative elements come before
+     * that boundary and how many elements it has to write out.
+     */
+    uint8_t valid;
+    uint64_t sync;
+    uint64_t skip;
+    uint64_t total;
+    uint8_t *out;
+} psegment_t;
+
+/**
+ * This function steps through the tree from the root until a leaf
+ * node is reached. It is the same as calling htree_state_step for
+ * every opcode of a single element. This function is not presented
+ * as an interface function.
+ *
+ * @param root The root of the tree.
+ * @param vector The opcodes.
+ * @param position The position of the next opcode.
+ * @param bit_count The number of opcodes.
+ * @return The element or -1 if the opcodes ran out
+ */
+static int
+_step_element(helement_t *root, const uint8_t *vector, uint64_t *position, uint64_t bit_count)
+{
+    uint64_t index = *position;
+    helement_t *helement_node = root;
+
+    while (!helement_node->leaf_node) {
+        if (index >= bit_count) {
+            *position = index;
+            return -1;
+        }
+
+        if (vector[VECTOR_BYTE_INDEX(index)] & VECTOR_CHECK_STRING(index)) {
+            helement_node = helement_node->right_child;
+        } else {
+            helement_node = helement_node->left_child;
+        }
+        index += 1;
+    }
+
+    *position = index;
+    return helement_node->element;
+}
+
+/**
+ * This function is run by every thread to decode its segment
+ * speculatively. Nothing is written out, the thread only counts
+ * the elements and remembers the first boundaries it finds. This
+ * function is not presented as an interface function.
+ *
+ * @param argument The segment to decode.
+ * @return NULL
+ */
+static void*
+_speculate(void *argument)
+{
+    psegment_t *segment = argument;
+    uint64_t position = segment->start;
+
+    segment->count = 0;
+    segment->boundary_count = 0;
+    while (position < segment->stop) {
+        if (_step_element(segment->htree->root, segment->vector, &position, segment->bit_count) < 0) {
+            break;
+        }
+
+        if (segment->boundary_count < PARALLEL_SYNC_WINDOW) {
+            segment->boundaries[segment->boundary_count++] = position;
+        }
+        segment->count += 1;
+    }
+
+    segment->end = position;
+    return NULL;
+}
+
+/**
+ * This function is run by every thread once the segments have been
+ * stitched. It decodes the valid part of a segment into its place
+ * in the output. This function is not presented as an interface
+ * function.
+ *
+ * @param argument The segment to decode.
+ * @return NULL
+ */
+static void*
+_decode(void *argument)
+{
+    int element;
+    uint64_t i;
+    psegment_t *segment = argument;
+    uint64_t position = segment->sync;
+
+    for (i = 0; i < segment->total; i++) {
+        element = _step_element(segment->htree->root, segment->vector, &position, segment->bit_count);
+        if (element < 0) {
+            break;
+        }
+        segment->out[i] = element;
+    }
+
+    segment->total = i;
+    return NULL;
+}
+
+/**
+ * This function runs a function on a thread for every segment in
+ * a list and waits for all of them. This function is not presented
+ * as an interface function.
+ *
+ * @param segments The segments to run on.
+ * @param count The number of segments.
+ * @param function The function to run.
+ * @return 0 on success or error code
+ */
+static int
+_run(psegment_t *segments, int count, void *(*function)(void *))
+{
+    int i, ret;
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    uint8_t started[PARALLEL_MAX_THREADS];
+
+    ret = 0;
+    for (i = 0; i < count; i++) {
+        started[i] = 0;
+        if (function == _decode && !segments[i].valid) {
+            continue;
+        }
+
+        if (pthread_create(&threads[i], NULL, function, &segments[i])) {
+            /* Run it here instead if a thread cannot be made */
+            function(&segments[i]);
+        } else {
+            started[i] = 1;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (started[i] && pthread_join(threads[i], NULL)) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * This function walks the segments in order and checks where the
+ * true element boundaries, which continue on from the first segment,
+ * meet the speculative boundaries of the next segment. Once they meet
+ * both decode exactly the same elements from there on. If they never
+ * meet within the window, the next segment is decoded here instead
+ * and is dropped. This function is not presented as an interface
+ * function.
+ *
+ * @param segments The segments to stitch.
+ * @param count The number of segments.
+ */
+static void
+_stitch(psegment_t *segments, int count)
+{
+    int i;
+    int64_t match;
+    uint64_t j, position, extra;
+    psegment_t *current, *next;
+
+    current = &segments[0];
+    current->valid = 1;
+    current->sync = 0;
+    current->skip = 0;
+    position = current->end;
+    extra = 0;
+
+    for (i = 1; i < count; i++) {
+        next = &segments[i];
+        match = -2;
+        j = 0;
+
+        /*
+         * Keep decoding the true boundaries one element at a time
+         * until one of them is a boundary the next segment also saw.
+         */
+        if (position == next->start) {
+            match = -1;
+        } else {
+            while (1) {
+                while (j < next->boundary_count && next->boundaries[j] < position) {
+                    j += 1;
+                }
+
+                if (j >= next->boundary_count) {
+                    break;
+                } else if (next->boundaries[j] == position) {
+                    match = j;
+                    break;
+                } else if (_step_element(current->htree->root, current->vector, &position, current->bit_count) < 0) {
+                    break;
+                }
+                extra += 1;
+            }
+        }
+
+        if (match >= -1) {
+            current->total = current->count - current->skip + extra;
+            next->valid = 1;
+            next->sync = position;
+            next->skip = match + 1;
+            current = next;
+            position = current->end;
+            extra = 0;
+        } else {
+            /* The speculation failed so the segment is decoded here */
+            next->valid = 0;
+            while (position < next->stop) {
+                if (_step_element(current->htree->root, current->vector, &position, current->bit_count) < 0) {
+                    break;
+                }
+                extra += 1;
+            }
+        }
+    }
+
+    current->total = current->count - current->skip + extra;
+}
+
+/**
+ * This function is used to decode the opcodes of a huffman tree
+ * on several threads. The opcodes are cut into equal segments which
+ * are decoded speculatively, stitched together where the speculative
+ * and true element boundaries meet, and then decoded once more into
+ * their places in the output. The output is exactly the same as
+ * stepping through the opcodes one by one.
+ *
+ * @param htree The huffman tree to step through.
+ * @param vector_opcodes The opcodes.
+ * @param out The buffer to decode into.
+ * @param length The number of elements to decode.
+ * @param threads The number of threads to use.
+ * @return The number of elements decoded or error code
+ */
+int64_t
+hparallel_decode(htree_t *htree, bvector_t *vector_opcodes, uint8_t *out, uint64_t length, int threads)
+{
+    int i;
+    uint64_t bit_count, segment_bits, offset;
+    psegment_t *segments;
+
+    if (!htree || !htree->root || !vector_opcodes || !out) {
+        return -1;
+    } else if (htree->root->leaf_node) {
+        return -2;
+    }
+
+    /* Every thread should have a meaningful amount of work */
+    bit_count = bvector_get_size(vector_opcodes, VECTOR_FLAG_STREAM);
+    if (threads > (int)PARALLEL_MAX_THREADS) {
+        threads = PARALLEL_MAX_THREADS;
+    }
+    if ((uint64_t)threads > bit_count / PARALLEL_MIN_SEGMENT_BITS) {
+        threads = bit_count / PARALLEL_MIN_SEGMENT_BITS;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    segments = calloc(threads, sizeof(psegment_t));
+    if (!segments) {
+        return -3;
+    }
+
+    segment_bits = (bit_count + threads - 1) / threads;
+    for (i = 0; i < threads; i++) {
+        segments[i].htree = htree;
+        segments[i].vector = vector_opcodes->vector;
+        segments[i].bit_count = bit_count;
+        segments[i].start = (i * segment_bits < bit_count) ? i * segment_bits : bit_count;
+        segments[i].stop = (segments[i].start + segment_bits < bit_count) ? segments[i].start + segment_bits : bit_count;
+    }
+
+    if (_run(segments, threads, _speculate)) {
+        free(segments);
+        return -4;
+    }
+
+    _stitch(segments, threads);
+
+    /* Place every valid segment in the output and make sure it fits */
+    offset = 0;
+    for (i = 0; i < threads; i++) {
+        if (!segments[i].valid) {
+            continue;
+        }
+
+        if (segments[i].total > length - offset) {
+            free(segments);
+            return -5;
+        }
+        segments[i].out = out + offset;
+        offset += segments[i].total;
+    }
+
+    if (_run(segments, threads, _decode)) {
+        free(segments);
+        return -4;
+    }
+
+    offset = 0;
+    for (i = 0; i < threads; i++) {
+        if (segments[i].valid) {
+            offset += segments[i].total;
+        }
+    }
+
+    free(segments);
+    return offset;
+}
+
+/**
+ * This function is run by every thread to prepare its block,
+ * which counts the elements and builds a fresh table. This
+ * function is not presented as an interface function.
+ *
+ * @param argument The job to prepare.
+ * @return NULL
+ */
+static void*
+_prepare(void *argument)
+{
+    pjob_t *job = argument;
+
+    job->size = hblock_prepare(job->block, job->in, job->length);
+    return NULL;
+}
+
+/**
+ * This function is run by every thread to emit its block once
+ * the tables of every block have been chosen. This function is not
+ * presented as an interface function.
+ *
+ * @param argument The job to emit.
+ * @return NULL
+ */
+static void*
+_emit(void *argument)
+{
+    pjob_t *job = argument;
+
+    job->size = hblock_emit(job->block, job->in, job->out, job->capacity);
+    return NULL;
+}
+
+/**
+ * This function is run by every thread to decode its block once
+ * it has followed the block before it. A block which is only
+ * checked is decoded into the buffer of the job used as scratch,
+ * and so is a stored block, which is written out from its body.
+ * This function is not presented as an interface function.
+ *
+ * @param argument The job to decode.
+ * @return NULL
+ */
+static void*
+_decode_block(void *argument)
+{
+    pjob_t *job = argument;
+
+    if (job->verify || job->block->type == BLOCK_TYPE_STORED) {
+        job->size = hblock_verify(job->block, job->in, job->out, job->capacity);
+    } else {
+        job->size = hblock_decode(job->block, job->in, job->out, job->capacity);
+    }
+    return NULL;
+}
+
+/**
+ * This function is run by every thread to emit its sized block
+ * and write it into the file at its offset. The block must come out
+ * exactly as large as was worked out for it, or it would run into
+ * the block after it. This function is not presented as an
+ * interface function.
+ *
+ * @param argument The job to emit and write.
+ * @return NULL
+ */
+static void*
+_emit_at(void *argument)
+{
+    pjob_t *job = argument;
+    ssize_t size;
+
+    size = job->size;
+    job->size = hblock_emit(job->block, job->in, job->out, job->capacity);
+    if (job->size < 0) {
+        return NULL;
+    } else if (job->size != size) {
+        job->size = -1;
+        return NULL;
+    }
+
+    if (hio_pwrite(job->out_fd, job->out, size, job->offset)) {
+        job->size = -1;
+    }
+    return NULL;
+}
+
+/**
+ * This function runs a function on a thread for every job in a
+ * batch and waits for all of them. The first job is run on the
+ * calling thread, so a batch of one never starts a thread. This
+ * function is not presented as an interface function.
+ *
+ * @param jobs The jobs to run on.
+ * @param count The number of jobs.
+ * @param function The function to run.
+ * @return 0 on success or error code
+ */
+static int
+_run_jobs(pjob_t *jobs, int count, void *(*function)(void *))
+{
+    int i, ret;
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    uint8_t started[PARALLEL_MAX_THREADS];
+
+    ret = 0;
+    for (i = 1; i < count; i++) {
+        started[i] = 0;
+        if (pthread_create(&threads[i], NULL, function, &jobs[i])) {
+            /* Run it here instead if a thread cannot be made */
+            function(&jobs[i]);
+        } else {
+            started[i] = 1;
+        }
+    }
+
+    function(&jobs[0]);
+    for (i = 1; i < count; i++) {
+        if (started[i] && pthread_join(threads[i], NULL)) {
+            ret = -1;
+        }
+    }
+
+    for (i = 0; i < count && !ret; i++) {
+        if (jobs[i].size < 0) {
+            ret = jobs[i].size;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * This function is used to encode a batch of blocks on several
+ * threads. Every block is prepared on its own thread. Only the
+ * choice of table depends on the block before, and it looks at
+ * nothing but the frequencies, so it is made for every block in
+ * order on the calling thread. The blocks are then emitted on
+ * their own threads again. The output is exactly the same as
+ * encoding the blocks one by one, whatever the number of threads.
+ *
+ * @param jobs The blocks of the batch in the order of the file.
+ * @param count The number of blocks, at most PARALLEL_MAX_THREADS.
+ * @param previous The block before the batch or NULL.
+ * @return 0 on success or error code
+ */
+int
+hparallel_encode(pjob_t *jobs, int count, hblock_t *previous)
+{
+    int i, ret;
+
+    if (!jobs || count < 1 || count > (int)PARALLEL_MAX_THREADS) {
+        return -1;
+    }
+
+    ret = _run_jobs(jobs, count, _prepare);
+    if (ret) {
+        return ret;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = hblock_choose(jobs[i].block, previous);
+        if (ret) {
+            return ret;
+        }
+        previous = jobs[i].block;
+    }
+
+    return _run_jobs(jobs, count, _emit);
+}
+
+/**
+ * This function is used to prepare and choose a batch of sized
+ * blocks on several threads, like the first half of encoding a
+ * batch. The size of every job is set to the exact size its block
+ * is emitted into, so that every block can be given its place in
+ * the file before any of them is emitted.
+ *
+ * @param jobs The sized blocks of the batch in the order of the file.
+ * @param count The number of blocks, at most PARALLEL_MAX_THREADS.
+ * @param previous The block before the batch or NULL.
+ * @return 0 on success or error code
+ */
+int
+hparallel_size(pjob_t *jobs, int count, hblock_t *previous)
+{
+    int i, ret;
+
+    if (!jobs || count < 1 || count > (int)PARALLEL_MAX_THREADS) {
+        return -1;
+    }
+
+    ret = _run_jobs(jobs, count, _prepare);
+    if (ret) {
+        return ret;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = hblock_choose(jobs[i].block, previous);
+        if (ret) {
+            return ret;
+        }
+
+        jobs[i].size = hblock_size(jobs[i].block);
+        if (jobs[i].size < 0) {
+            return jobs[i].size;
+        }
+        previous = jobs[i].block;
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to emit a batch of sized blocks on
+ * several threads, once hparallel_size has worked out how large
+ * they are and every job has been given its file and offset. Every
+ * thread writes its own block at its offset as soon as it is
+ * emitted, so the blocks are written in no particular order and no
+ * thread waits on the block before it.
+ *
+ * @param jobs The sized blocks of the batch.
+ * @param count The number of blocks, at most PARALLEL_MAX_THREADS.
+ * @return 0 on success or error code
+ */
+int
+hparallel_emit_at(pjob_t *jobs, int count)
+{
+    if (!jobs || count < 1 || count > (int)PARALLEL_MAX_THREADS) {
+        return -1;
+    }
+
+    return _run_jobs(jobs, count, _emit_at);
+}
+
+/**
+ * This function is used to encode two blocks in a row at once,
+ * overlapping the two halves of encoding. The current block, whose
+ * table has been chosen already, is emitted on a thread of its own
+ * while the calling thread prepares the next block and chooses its
+ * table after the current one. Choosing only reads the table of the
+ * current block, which emitting never changes, and every block has
+ * its own state, so nothing is written by both threads. Called for
+ * every block with two jobs taking turns, counting and building the
+ * table of a block is hidden behind packing the block before it.
+ * The output is exactly the same as encoding the blocks one by one.
+ *
+ * @param current The block to emit, or NULL before the first block.
+ * @param next The block to prepare, or NULL after the last block.
+ * @return 0 on success or error code
+ */
+int
+hparallel_overlap(pjob_t *current, pjob_t *next)
+{
+    pthread_t thread;
+    uint8_t started;
+    int ret;
+
+    started = 0;
+    if (current && !pthread_create(&thread, NULL, _emit, current)) {
+        started = 1;
+    } else if (current) {
+        /* Run it here instead if a thread cannot be made */
+        _emit(current);
+    }
+
+    ret = 0;
+    if (next) {
+        ret = hblock_prepare(next->block, next->in, next->length);
+        if (!ret) {
+            ret = hblock_choose(next->block, current ? current->block : NULL);
+        }
+    }
+
+    if (started && pthread_join(thread, NULL)) {
+        return -1;
+    } else if (ret) {
+        return ret;
+    } else if (current && current->size < 0) {
+        return current->size;
+    }
+    return 0;
+}
+
+/**
+ * This function is used to decode a batch of blocks on several
+ * threads. The header of every block must have been read with
+ * hblock_parse and its body followed by STREAM_PADDING readable
+ * bytes. Every block follows the block before it on the calling
+ * thread first, which only copies or loads tables, and the blocks
+ * are then decoded on their own threads.
+ *
+ * @param jobs The blocks of the batch in the order of the file.
+ * @param count The number of blocks, at most PARALLEL_MAX_THREADS.
+ * @param previous The block before the batch or NULL.
+ * @return 0 on success or error code
+ */
+int
+hparallel_decode_blocks(pjob_t *jobs, int count, hblock_t *previous)
+{
+    int i, ret;
+
+    if (!jobs || count < 1 || count > (int)PARALLEL_MAX_THREADS) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = hblock_follow(jobs[i].block, previous, jobs[i].in);
+        if (ret) {
+            return ret;
+        }
+        previous = jobs[i].block;
+    }
+
+    return _run_jobs(jobs, count, _decode_block);
+}
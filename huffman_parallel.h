@@ -0,0 +1,103 @@
+/*
+ * This file declares the interface for decoding a single huffman
+ * bit stream on several threads at once. Threads begin at arbitrary
+ * bit offsets and rely on huffman codes synchronizing themselves
+ * after a short distance. Batches of blocks are also encoded and
+ * decoded on several threads at once.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "huffman_tree.h"
+#include "huffman_block.h"
+#include "bit_vector.h"
+
+#ifndef HUFFMAN_PARALLEL_H
+#define HUFFMAN_PARALLEL_H
+
+/* Limits */
+#define PARALLEL_MAX_THREADS            (256U)
+#define PARALLEL_MIN_SEGMENT_BITS       (1U << 16)
+
+/*
+ * This is the number of element boundaries every thread remembers
+ * from where it began. The thread before it has to land on one of
+ * these boundaries for the speculation to be accepted.
+ */
+#define PARALLEL_SYNC_WINDOW            (1024U)
+
+/*
+ * This structure holds one block of a batch which is encoded or
+ * decoded on a thread of its own. Every job has its own block state and
+ * buffers so that nothing is shared between the threads.
+ */
+typedef struct parallel_job {
+    /* The block state of the job */
+    hblock_t *block;
+
+    /* The elements of the block, or its body when decoding */
+    uint8_t *in;
+    uint64_t length;
+
+    /* The buffer the block is encoded or decoded into */
+    uint8_t *out;
+    uint64_t capacity;
+
+    /* The size of the encoded block or error code */
+    ssize_t size;
+
+    /* This is set when the block is only checked */
+    uint8_t verify;
+
+    /* The file and offset a sized block is written at by its own thread */
+    int out_fd;
+    uint64_t offset;
+} pjob_t;
+
+/**
+ * This function is used to decode the opcodes of a huffman tree
+ * on several threads. The output is exactly the same as stepping
+ * through the opcodes one by one.
+ */
+int64_t hparallel_decode(htree_t*, bvector_t*, uint8_t*, uint64_t, int);
+
+/**
+ * This function is used to encode a batch of blocks on several
+ * threads. The output is exactly the same as encoding the blocks
+ * one by one.
+ */
+int hparallel_encode(pjob_t*, int, hblock_t*);
+
+/**
+ * This function is used to prepare and choose a batch of sized
+ * blocks on several threads, working out the exact size of every
+ * block before any of them is emitted.
+ */
+int hparallel_size(pjob_t*, int, hblock_t*);
+
+/**
+ * This function is used to emit a batch of sized blocks on
+ * several threads, every thread writing its block where it goes.
+ */
+int hparallel_emit_at(pjob_t*, int);
+
+/**
+ * This function is used to emit one block on a thread of its own
+ * while the block after it is prepared on the calling thread.
+ */
+int hparallel_overlap(pjob_t*, pjob_t*);
+
+/**
+ * This function is used to decode a batch of blocks on several
+ * threads, every block into the buffer of its own job.
+ */
+int hparallel_decode_blocks(pjob_t*, int, hblock_t*);
+
+#endif
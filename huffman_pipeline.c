@@ -0,0 +1,569 @@
+/*
+ * This file defines the interface for encoding blocks in a
+ * pipeline of three stages. A reader thread, an encoder thread and
+ * the calling thread as the writer pass preallocated blocks between
+ * each other over rings, so that reading, encoding and writing all
+ * happen at the same time. Where asked for and where the system has
+ * it, the reader and the writer keep several reads and writes in
+ * flight through io_uring.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_pipeline.h"
+#include "huffman_io.h"
+
+/**
+ * This function sets up an io_uring for the reader or the writer
+ * and registers the input or the output buffers of every block with
+ * it. If the buffers cannot be registered, plain reads and writes
+ * are still queued on the ring. This function is not presented as
+ * an interface function.
+ *
+ * @param hpipeline The pipeline.
+ * @param output Whether the output buffers are registered.
+ * @return A ring or NULL where io_uring is missing
+ */
+static huring_t*
+_uring_create(hpipeline_t *hpipeline, uint8_t output)
+{
+    struct iovec buffers[PIPELINE_MAX_DEPTH];
+    huring_t *huring;
+    uint32_t i;
+
+    huring = huring_create(hpipeline->depth);
+    if (!huring) {
+        return NULL;
+    }
+
+    for (i = 0; i < hpipeline->depth; i++) {
+        buffers[i].iov_base = output ? hpipeline->slots[i].out : hpipeline->slots[i].in;
+        buffers[i].iov_len = output ? hpipeline->slots[i].capacity : hpipeline->block_size;
+    }
+    huring_register(huring, buffers, hpipeline->depth);
+    return huring;
+}
+
+/**
+ * This function closes every ring of a pipeline so that every
+ * stage stops. This function is not presented as an interface
+ * function.
+ *
+ * @param hpipeline The pipeline to stop.
+ */
+static void
+_abort(hpipeline_t *hpipeline)
+{
+    hring_close(hpipeline->free);
+    hring_close(hpipeline->filled);
+    hring_close(hpipeline->encoded);
+}
+
+/**
+ * This function is used by the reader to read through io_uring.
+ * A read is kept in flight for every free block, each at the offset
+ * of its part of the file, and blocks are passed on to the encoder
+ * in the order of the file whichever read completes first. A short
+ * read is finished off with plain reads and only ends the file if
+ * it stays short. This function is not presented as an interface
+ * function.
+ *
+ * @param hpipeline The pipeline.
+ * @param huring The ring of the reader.
+ * @param offset The offset of the first block in the file.
+ * @return 0 on success or error code
+ */
+static int
+_read_ahead(hpipeline_t *hpipeline, huring_t *huring, uint64_t offset)
+{
+    pjob_t *pending[PIPELINE_MAX_DEPTH];
+    uint64_t offsets[PIPELINE_MAX_DEPTH];
+    int32_t results[PIPELINE_MAX_DEPTH];
+    uint8_t done[PIPELINE_MAX_DEPTH];
+    uint32_t first, count, slot;
+    uint64_t user_data;
+    int32_t result;
+    ssize_t length, rest;
+    pjob_t *job;
+    uint8_t ended;
+    int ret;
+
+    first = 0;
+    count = 0;
+    ended = 0;
+    ret = 0;
+    while (1) {
+        /* Nothing is waited on while reads are in flight */
+        while (!ended && !ret && count < hpipeline->depth) {
+            job = count ? hring_try_pop(hpipeline->free) : hring_pop(hpipeline->free);
+            if (!job) {
+                break;
+            }
+
+            slot = job - hpipeline->slots;
+            done[slot] = 0;
+            offsets[slot] = offset;
+            if (huring_read(huring, hpipeline->in_fd, job->in, hpipeline->block_size, offset,
+                            huring->registered ? (int)slot : URING_UNREGISTERED, slot)) {
+                ret = PIPELINE_ERROR_READ;
+                break;
+            }
+
+            pending[(first + count) % PIPELINE_MAX_DEPTH] = job;
+            offset += hpipeline->block_size;
+            count += 1;
+        }
+
+        if (!ret && huring_submit(huring) < 0) {
+            ret = PIPELINE_ERROR_READ;
+        }
+        if (ret || !count) {
+            break;
+        }
+
+        job = pending[first];
+        slot = job - hpipeline->slots;
+        while (!done[slot]) {
+            if (huring_reap(huring, &user_data, &result, 1) <= 0) {
+                ret = PIPELINE_ERROR_READ;
+                break;
+            }
+            done[user_data] = 1;
+            results[user_data] = result;
+        }
+
+        first = (first + 1) % PIPELINE_MAX_DEPTH;
+        count -= 1;
+        if (ret) {
+            break;
+        } else if (ended) {
+            continue;
+        } else if (results[slot] < 0) {
+            ret = PIPELINE_ERROR_READ;
+            break;
+        }
+
+        length = results[slot];
+        if ((uint64_t)length < hpipeline->block_size) {
+            rest = hio_pread(hpipeline->in_fd, job->in + length, hpipeline->block_size - length,
+                                offsets[slot] + length);
+            if (rest < 0) {
+                ret = PIPELINE_ERROR_READ;
+                break;
+            }
+            length += rest;
+        }
+
+        /* Reads past the end are still drained before stopping */
+        if ((uint64_t)length < hpipeline->block_size) {
+            ended = 1;
+        }
+        if (!length) {
+            continue;
+        }
+
+        job->length = length;
+        if (hring_push(hpipeline->filled, job)) {
+            break;
+        }
+    }
+
+    /* Reads still in flight must land before their blocks are freed */
+    while ((huring->in_flight || huring->queued) && huring_reap(huring, &user_data, &result, 1) > 0);
+    return ret;
+}
+
+/**
+ * This function is run by the reader thread. It takes free
+ * blocks, reads the next part of the file into them and passes
+ * them on to the encoder until the file ends. This function is not
+ * presented as an interface function.
+ *
+ * @param argument The pipeline.
+ * @return NULL
+ */
+static void*
+_reader(void *argument)
+{
+    hpipeline_t *hpipeline = argument;
+    huring_t *huring;
+    pjob_t *job;
+    ssize_t length;
+    off_t offset;
+    int ret;
+
+    /* Reads at offsets go on from wherever the file was left */
+    huring = NULL;
+    if (hpipeline->uring) {
+        offset = lseek(hpipeline->in_fd, 0, SEEK_CUR);
+        huring = (offset < 0) ? NULL : _uring_create(hpipeline, 0);
+    }
+
+    if (huring) {
+        hpipeline->read_backend = huring->registered ? PIPELINE_IO_URING_REGISTERED : PIPELINE_IO_URING;
+        ret = _read_ahead(hpipeline, huring, offset);
+        huring_free(huring);
+        if (ret) {
+            hpipeline->read_error = ret;
+            _abort(hpipeline);
+        }
+
+        hring_close(hpipeline->filled);
+        return NULL;
+    }
+
+    while ((job = hring_pop(hpipeline->free))) {
+        length = hio_read(hpipeline->in_fd, job->in, hpipeline->block_size);
+        if (length < 0) {
+            hpipeline->read_error = PIPELINE_ERROR_READ;
+            _abort(hpipeline);
+            break;
+        } else if (length == 0) {
+            break;
+        }
+
+        job->length = length;
+        if (hring_push(hpipeline->filled, job) || (uint64_t)length < hpipeline->block_size) {
+            break;
+        }
+    }
+
+    hring_close(hpipeline->filled);
+    return NULL;
+}
+
+/**
+ * This function is run by the encoder thread. It waits for a
+ * filled block, takes whatever other filled blocks are already
+ * waiting up to the batch size and encodes them together with
+ * hparallel_encode. The output does not depend on how the blocks
+ * were batched. This function is not presented as an interface
+ * function.
+ *
+ * @param argument The pipeline.
+ * @return NULL
+ */
+static void*
+_encoder(void *argument)
+{
+    hpipeline_t *hpipeline = argument;
+    pjob_t batch[PARALLEL_MAX_THREADS];
+    pjob_t *owners[PARALLEL_MAX_THREADS];
+    pjob_t *job;
+    int i, count, ret;
+
+    while ((job = hring_pop(hpipeline->filled))) {
+        owners[0] = job;
+        count = 1;
+        while (count < hpipeline->batch_size && (job = hring_try_pop(hpipeline->filled))) {
+            owners[count++] = job;
+        }
+
+        for (i = 0; i < count; i++) {
+            batch[i] = *owners[i];
+        }
+
+        ret = hparallel_encode(batch, count, hpipeline->previous);
+        if (ret) {
+            hpipeline->encode_error = PIPELINE_ERROR_ENCODE;
+            _abort(hpipeline);
+            break;
+        }
+
+        for (i = 0; i < count && !ret; i++) {
+            owners[i]->size = batch[i].size;
+            ret = hring_push(hpipeline->encoded, owners[i]);
+        }
+
+        if (ret) {
+            break;
+        }
+        hpipeline->previous = owners[count - 1]->block;
+    }
+
+    hring_close(hpipeline->encoded);
+    return NULL;
+}
+
+/**
+ * This function is used to build a new pipeline along with every
+ * block it needs, so that nothing is allocated while it runs. The
+ * depth is the number of blocks going around the pipeline.
+ *
+ * @param depth The number of blocks in the pipeline.
+ * @param batch_size The largest number of blocks encoded at once.
+ * @param block_size The number of elements in every block.
+ * @param stream_count The number of streams every block is encoded into.
+ * @param checksums Whether every block carries a checksum.
+ * @return A pipeline or NULL
+ */
+hpipeline_t*
+hpipeline_create(uint32_t depth, int batch_size, uint32_t block_size, uint8_t stream_count, uint8_t checksums)
+{
+    hpipeline_t *temp;
+    uint32_t i;
+
+    if (depth < PIPELINE_MIN_DEPTH || depth > PIPELINE_MAX_DEPTH) {
+        return NULL;
+    } else if (batch_size < 1 || batch_size > (int)PARALLEL_MAX_THREADS) {
+        return NULL;
+    } else if (block_size < 1 || block_size > BLOCK_MAX_SIZE) {
+        return NULL;
+    }
+
+    temp = calloc(1, sizeof(hpipeline_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    temp->depth = depth;
+    temp->batch_size = batch_size;
+    temp->block_size = block_size;
+    temp->slots = calloc(depth, sizeof(pjob_t));
+    temp->free = hring_create(depth);
+    temp->filled = hring_create(depth);
+    temp->encoded = hring_create(depth);
+    if (!temp->slots || !temp->free || !temp->filled || !temp->encoded) {
+        hpipeline_free(temp);
+        return NULL;
+    }
+
+    for (i = 0; i < depth; i++) {
+        temp->slots[i].block = hblock_create(stream_count, checksums);
+        temp->slots[i].capacity = hblock_bound(block_size, stream_count);
+        temp->slots[i].in = malloc(block_size);
+        temp->slots[i].out = malloc(temp->slots[i].capacity);
+        if (!temp->slots[i].block || !temp->slots[i].in || !temp->slots[i].out) {
+            hpipeline_free(temp);
+            return NULL;
+        }
+    }
+
+    return temp;
+}
+
+/**
+ * This function is used to free a pipeline and its blocks.
+ *
+ * @param hpipeline The pipeline to free
+ */
+void
+hpipeline_free(hpipeline_t *hpipeline)
+{
+    uint32_t i;
+
+    if (!hpipeline) {
+        return;
+    }
+
+    for (i = 0; hpipeline->slots && i < hpipeline->depth; i++) {
+        hblock_free(hpipeline->slots[i].block);
+        free(hpipeline->slots[i].in);
+        free(hpipeline->slots[i].out);
+    }
+
+    hring_free(hpipeline->free);
+    hring_free(hpipeline->filled);
+    hring_free(hpipeline->encoded);
+    free(hpipeline->slots);
+    free(hpipeline);
+}
+
+/**
+ * This function is used by the writer to take the next write
+ * which completed off its io_uring and hand the block back to the
+ * reader. A short write is finished off with plain writes. This
+ * function is not presented as an interface function.
+ *
+ * @param hpipeline The pipeline.
+ * @param huring The ring of the writer.
+ * @param offsets The offset every block in flight is written at.
+ * @return 0 on success or error code
+ */
+static int
+_write_complete(hpipeline_t *hpipeline, huring_t *huring, const uint64_t *offsets)
+{
+    uint64_t user_data;
+    int32_t result;
+    pjob_t *job;
+
+    if (huring_reap(huring, &user_data, &result, 1) <= 0) {
+        return PIPELINE_ERROR_WRITE;
+    }
+
+    job = &hpipeline->slots[user_data];
+    if (result < 0) {
+        return PIPELINE_ERROR_WRITE;
+    } else if (result < job->size &&
+               hio_pwrite(hpipeline->out_fd, job->out + result, job->size - result,
+                             offsets[user_data] + result)) {
+        return PIPELINE_ERROR_WRITE;
+    }
+
+    hring_push(hpipeline->free, job);
+    return 0;
+}
+
+/**
+ * This function is used to encode a file in blocks through the
+ * pipeline. The reader and the encoder run on threads of their own
+ * while the calling thread writes. Every encoded block is handed to
+ * the place function in the order of the file, which says where it
+ * goes, and is written there before it is passed back to the reader.
+ * Through io_uring the writer keeps several writes in flight and
+ * only waits on them when there is no encoded block to take. A
+ * pipeline is only run once.
+ *
+ * @param hpipeline The pipeline.
+ * @param in_fd The file to read.
+ * @param out_fd The file to write.
+ * @param place The function placing every encoded block.
+ * @param context The context passed to the place function.
+ * @return 0 on success or error code
+ */
+int
+hpipeline_encode(hpipeline_t *hpipeline, int in_fd, int out_fd, hpipeline_place_t place, void *context)
+{
+    uint64_t offsets[PIPELINE_MAX_DEPTH];
+    pthread_t reader, encoder;
+    huring_t *huring;
+    uint64_t user_data;
+    int32_t result;
+    int64_t offset;
+    pjob_t *job;
+    uint32_t i, slot;
+    int ret;
+
+    if (!hpipeline || !place) {
+        return PIPELINE_ERROR_ARGUMENT;
+    }
+
+    hpipeline->in_fd = in_fd;
+    hpipeline->out_fd = out_fd;
+    for (i = 0; i < hpipeline->depth; i++) {
+        hring_push(hpipeline->free, &hpipeline->slots[i]);
+    }
+
+    huring = hpipeline->uring ? _uring_create(hpipeline, 1) : NULL;
+    if (huring) {
+        hpipeline->write_backend = huring->registered ? PIPELINE_IO_URING_REGISTERED : PIPELINE_IO_URING;
+    }
+
+    if (pthread_create(&reader, NULL, _reader, hpipeline)) {
+        huring_free(huring);
+        return PIPELINE_ERROR_THREAD;
+    } else if (pthread_create(&encoder, NULL, _encoder, hpipeline)) {
+        _abort(hpipeline);
+        pthread_join(reader, NULL);
+        huring_free(huring);
+        return PIPELINE_ERROR_THREAD;
+    }
+
+    ret = 0;
+    while (1) {
+        /* While writes are in flight, a block is only taken if one is waiting */
+        job = (huring && (huring->in_flight || huring->queued)) ? hring_try_pop(hpipeline->encoded) :
+                                                                   hring_pop(hpipeline->encoded);
+        if (!job && huring && (huring->in_flight || huring->queued)) {
+            ret = _write_complete(hpipeline, huring, offsets);
+            if (ret) {
+                _abort(hpipeline);
+                break;
+            }
+            continue;
+        } else if (!job) {
+            break;
+        }
+
+        offset = place(context, job);
+        if (offset < 0) {
+            ret = offset;
+            _abort(hpipeline);
+            break;
+        }
+
+        if (huring) {
+            slot = job - hpipeline->slots;
+            offsets[slot] = offset;
+            if (huring_write(huring, out_fd, job->out, job->size, offset,
+                             huring->registered ? (int)slot : URING_UNREGISTERED, slot) ||
+                huring_submit(huring) < 0) {
+                ret = PIPELINE_ERROR_WRITE;
+                _abort(hpipeline);
+                break;
+            }
+        } else {
+            if (hio_pwrite(out_fd, job->out, job->size, offset)) {
+                ret = PIPELINE_ERROR_WRITE;
+                _abort(hpipeline);
+                break;
+            }
+            hring_push(hpipeline->free, job);
+        }
+    }
+
+    /* Writes still in flight must land before their blocks are freed */
+    while (huring && (huring->in_flight || huring->queued) && !ret) {
+        ret = _write_complete(hpipeline, huring, offsets);
+    }
+    while (huring && (huring->in_flight || huring->queued) && huring_reap(huring, &user_data, &result, 1) > 0);
+    huring_free(huring);
+
+    pthread_join(reader, NULL);
+    pthread_join(encoder, NULL);
+
+    if (hpipeline->read_error) {
+        return hpipeline->read_error;
+    } else if (hpipeline->encode_error) {
+        return hpipeline->encode_error;
+    }
+    return ret;
+}
+
+/* These are the names of the backends the reader and the writer use */
+static const char *_backends[] = {"posix", "io_uring", "io_uring registered"};
+
+/**
+ * This function prints the counters of a single ring. This
+ * function is not presented as an interface function.
+ *
+ * @param out The stream to print to.
+ * @param name The name of the ring.
+ * @param hring The ring.
+ * @param producer The name of the stage pushing onto the ring.
+ * @param consumer The name of the stage popping off the ring.
+ */
+static void
+_report_ring(FILE *out, const char *name, hring_t *hring, const char *producer, const char *consumer)
+{
+    fprintf(out, "[PIPELINE] %-8s depth avg %.2f max %llu, %s stalls %llu (%.3f s), %s stalls %llu (%.3f s)\n",
+            name, hring->pushes ? (double)hring->depth_sum / hring->pushes : 0.0,
+            (unsigned long long)hring->depth_max,
+            producer, (unsigned long long)hring->push_stalls, hring->push_stall_time / 1e9,
+            consumer, (unsigned long long)hring->pop_stalls, hring->pop_stall_time / 1e9);
+}
+
+/**
+ * This function is used to print the depth and stall counters of
+ * the rings of a pipeline which has run. A stage which stalls long
+ * is waiting on its neighbour, which tells which stage holds the
+ * pipeline back and whether more depth or larger blocks would help.
+ *
+ * @param hpipeline The pipeline.
+ * @param out The stream to print to.
+ */
+void
+hpipeline_report(hpipeline_t *hpipeline, FILE *out)
+{
+    if (!hpipeline || !out) {
+        return;
+    }
+
+    fprintf(out, "[PIPELINE] depth %u, batch %d, block %u\n",
+            hpipeline->depth, hpipeline->batch_size, hpipeline->block_size);
+    fprintf(out, "[PIPELINE] reader io %s, writer io %s\n",
+            _backends[hpipeline->read_backend], _backends[hpipeline->write_backend]);
+    _report_ring(out, "filled", hpipeline->filled, "reader", "encoder");
+    _report_ring(out, "encoded", hpipeline->encoded, "encoder", "writer");
+    _report_ring(out, "free", hpipeline->free, "writer", "reader");
+}
@@ -0,0 +1,115 @@
+/*
+ * This file declares the interface for encoding blocks in a
+ * pipeline of three stages. A reader thread, an encoder thread and
+ * the calling thread as the writer pass preallocated blocks between
+ * each other over rings, so that reading, encoding and writing all
+ * happen at the same time.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "huffman_block.h"
+#include "huffman_parallel.h"
+#include "huffman_ring.h"
+#include "huffman_uring.h"
+
+#ifndef HUFFMAN_PIPELINE_H
+#define HUFFMAN_PIPELINE_H
+
+/* Depths */
+#define PIPELINE_MIN_DEPTH              (2U)
+#define PIPELINE_DEFAULT_DEPTH          (4U)
+#define PIPELINE_MAX_DEPTH              (64U)
+
+/* Pipeline Errors */
+#define PIPELINE_ERROR_ARGUMENT         (-1)
+#define PIPELINE_ERROR_THREAD           (-2)
+#define PIPELINE_ERROR_READ             (-3)
+#define PIPELINE_ERROR_ENCODE           (-4)
+#define PIPELINE_ERROR_WRITE            (-5)
+
+/* How the reader and the writer did their I/O */
+#define PIPELINE_IO_POSIX               (0U)
+#define PIPELINE_IO_URING               (1U)
+#define PIPELINE_IO_URING_REGISTERED    (2U)
+
+/*
+ * This is the function the writer calls for every encoded block,
+ * in the order of the file, with the context it was given. It
+ * returns the offset the block is written at or an error code.
+ */
+typedef int64_t (*hpipeline_place_t)(void*, pjob_t*);
+
+typedef struct huffman_pipeline {
+    /* These are the blocks which go around the pipeline */
+    pjob_t *slots;
+    uint32_t depth;
+
+    /* This is the largest number of blocks encoded at once */
+    int batch_size;
+
+    /* This is the number of elements read into every block */
+    uint32_t block_size;
+
+    /*
+     * These are the rings between the stages. Free blocks go from
+     * the writer to the reader, filled blocks from the reader to the
+     * encoder and encoded blocks from the encoder to the writer.
+     */
+    hring_t *free;
+    hring_t *filled;
+    hring_t *encoded;
+
+    /* The file the reader reads and the file the writer writes */
+    int in_fd;
+    int out_fd;
+
+    /*
+     * This is set to read and write through io_uring where the
+     * system has it. Once run, the backends tell what was used.
+     */
+    uint8_t uring;
+    uint8_t read_backend;
+    uint8_t write_backend;
+
+    /* This is the block the encoder encoded last */
+    hblock_t *previous;
+
+    /* These are the errors of the reader and the encoder */
+    int read_error;
+    int encode_error;
+} hpipeline_t;
+
+/**
+ * This function is used to build a new pipeline of a depth,
+ * encoding a number of blocks at once, along with every block
+ * it needs.
+ */
+hpipeline_t* hpipeline_create(uint32_t, int, uint32_t, uint8_t, uint8_t);
+
+/**
+ * This function is used to free a pipeline.
+ */
+void hpipeline_free(hpipeline_t*);
+
+/**
+ * This function is used to encode a file in blocks through the
+ * pipeline, writing every encoded block where the place function
+ * puts it.
+ */
+int hpipeline_encode(hpipeline_t*, int, int, hpipeline_place_t, void*);
+
+/**
+ * This function is used to print the depth and stall counters
+ * of the rings of a pipeline.
+ */
+void hpipeline_report(hpipeline_t*, FILE*);
+
+#endif
@@ -0,0 +1,339 @@
+/*
+ * This file defines the interface for running a set of tasks on
+ * a pool of threads which steal work from each other. Every worker
+ * has a deque of its own which is dealt a share of the tasks up
+ * front. A worker takes tasks off the bottom of its own deque, and
+ * once that is empty it steals from the top of the deques of the
+ * others, without any locks, so that a few long tasks on one worker
+ * do not leave the rest idle.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_pool.h"
+
+/* These are what taking a task gives back instead of a task */
+#define POOL_EMPTY                      (-1)
+#define POOL_RETRY                      (-2)
+
+/*
+ * This structure holds a task along with its weight while the
+ * tasks are sorted before they are dealt out.
+ */
+typedef struct pool_weight {
+    uint64_t weight;
+    uint32_t task;
+} pweight_t;
+
+/*
+ * This structure holds what a worker thread is started with.
+ */
+typedef struct pool_worker {
+    hpool_t *hpool;
+    uint32_t index;
+} pworker_t;
+
+/**
+ * This function orders tasks from the lightest to the heaviest.
+ * This function is not presented as an interface function.
+ *
+ * @param first The first task.
+ * @param second The second task.
+ * @return The order of the two tasks
+ */
+static int
+_compare(const void *first, const void *second)
+{
+    const pweight_t *a = first;
+    const pweight_t *b = second;
+
+    if (a->weight != b->weight) {
+        return (a->weight < b->weight) ? -1 : 1;
+    }
+    return (a->task < b->task) ? -1 : (a->task > b->task);
+}
+
+/**
+ * This function is used by the owner of a deque to take the task
+ * at its bottom. The bottom is moved up first, and only when the
+ * last task is left does the owner race the thieves for it on the
+ * top. This function is not presented as an interface function.
+ *
+ * @param deque The deque of the worker.
+ * @return The task or POOL_EMPTY
+ */
+static int64_t
+_pop(pdeque_t *deque)
+{
+    int64_t top, bottom, task;
+
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return POOL_EMPTY;
+    }
+
+    task = deque->tasks[bottom];
+    if (top == bottom) {
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            task = POOL_EMPTY;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/**
+ * This function is used by a thief to take the task at the top of
+ * the deque of another worker. Losing the race for it to another
+ * thief or the owner means it has to be tried again. This function
+ * is not presented as an interface function.
+ *
+ * @param deque The deque to steal from.
+ * @return The task, POOL_EMPTY or POOL_RETRY
+ */
+static int64_t
+_steal(pdeque_t *deque)
+{
+    int64_t top, bottom, task;
+
+    top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return POOL_EMPTY;
+    }
+
+    task = deque->tasks[top];
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return POOL_RETRY;
+    }
+    return task;
+}
+
+/**
+ * This function is run by every worker. It runs the tasks of its
+ * own deque and then steals from the others in turn, starting with
+ * the worker after it. No task is ever added once the pool runs, so
+ * a worker which finds every deque empty is done. This function is
+ * not presented as an interface function.
+ *
+ * @param argument The worker.
+ * @return NULL
+ */
+static void*
+_work(void *argument)
+{
+    pworker_t *worker = argument;
+    hpool_t *hpool = worker->hpool;
+    pdeque_t *own = &hpool->deques[worker->index];
+    uint32_t i, victim;
+    int64_t task;
+
+    while (1) {
+        task = _pop(own);
+        for (i = 1; task == POOL_EMPTY && i < hpool->worker_count; i++) {
+            victim = (worker->index + i) % hpool->worker_count;
+            do {
+                task = _steal(&hpool->deques[victim]);
+            } while (task == POOL_RETRY);
+
+            if (task >= 0) {
+                own->stolen += 1;
+            }
+        }
+
+        if (task == POOL_EMPTY) {
+            break;
+        }
+
+        own->ran += 1;
+        if (hpool->task(hpool->context, (uint32_t)task)) {
+            own->failed += 1;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * This function is used to build a new pool of a number of
+ * workers. The calling thread is one of them when the pool runs.
+ *
+ * @param worker_count The number of workers.
+ * @return A pool or NULL
+ */
+hpool_t*
+hpool_create(uint32_t worker_count)
+{
+    hpool_t *temp;
+
+    if (worker_count < 1 || worker_count > POOL_MAX_WORKERS) {
+        return NULL;
+    }
+
+    temp = calloc(1, sizeof(hpool_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    temp->deques = aligned_alloc(POOL_CACHE_LINE, worker_count * sizeof(pdeque_t));
+    if (!temp->deques) {
+        free(temp);
+        return NULL;
+    }
+    memset(temp->deques, 0, worker_count * sizeof(pdeque_t));
+
+    temp->worker_count = worker_count;
+    return temp;
+}
+
+/**
+ * This function is used to free a pool.
+ *
+ * @param hpool The pool to free
+ */
+void
+hpool_free(hpool_t *hpool)
+{
+    uint32_t i;
+
+    if (!hpool) {
+        return;
+    }
+
+    for (i = 0; i < hpool->worker_count; i++) {
+        free(hpool->deques[i].tasks);
+    }
+    free(hpool->deques);
+    free(hpool);
+}
+
+/**
+ * This function is used to run a number of tasks on a pool and
+ * wait for all of them. The tasks are sorted by weight and dealt
+ * out in turn, so every worker gets a similar share of the weight,
+ * and every worker runs its heaviest tasks first while thieves take
+ * the lightest ones. A worker whose thread cannot be made leaves its
+ * deque to be stolen by the others.
+ *
+ * @param hpool The pool.
+ * @param task_count The number of tasks.
+ * @param weights The weight of every task or NULL for all the same.
+ * @param task The function every task is run with.
+ * @param context What the function is given along with the task.
+ * @return 0 on success or error code
+ */
+int
+hpool_run(hpool_t *hpool, uint32_t task_count, const uint64_t *weights, hpool_task_t task, void *context)
+{
+    pthread_t threads[POOL_MAX_WORKERS];
+    pworker_t workers[POOL_MAX_WORKERS];
+    uint8_t started[POOL_MAX_WORKERS];
+    pweight_t *order;
+    pdeque_t *deque;
+    uint32_t i, share;
+
+    if (!hpool || !task) {
+        return POOL_ERROR_ARGUMENT;
+    }
+
+    order = malloc((task_count ? task_count : 1) * sizeof(pweight_t));
+    if (!order) {
+        return POOL_ERROR_MEMORY;
+    }
+
+    for (i = 0; i < task_count; i++) {
+        order[i].weight = weights ? weights[i] : 0;
+        order[i].task = i;
+    }
+    qsort(order, task_count, sizeof(pweight_t), _compare);
+
+    /* Every deque goes from its lightest task at the top to its heaviest at the bottom */
+    share = (task_count + hpool->worker_count - 1) / hpool->worker_count;
+    for (i = 0; i < hpool->worker_count; i++) {
+        deque = &hpool->deques[i];
+        free(deque->tasks);
+        deque->tasks = malloc((share ? share : 1) * sizeof(uint32_t));
+        if (!deque->tasks) {
+            free(order);
+            return POOL_ERROR_MEMORY;
+        }
+
+        atomic_init(&deque->top, 0);
+        atomic_init(&deque->bottom, 0);
+        deque->ran = 0;
+        deque->stolen = 0;
+        deque->failed = 0;
+    }
+
+    for (i = 0; i < task_count; i++) {
+        deque = &hpool->deques[i % hpool->worker_count];
+        deque->tasks[i / hpool->worker_count] = order[i].task;
+        atomic_store_explicit(&deque->bottom, i / hpool->worker_count + 1, memory_order_relaxed);
+    }
+    free(order);
+
+    hpool->task = task;
+    hpool->context = context;
+    hpool->task_count = task_count;
+
+    /* The deques are filled in before any thread can see them */
+    for (i = 1; i < hpool->worker_count; i++) {
+        workers[i].hpool = hpool;
+        workers[i].index = i;
+        started[i] = !pthread_create(&threads[i], NULL, _work, &workers[i]);
+    }
+
+    workers[0].hpool = hpool;
+    workers[0].index = 0;
+    _work(&workers[0]);
+
+    hpool->failed = 0;
+    for (i = 0; i < hpool->worker_count; i++) {
+        if (i && started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        hpool->failed += hpool->deques[i].failed;
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to print how the tasks of the last run
+ * were spread over the workers, and how many of them every worker
+ * stole from the others.
+ *
+ * @param hpool The pool.
+ * @param out The file to print to.
+ */
+void
+hpool_report(hpool_t *hpool, FILE *out)
+{
+    uint32_t i;
+    uint64_t stolen;
+
+    if (!hpool || !out) {
+        return;
+    }
+
+    stolen = 0;
+    for (i = 0; i < hpool->worker_count; i++) {
+        stolen += hpool->deques[i].stolen;
+    }
+
+    fprintf(out, "[POOL] %u workers, %u tasks, %llu stolen, %llu failed\n", hpool->worker_count,
+            hpool->task_count, (unsigned long long)stolen, (unsigned long long)hpool->failed);
+    for (i = 0; i < hpool->worker_count; i++) {
+        fprintf(out, "[POOL] worker %u ran %llu, stole %llu\n", i,
+                (unsigned long long)hpool->deques[i].ran, (unsigned long long)hpool->deques[i].stolen);
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * This file declares the interface for running a set of tasks on
+ * a pool of threads which steal work from each other. Every worker
+ * has a deque of its own which is dealt a share of the tasks up
+ * front. A worker takes tasks off the bottom of its own deque, and
+ * once that is empty it steals from the top of the deques of the
+ * others, without any locks, so that a few long tasks on one worker
+ * do not leave the rest idle.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifndef HUFFMAN_POOL_H
+#define HUFFMAN_POOL_H
+
+/* Limits */
+#define POOL_MAX_WORKERS                (256U)
+
+/* The top and the bottom are kept apart so they do not share a cache line */
+#define POOL_CACHE_LINE                 (64U)
+
+/* Pool Errors */
+#define POOL_ERROR_ARGUMENT             (-1)
+#define POOL_ERROR_MEMORY               (-2)
+
+/*
+ * This is a task run by the pool. It is given the context of the
+ * pool and the index of the task, and returns 0 on success.
+ */
+typedef int (*hpool_task_t)(void*, uint32_t);
+
+typedef struct pool_deque {
+    /*
+     * These are the ends of the deque. Thieves take tasks from the
+     * top and the owner from the bottom, and the deque is empty once
+     * they meet.
+     */
+    _Alignas(POOL_CACHE_LINE) _Atomic int64_t top;
+    _Alignas(POOL_CACHE_LINE) _Atomic int64_t bottom;
+
+    /* These are the tasks dealt to the worker, never changed once running */
+    _Alignas(POOL_CACHE_LINE) uint32_t *tasks;
+
+    /* These are the counters of the worker which owns the deque */
+    uint64_t ran;
+    uint64_t stolen;
+    uint64_t failed;
+} pdeque_t;
+
+typedef struct huffman_pool {
+    /* These are the deques, one for every worker */
+    pdeque_t *deques;
+    uint32_t worker_count;
+
+    /* This is what every task is run with */
+    hpool_task_t task;
+    void *context;
+
+    /* These are the totals of the last run */
+    uint32_t task_count;
+    uint64_t failed;
+} hpool_t;
+
+/**
+ * This function is used to build a new pool of a number of
+ * workers.
+ */
+hpool_t* hpool_create(uint32_t);
+
+/**
+ * This function is used to free a pool.
+ */
+void hpool_free(hpool_t*);
+
+/**
+ * This function is used to run a number of tasks on a pool,
+ * the heaviest first, and wait for all of them.
+ */
+int hpool_run(hpool_t*, uint32_t, const uint64_t*, hpool_task_t, void*);
+
+/**
+ * This function is used to print how the tasks of the last run
+ * were spread over the workers.
+ */
+void hpool_report(hpool_t*, FILE*);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * This file defines the interface for using a ring buffer which
+ * passes items from exactly one producer thread to exactly one
+ * consumer thread without any locks. A side which has to wait on
+ * the other spins briefly and then sleeps until it is woken. The
+ * ring counts how deep it gets, and how often and for how long
+ * either side has to wait on the other.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_ring.h"
+
+/**
+ * This function tells whether a side of a ring can go on, which
+ * is once there is room to push or an item to pop, or once the
+ * ring is closed. This function is not presented as an interface
+ * function.
+ *
+ * @param hring The ring.
+ * @param producer Whether the side is the producer.
+ * @return 1 if the side can go on or 0
+ */
+static int
+_ready(hring_t *hring, uint8_t producer)
+{
+    uint64_t head, tail;
+
+    if (atomic_load_explicit(&hring->closed, memory_order_acquire)) {
+        return 1;
+    }
+
+    head = atomic_load_explicit(&hring->head, memory_order_acquire);
+    tail = atomic_load_explicit(&hring->tail, memory_order_acquire);
+    return producer ? (tail - head < hring->capacity) : (head != tail);
+}
+
+/**
+ * This function is used by a side of a ring to wait until it can
+ * go on. It yields a few times first, since the other side is
+ * usually about to move, and then sleeps until the other side wakes
+ * it. The fence after counting itself as asleep pairs with the one
+ * in _wake, so either the sleeper sees the move or the other side
+ * sees the sleeper. This function is not presented as an interface
+ * function.
+ *
+ * @param hring The ring.
+ * @param producer Whether the side is the producer.
+ * @return How long the side waited in nanoseconds
+ */
+static uint64_t
+_wait(hring_t *hring, uint8_t producer)
+{
+    struct timespec start, stop;
+    uint32_t spins;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (spins = 0; spins < RING_SPIN_COUNT && !_ready(hring, producer); spins++) {
+        sched_yield();
+    }
+
+    if (spins == RING_SPIN_COUNT) {
+        pthread_mutex_lock(&hring->lock);
+        atomic_fetch_add_explicit(&hring->sleepers, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!_ready(hring, producer)) {
+            pthread_cond_wait(&hring->changed, &hring->lock);
+        }
+        atomic_fetch_sub_explicit(&hring->sleepers, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&hring->lock);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    return (stop.tv_sec - start.tv_sec) * 1000000000ULL + stop.tv_nsec - start.tv_nsec;
+}
+
+/**
+ * This function is used by a side of a ring which has moved to
+ * wake the other side if it is asleep. This function is not
+ * presented as an interface function.
+ *
+ * @param hring The ring.
+ */
+static void
+_wake(hring_t *hring)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&hring->sleepers, memory_order_relaxed)) {
+        pthread_mutex_lock(&hring->lock);
+        pthread_cond_broadcast(&hring->changed);
+        pthread_mutex_unlock(&hring->lock);
+    }
+}
+
+/**
+ * This function is used to build a new empty ring which holds
+ * at least a number of items. The number is rounded up to a power
+ * of two so that a count of items maps onto a slot with a mask.
+ *
+ * @param capacity The number of items the ring must hold.
+ * @return A ring or NULL
+ */
+hring_t*
+hring_create(uint32_t capacity)
+{
+    hring_t *temp;
+    uint32_t size;
+
+    if (capacity < 1 || capacity > RING_MAX_CAPACITY) {
+        return NULL;
+    }
+
+    for (size = 1; size < capacity; size <<= 1);
+
+    temp = aligned_alloc(RING_CACHE_LINE, sizeof(hring_t));
+    if (!temp) {
+        return NULL;
+    }
+    memset(temp, 0, sizeof(hring_t));
+
+    temp->slots = calloc(size, sizeof(void*));
+    if (!temp->slots) {
+        free(temp);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&temp->lock, NULL)) {
+        free(temp->slots);
+        free(temp);
+        return NULL;
+    } else if (pthread_cond_init(&temp->changed, NULL)) {
+        pthread_mutex_destroy(&temp->lock);
+        free(temp->slots);
+        free(temp);
+        return NULL;
+    }
+
+    temp->capacity = size;
+    atomic_init(&temp->tail, 0);
+    atomic_init(&temp->head, 0);
+    atomic_init(&temp->closed, 0);
+    atomic_init(&temp->sleepers, 0);
+    return temp;
+}
+
+/**
+ * This function is used to free a ring. The items left in it
+ * are not freed.
+ *
+ * @param hring The ring to free
+ */
+void
+hring_free(hring_t *hring)
+{
+    if (!hring) {
+        return;
+    }
+
+    pthread_cond_destroy(&hring->changed);
+    pthread_mutex_destroy(&hring->lock);
+    free(hring->slots);
+    free(hring);
+}
+
+/**
+ * This function is used by the producer to push an item onto a
+ * ring. While the ring is full the producer waits until the
+ * consumer makes room, which is counted as a stall along with how
+ * long it took. The release of the tail makes the item, and
+ * everything written before it was pushed, visible to the consumer.
+ *
+ * @param hring The ring to push onto.
+ * @param item The item to push.
+ * @return 0 on success or error code
+ */
+int
+hring_push(hring_t *hring, void *item)
+{
+    uint64_t tail, head;
+
+    if (!hring) {
+        return RING_ERROR_ARGUMENT;
+    }
+
+    tail = atomic_load_explicit(&hring->tail, memory_order_relaxed);
+    while (1) {
+        if (atomic_load_explicit(&hring->closed, memory_order_acquire)) {
+            return RING_ERROR_CLOSED;
+        }
+
+        head = atomic_load_explicit(&hring->head, memory_order_acquire);
+        if (tail - head < hring->capacity) {
+            break;
+        }
+
+        hring->push_stalls += 1;
+        hring->push_stall_time += _wait(hring, 1);
+    }
+
+    hring->slots[tail & (hring->capacity - 1)] = item;
+    atomic_store_explicit(&hring->tail, tail + 1, memory_order_release);
+    _wake(hring);
+
+    hring->pushes += 1;
+    hring->depth_sum += tail + 1 - head;
+    if (tail + 1 - head > hring->depth_max) {
+        hring->depth_max = tail + 1 - head;
+    }
+    return 0;
+}
+
+/**
+ * This function takes the next item off a ring if there is one.
+ * This function is not presented as an interface function.
+ *
+ * @param hring The ring to pop from.
+ * @param item Where to put the item.
+ * @return 1 if an item was popped or 0
+ */
+static int
+_pop(hring_t *hring, void **item)
+{
+    uint64_t head, tail;
+
+    head = atomic_load_explicit(&hring->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&hring->tail, memory_order_acquire);
+    if (head == tail) {
+        return 0;
+    }
+
+    *item = hring->slots[head & (hring->capacity - 1)];
+    atomic_store_explicit(&hring->head, head + 1, memory_order_release);
+    _wake(hring);
+    hring->pops += 1;
+    return 1;
+}
+
+/**
+ * This function is used by the consumer to pop an item off a
+ * ring. While the ring is empty the consumer waits until the
+ * producer pushes something, which is counted as a stall along with
+ * how long it took. Once the ring is closed, whatever is left in it
+ * is still popped.
+ *
+ * @param hring The ring to pop from.
+ * @return The item or NULL once the ring is closed and empty
+ */
+void*
+hring_pop(hring_t *hring)
+{
+    void *item;
+
+    if (!hring) {
+        return NULL;
+    }
+
+    while (!_pop(hring, &item)) {
+        /* Anything pushed before closing is seen once closed is */
+        if (atomic_load_explicit(&hring->closed, memory_order_acquire)) {
+            return _pop(hring, &item) ? item : NULL;
+        }
+
+        hring->pop_stalls += 1;
+        hring->pop_stall_time += _wait(hring, 0);
+    }
+
+    return item;
+}
+
+/**
+ * This function is used by the consumer to pop an item off a
+ * ring only if one is there already. It never waits.
+ *
+ * @param hring The ring to pop from.
+ * @return The item or NULL if the ring is empty
+ */
+void*
+hring_try_pop(hring_t *hring)
+{
+    void *item;
+
+    if (!hring || !_pop(hring, &item)) {
+        return NULL;
+    }
+
+    return item;
+}
+
+/**
+ * This function is used to close a ring. Nothing more can be
+ * pushed onto it, and a consumer waiting on it gets what is left
+ * and then NULL, and a side asleep on it is woken. Either side may
+ * close a ring, which is how a side which fails stops the other.
+ *
+ * @param hring The ring to close
+ */
+void
+hring_close(hring_t *hring)
+{
+    if (!hring) {
+        return;
+    }
+
+    atomic_store_explicit(&hring->closed, 1, memory_order_release);
+    _wake(hring);
+}
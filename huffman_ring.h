@@ -0,0 +1,114 @@
+/*
+ * This file declares the interface for using a ring buffer which
+ * passes items from exactly one producer thread to exactly one
+ * consumer thread without any locks. A side which has to wait on
+ * the other spins briefly and then sleeps until it is woken. The
+ * ring counts how deep it gets, and how often and for how long
+ * either side has to wait on the other.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifndef HUFFMAN_RING_H
+#define HUFFMAN_RING_H
+
+/* Limits */
+#define RING_MAX_CAPACITY               (1U << 16)
+
+/* The head and the tail are kept apart so they do not share a cache line */
+#define RING_CACHE_LINE                 (64U)
+
+/* The number of times a side yields before it sleeps until it is woken */
+#define RING_SPIN_COUNT                 (64U)
+
+/* Ring Errors */
+#define RING_ERROR_ARGUMENT             (-1)
+#define RING_ERROR_CLOSED               (-2)
+
+typedef struct huffman_ring {
+    /*
+     * This is the number of items the ring has pushed and popped.
+     * The tail is only ever moved by the producer and the head only
+     * ever by the consumer.
+     */
+    _Alignas(RING_CACHE_LINE) _Atomic uint64_t tail;
+    _Alignas(RING_CACHE_LINE) _Atomic uint64_t head;
+
+    /* This is set once nothing more is going to be pushed */
+    _Alignas(RING_CACHE_LINE) _Atomic int closed;
+
+    /*
+     * This is the number of sides asleep on the ring. A side only
+     * takes the lock to wake the other while it is asleep.
+     */
+    _Atomic int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    /* These are the slots, a power of two of them */
+    void **slots;
+    uint32_t capacity;
+
+    /*
+     * These are the counters of the producer. A stall is a push
+     * which found the ring full and had to wait, and the stall time
+     * is how long all of them waited in nanoseconds. The depth is
+     * the number of items in the ring right after a push.
+     */
+    uint64_t pushes;
+    uint64_t push_stalls;
+    uint64_t push_stall_time;
+    uint64_t depth_sum;
+    uint64_t depth_max;
+
+    /* A stall of the consumer is a pop which found the ring empty */
+    uint64_t pops;
+    uint64_t pop_stalls;
+    uint64_t pop_stall_time;
+} hring_t;
+
+/**
+ * This function is used to build a new empty ring which
+ * holds at least a number of items.
+ */
+hring_t* hring_create(uint32_t);
+
+/**
+ * This function is used to free a ring.
+ */
+void hring_free(hring_t*);
+
+/**
+ * This function is used by the producer to push an item onto
+ * a ring, waiting while the ring is full.
+ */
+int hring_push(hring_t*, void*);
+
+/**
+ * This function is used by the consumer to pop an item off a
+ * ring, waiting while the ring is empty.
+ */
+void* hring_pop(hring_t*);
+
+/**
+ * This function is used by the consumer to pop an item off a
+ * ring only if one is there already.
+ */
+void* hring_try_pop(hring_t*);
+
+/**
+ * This function is used to close a ring so that nothing more
+ * is pushed onto it and nobody waits on it any more.
+ */
+void hring_close(hring_t*);
+
+#endif
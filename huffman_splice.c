@@ -0,0 +1,252 @@
+/*
+ * This file defines the interface for copying raw bytes from one
+ * file to another inside the kernel, without passing them through
+ * a buffer of the program. The bytes are copied with
+ * copy_file_range, sendfile or splice, whichever the two files
+ * allow, and whatever none of them can copy is left for the caller
+ * to copy itself.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#define _GNU_SOURCE
+#include <sys/sendfile.h>
+#include "huffman_splice.h"
+
+/**
+ * This function tells whether an error only means that two files
+ * do not allow a method, so that the next one is tried instead.
+ * This function is not presented as an interface function.
+ *
+ * @param error The error of the method.
+ * @return 1 if the method was turned down or 0
+ */
+static int
+_refused(int error)
+{
+    return error == EINVAL || error == EXDEV || error == ENOSYS ||
+           error == EOPNOTSUPP || error == EBADF || error == ESPIPE;
+}
+
+/**
+ * This function splices bytes from a file into the pipe of a
+ * copier and from the pipe into another file, for when neither
+ * file is a pipe. Bytes left in the pipe by an output which stopped
+ * taking them are thrown away along with the pipe. This function is
+ * not presented as an interface function.
+ *
+ * @param hsplice The copier.
+ * @param in_fd The file to copy from.
+ * @param in_offset The offset to copy from.
+ * @param out_fd The file to copy into.
+ * @param out_offset The offset to copy into or NULL for the current position.
+ * @param count The most bytes to copy.
+ * @return The number of bytes copied or -1
+ */
+static ssize_t
+_pipe(hsplice_t *hsplice, int in_fd, loff_t *in_offset, int out_fd, loff_t *out_offset, size_t count)
+{
+    ssize_t filled, drained, total;
+
+    if (hsplice->pipe_fds[0] < 0) {
+        if (pipe(hsplice->pipe_fds)) {
+            hsplice->pipe_fds[0] = -1;
+            hsplice->pipe_fds[1] = -1;
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+#ifdef F_SETPIPE_SZ
+        /* A larger pipe moves more in every call, and a smaller one still works */
+        fcntl(hsplice->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+#endif
+    }
+
+    filled = splice(in_fd, in_offset, hsplice->pipe_fds[1], NULL, count, SPLICE_F_MOVE);
+    if (filled <= 0) {
+        return filled;
+    }
+
+    total = 0;
+    while (total < filled) {
+        drained = splice(hsplice->pipe_fds[0], NULL, out_fd, out_offset, filled - total, SPLICE_F_MOVE);
+        if (drained < 0 && errno == EINTR) {
+            continue;
+        } else if (drained <= 0) {
+            close(hsplice->pipe_fds[0]);
+            close(hsplice->pipe_fds[1]);
+            hsplice->pipe_fds[0] = -1;
+            hsplice->pipe_fds[1] = -1;
+            return total ? total : -1;
+        }
+        total += drained;
+    }
+
+    return total;
+}
+
+/**
+ * This function copies bytes with a single call of a method.
+ * This function is not presented as an interface function.
+ *
+ * @param hsplice The copier.
+ * @param method The method to copy with.
+ * @param in_fd The file to copy from.
+ * @param in_offset The offset to copy from.
+ * @param out_fd The file to copy into.
+ * @param out_offset The offset to copy into or SPLICE_CURRENT.
+ * @param count The most bytes to copy.
+ * @return The number of bytes copied or -1
+ */
+static ssize_t
+_step(hsplice_t *hsplice, uint8_t method, int in_fd, uint64_t in_offset, int out_fd, int64_t out_offset,
+      uint64_t count)
+{
+    loff_t in_position = in_offset;
+    loff_t out_position = out_offset;
+    off_t file_position = in_offset;
+
+    switch (method) {
+        case SPLICE_METHOD_COPY_RANGE:
+            return copy_file_range(in_fd, &in_position, out_fd,
+                                   (out_offset < 0) ? NULL : &out_position, count, 0);
+        case SPLICE_METHOD_SENDFILE:
+            return sendfile(out_fd, in_fd, &file_position, count);
+        case SPLICE_METHOD_SPLICE:
+            /* Splice needs a pipe on one side, here the output */
+            return splice(in_fd, &in_position, out_fd, (out_offset < 0) ? NULL : &out_position,
+                          count, SPLICE_F_MOVE);
+        default:
+            return _pipe(hsplice, in_fd, &in_position, out_fd, (out_offset < 0) ? NULL : &out_position, count);
+    }
+}
+
+/**
+ * This function is used to build a new copier, which has not
+ * tried any method yet.
+ *
+ * @return A copier or NULL
+ */
+hsplice_t*
+hsplice_create(void)
+{
+    hsplice_t *temp;
+
+    temp = calloc(1, sizeof(hsplice_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    temp->pipe_fds[0] = -1;
+    temp->pipe_fds[1] = -1;
+    temp->method = SPLICE_METHOD_NONE;
+    return temp;
+}
+
+/**
+ * This function is used to free a copier along with its pipe.
+ *
+ * @param hsplice The copier to free
+ */
+void
+hsplice_free(hsplice_t *hsplice)
+{
+    if (!hsplice) {
+        return;
+    }
+
+    if (hsplice->pipe_fds[0] >= 0) {
+        close(hsplice->pipe_fds[0]);
+        close(hsplice->pipe_fds[1]);
+    }
+    free(hsplice);
+}
+
+/**
+ * This function is used to copy bytes of one file at an offset
+ * into another file inside the kernel. The methods are tried in
+ * order, and a method the two files turn down is never tried again
+ * by the same copier. Sendfile only writes at the current position
+ * of the output, and an output which cannot seek is always written
+ * at its current position. The input must be a file which can be
+ * read at an offset. Fewer bytes are copied than asked for when the
+ * input ends, or when no method is left, and the caller copies the
+ * rest itself.
+ *
+ * @param hsplice The copier.
+ * @param in_fd The file to copy from.
+ * @param in_offset The offset to copy from.
+ * @param out_fd The file to copy into.
+ * @param out_offset The offset to copy into or SPLICE_CURRENT.
+ * @param length The number of bytes to copy.
+ * @return The number of bytes copied or error code
+ */
+int64_t
+hsplice_copy(hsplice_t *hsplice, int in_fd, uint64_t in_offset, int out_fd, int64_t out_offset, uint64_t length)
+{
+    uint64_t total;
+    ssize_t moved;
+    uint8_t method;
+
+    if (!hsplice) {
+        return SPLICE_ERROR_ARGUMENT;
+    }
+
+    total = 0;
+    method = SPLICE_METHOD_COPY_RANGE;
+    while (total < length && method < SPLICE_METHOD_COUNT) {
+        if ((hsplice->refused & (1U << method)) || (method == SPLICE_METHOD_SENDFILE && out_offset >= 0)) {
+            method += 1;
+            continue;
+        }
+
+        moved = _step(hsplice, method, in_fd, in_offset + total, out_fd,
+                      (out_offset < 0) ? SPLICE_CURRENT : out_offset + (int64_t)total, length - total);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        } else if (moved < 0 && errno == ESPIPE && out_offset >= 0) {
+            /* An output which cannot seek is written at its position */
+            out_offset = SPLICE_CURRENT;
+            method = SPLICE_METHOD_COPY_RANGE;
+            continue;
+        } else if (moved < 0 && _refused(errno)) {
+            hsplice->refused |= 1U << method;
+            method += 1;
+            continue;
+        } else if (moved < 0) {
+            return SPLICE_ERROR_COPY;
+        } else if (!moved) {
+            /* The input ends */
+            break;
+        }
+
+        hsplice->method = method;
+        hsplice->bytes += moved;
+        total += moved;
+    }
+
+    return total;
+}
+
+/**
+ * This function is used to get the name of a method, for
+ * reporting which one copied the bytes.
+ *
+ * @param method The method.
+ * @return The name of the method
+ */
+const char*
+hsplice_name(uint8_t method)
+{
+    switch (method) {
+        case SPLICE_METHOD_COPY_RANGE:
+            return "copy_file_range";
+        case SPLICE_METHOD_SENDFILE:
+            return "sendfile";
+        case SPLICE_METHOD_SPLICE:
+            return "splice";
+        case SPLICE_METHOD_PIPE:
+            return "splice through a pipe";
+        default:
+            return "none";
+    }
+}
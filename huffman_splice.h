@@ -0,0 +1,80 @@
+/*
+ * This file declares the interface for copying raw bytes from one
+ * file to another inside the kernel, without passing them through
+ * a buffer of the program. The bytes are copied with
+ * copy_file_range, sendfile or splice, whichever the two files
+ * allow, and whatever none of them can copy is left for the caller
+ * to copy itself.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifndef HUFFMAN_SPLICE_H
+#define HUFFMAN_SPLICE_H
+
+/* Methods, tried in this order */
+#define SPLICE_METHOD_COPY_RANGE        (0U)
+#define SPLICE_METHOD_SENDFILE          (1U)
+#define SPLICE_METHOD_SPLICE            (2U)
+#define SPLICE_METHOD_PIPE              (3U)
+#define SPLICE_METHOD_COUNT             (4U)
+#define SPLICE_METHOD_NONE              (SPLICE_METHOD_COUNT)
+
+/* An output offset which means the current position of the file */
+#define SPLICE_CURRENT                  (-1)
+
+/* The size asked for the pipe of a copier */
+#define SPLICE_PIPE_SIZE                (1U << 20)
+
+/* Splice Errors */
+#define SPLICE_ERROR_ARGUMENT           (-1)
+#define SPLICE_ERROR_COPY               (-2)
+
+typedef struct huffman_splice {
+    /*
+     * This is the pipe splice goes through between two files,
+     * neither of which is a pipe. It is only made once needed.
+     */
+    int pipe_fds[2];
+
+    /* This holds a bit for every method the files turned down */
+    uint8_t refused;
+
+    /* This is the method which last copied any bytes */
+    uint8_t method;
+
+    /* This is the number of bytes copied inside the kernel */
+    uint64_t bytes;
+} hsplice_t;
+
+/**
+ * This function is used to build a new copier.
+ */
+hsplice_t* hsplice_create(void);
+
+/**
+ * This function is used to free a copier along with its pipe.
+ */
+void hsplice_free(hsplice_t*);
+
+/**
+ * This function is used to copy bytes of one file at an offset
+ * into another file inside the kernel, returning how many bytes
+ * were copied.
+ */
+int64_t hsplice_copy(hsplice_t*, int, uint64_t, int, int64_t, uint64_t);
+
+/**
+ * This function is used to get the name of a method.
+ */
+const char* hsplice_name(uint8_t);
+
+#endif
@@ -0,0 +1,658 @@
+/*
+ * This file defines the interface for using interleaved huffman
+ * streams. The input is cut into equally sized segments and every
+ * segment is encoded into its own bit stream so that the decoder
+ * can keep several streams in flight at once.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <time.h>
+#include "huffman_stream.h"
+#include "huffman_endian.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define STREAM_HAVE_AVX2
+#endif
+
+/*
+ * This macro decodes a single element from the bits which have been
+ * loaded for a stream. The decode table gives both the element and
+ * how many bits its opcode used up.
+ */
+#define STREAM_DECODE_ELEMENT(table, bits, position, out)              \
+    do {                                                               \
+        uint16_t _entry = (table)[(bits) & CODE_TABLE_MASK];           \
+        *(out)++ = CODE_ENTRY_ELEMENT(_entry);                         \
+        (bits) >>= CODE_ENTRY_LENGTH(_entry);                          \
+        (position) += CODE_ENTRY_LENGTH(_entry);                       \
+    } while(0)
+
+/*
+ * A single load leaves at least 56 bits to work with, which is
+ * enough to decode this many elements before loading again.
+ */
+#define STREAM_ELEMENTS_PER_LOAD        (56 / CODE_MAX_LENGTH)
+
+/*
+ * This structure holds the state of a single stream while it is
+ * being decoded. Positions are counted in bits from the beginning
+ * of the stream.
+ */
+typedef struct stream_lane {
+    const uint8_t *stream;
+    uint64_t position;
+    uint64_t end;
+    uint8_t *out;
+    uint64_t remaining;
+} slane_t;
+
+/* The decoder used for wide sets of streams */
+static int stream_decoder = -1;
+
+/* The size of the sample used to time the decoders against each other */
+#define STREAM_CALIBRATE_SIZE           (1U << 16)
+
+/**
+ * This function encodes a segment of the input into a single
+ * stream. Whole bytes are flushed after every opcode, which means
+ * up to STREAM_PADDING bytes past the end of the stream are written
+ * to. This function is not presented as an interface function.
+ *
+ * @param hcode The code to encode with.
+ * @param in The segment to encode.
+ * @param length The length of the segment.
+ * @param out The buffer to encode into.
+ * @return The size of the stream in bytes
+ */
+static uint64_t
+_encode_segment(hcode_t *hcode, const uint8_t *in, uint64_t length, uint8_t *out)
+{
+    uint64_t i, size;
+    uint64_t bits;
+    uint32_t bit_count;
+
+    size = 0;
+    bits = 0;
+    bit_count = 0;
+    for (i = 0; i < length; i++) {
+        bits |= (uint64_t)hcode->codes[in[i]] << bit_count;
+        bit_count += hcode->lengths[in[i]];
+
+        hendian_store64(out + size, bits);
+        size += bit_count >> 3;
+        bits >>= bit_count & ~0x7U;
+        bit_count &= 0x7;
+    }
+
+    /* The last partial byte has already been stored */
+    return size + !!bit_count;
+}
+
+/**
+ * This function decodes whatever is left of a single stream one
+ * element at a time. This function is not presented as an interface
+ * function.
+ *
+ * @param table The decode table.
+ * @param lane The stream to decode.
+ */
+static void
+_decode_lane(const uint16_t *table, slane_t *lane)
+{
+    uint64_t bits;
+
+    while (lane->remaining && lane->position <= lane->end) {
+        bits = hendian_load64(lane->stream + (lane->position >> 3)) >> (lane->position & 0x7);
+        STREAM_DECODE_ELEMENT(table, bits, lane->position, lane->out);
+        lane->remaining -= 1;
+    }
+}
+
+/**
+ * This function decodes four streams at the same time. Every
+ * iteration reloads the bits of all four streams without branching
+ * and then decodes several elements from each of them, so that the
+ * table lookups of different streams overlap with each other. This
+ * function is not presented as an interface function.
+ *
+ * @param table The decode table.
+ * @param lanes The four streams to decode.
+ */
+static void
+_decode_four(const uint16_t *table, slane_t *lanes)
+{
+    int i;
+    uint64_t rounds;
+    uint64_t b0, b1, b2, b3;
+    uint64_t p0 = lanes[0].position, p1 = lanes[1].position;
+    uint64_t p2 = lanes[2].position, p3 = lanes[3].position;
+    uint8_t *o0 = lanes[0].out, *o1 = lanes[1].out;
+    uint8_t *o2 = lanes[2].out, *o3 = lanes[3].out;
+
+    rounds = lanes[0].remaining;
+    for (i = 1; i < 4; i++) {
+        if (lanes[i].remaining < rounds) {
+            rounds = lanes[i].remaining;
+        }
+    }
+    rounds /= STREAM_ELEMENTS_PER_LOAD;
+
+    while (rounds--) {
+        /* A corrupt stream must never be read past its end */
+        if ((p0 > lanes[0].end) | (p1 > lanes[1].end) | (p2 > lanes[2].end) | (p3 > lanes[3].end)) {
+            break;
+        }
+
+        b0 = hendian_load64(lanes[0].stream + (p0 >> 3)) >> (p0 & 0x7);
+        b1 = hendian_load64(lanes[1].stream + (p1 >> 3)) >> (p1 & 0x7);
+        b2 = hendian_load64(lanes[2].stream + (p2 >> 3)) >> (p2 & 0x7);
+        b3 = hendian_load64(lanes[3].stream + (p3 >> 3)) >> (p3 & 0x7);
+
+        for (i = 0; i < (int)STREAM_ELEMENTS_PER_LOAD; i++) {
+            STREAM_DECODE_ELEMENT(table, b0, p0, o0);
+            STREAM_DECODE_ELEMENT(table, b1, p1, o1);
+            STREAM_DECODE_ELEMENT(table, b2, p2, o2);
+            STREAM_DECODE_ELEMENT(table, b3, p3, o3);
+        }
+    }
+
+    lanes[0].remaining -= o0 - lanes[0].out;
+    lanes[1].remaining -= o1 - lanes[1].out;
+    lanes[2].remaining -= o2 - lanes[2].out;
+    lanes[3].remaining -= o3 - lanes[3].out;
+    lanes[0].position = p0, lanes[0].out = o0;
+    lanes[1].position = p1, lanes[1].out = o1;
+    lanes[2].position = p2, lanes[2].out = o2;
+    lanes[3].position = p3, lanes[3].out = o3;
+
+    for (i = 0; i < 4; i++) {
+        _decode_lane(table, &lanes[i]);
+    }
+}
+
+#ifdef STREAM_HAVE_AVX2
+/**
+ * This function decodes eight streams at the same time, one stream
+ * per 32 bit lane of an AVX2 register. Every lane gathers the next
+ * bits of its stream, a second gather resolves them through the
+ * decode table and the lane then advances by its own opcode length.
+ * Four elements of every lane are packed together and stored with a
+ * single write. Whatever cannot be decoded in groups of four is left
+ * to the scalar decoder. This function is not presented as an
+ * interface function.
+ *
+ * @param table The decode table.
+ * @param in The buffer every stream is part of.
+ * @param lanes The eight streams to decode.
+ */
+__attribute__((target("avx2")))
+static void
+_decode_eight_avx2(const uint16_t *table, const uint8_t *in, slane_t *lanes)
+{
+    int i;
+    uint64_t rounds;
+    int32_t base[8], position[8], end[8];
+    uint32_t packed[8];
+    __m256i v_base, v_position, v_end;
+    __m256i v_bits, v_entry, v_length, v_packed;
+    const __m256i v_seven = _mm256_set1_epi32(0x7);
+    const __m256i v_mask = _mm256_set1_epi32(CODE_TABLE_MASK);
+    const __m256i v_low = _mm256_set1_epi32(0xFF);
+
+    rounds = lanes[0].remaining;
+    for (i = 0; i < 8; i++) {
+        if (lanes[i].remaining < rounds) {
+            rounds = lanes[i].remaining;
+        }
+        base[i] = lanes[i].stream - in;
+        position[i] = lanes[i].position;
+        end[i] = lanes[i].end;
+    }
+    rounds /= 4;
+
+    v_base = _mm256_loadu_si256((const __m256i *)base);
+    v_position = _mm256_loadu_si256((const __m256i *)position);
+    v_end = _mm256_loadu_si256((const __m256i *)end);
+
+/*
+ * Gather 4 bytes of every stream at its position. At least 25 bits
+ * are valid after the shift, which is enough for two opcodes.
+ */
+#define STREAM_GATHER_BITS()                                                           \
+    v_bits = _mm256_i32gather_epi32((const int *)in,                                   \
+                 _mm256_add_epi32(v_base, _mm256_srli_epi32(v_position, 3)), 1);      \
+    v_bits = _mm256_srlv_epi32(v_bits, _mm256_and_si256(v_position, v_seven))
+
+/* Decode one element in every lane and pack it at the given shift */
+#define STREAM_GATHER_ELEMENT(shift)                                                   \
+    v_entry = _mm256_i32gather_epi32((const int *)table,                               \
+                  _mm256_and_si256(v_bits, v_mask), 2);                               \
+    v_length = _mm256_and_si256(_mm256_srli_epi32(v_entry, 8), v_low);                \
+    v_packed = _mm256_or_si256(v_packed,                                               \
+                   _mm256_slli_epi32(_mm256_and_si256(v_entry, v_low), shift));       \
+    v_bits = _mm256_srlv_epi32(v_bits, v_length);                                      \
+    v_position = _mm256_add_epi32(v_position, v_length)
+
+    while (rounds--) {
+        /* A corrupt stream must never be read past its end */
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(v_position, v_end))) {
+            break;
+        }
+
+        v_packed = _mm256_setzero_si256();
+        STREAM_GATHER_BITS();
+        STREAM_GATHER_ELEMENT(0);
+        STREAM_GATHER_ELEMENT(8);
+        STREAM_GATHER_BITS();
+        STREAM_GATHER_ELEMENT(16);
+        STREAM_GATHER_ELEMENT(24);
+
+        _mm256_storeu_si256((__m256i *)packed, v_packed);
+        for (i = 0; i < 8; i++) {
+            memcpy(lanes[i].out, &packed[i], sizeof(packed[i]));
+            lanes[i].out += sizeof(packed[i]);
+            lanes[i].remaining -= sizeof(packed[i]);
+        }
+    }
+
+#undef STREAM_GATHER_ELEMENT
+#undef STREAM_GATHER_BITS
+
+    _mm256_storeu_si256((__m256i *)position, v_position);
+    for (i = 0; i < 8; i++) {
+        lanes[i].position = position[i];
+        _decode_lane(table, &lanes[i]);
+    }
+}
+#endif
+
+#ifdef STREAM_HAVE_AVX2
+/**
+ * This function times both decoders on a sample of skewed elements
+ * and returns the faster one. Gathers are microcoded on some
+ * processors which support AVX2, and there the scalar decoder wins.
+ * This function is not presented as an interface function.
+ *
+ * @return The faster decoder
+ */
+static int
+_calibrate()
+{
+    int i, decoder;
+    uint32_t seed;
+    uint8_t *sample, *streams, *out;
+    uint64_t capacity, frequencies[CODE_MAX_SYMBOLS];
+    ssize_t size;
+    hcode_t *hcode;
+    struct timespec start, stop;
+    int64_t elapsed[2];
+
+    decoder = STREAM_DECODER_AVX2;
+    capacity = hstream_bound(STREAM_CALIBRATE_SIZE, STREAM_WIDE_COUNT);
+    sample = malloc(STREAM_CALIBRATE_SIZE);
+    out = malloc(STREAM_CALIBRATE_SIZE);
+    streams = malloc(capacity + STREAM_PADDING);
+    hcode = hcode_create();
+    if (!sample || !out || !streams || !hcode) {
+        goto done;
+    }
+
+    /* Multiplying two random bytes gives a skewed distribution */
+    seed = 1;
+    for (i = 0; i < (int)STREAM_CALIBRATE_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        sample[i] = ((seed >> 16) & 0xFF) * ((seed >> 24) & 0xFF) >> 8;
+    }
+
+    hcode_count(frequencies, sample, STREAM_CALIBRATE_SIZE);
+    size = hstream_encode(hcode_build(hcode, frequencies), sample,
+                          STREAM_CALIBRATE_SIZE, STREAM_WIDE_COUNT, streams, capacity);
+    if (size < 0) {
+        goto done;
+    }
+
+    for (i = 0; i < 2; i++) {
+        stream_decoder = (i == 0) ? STREAM_DECODER_SCALAR : STREAM_DECODER_AVX2;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        hstream_decode(hcode, streams, size, out, STREAM_CALIBRATE_SIZE);
+        hstream_decode(hcode, streams, size, out, STREAM_CALIBRATE_SIZE);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        elapsed[i] = (stop.tv_sec - start.tv_sec) * 1000000000LL + (stop.tv_nsec - start.tv_nsec);
+    }
+
+    if (elapsed[0] < elapsed[1]) {
+        decoder = STREAM_DECODER_SCALAR;
+    }
+
+done:
+    free(sample);
+    free(out);
+    free(streams);
+    hcode_free(hcode);
+    return decoder;
+}
+#endif
+
+/**
+ * This function is used to pick the decoder used for sets of
+ * STREAM_WIDE_COUNT streams. The AVX2 decoder is only used if
+ * the processor supports it, and when picking automatically only
+ * if it is also faster than the scalar decoder, which is the
+ * reference for the output of every other decoder. Without it the
+ * first wide set of streams picks one, and picking automatically
+ * switches between the decoders while timing them, so it is called
+ * before several threads decode.
+ *
+ * @param decoder The decoder which is wanted.
+ * @return The decoder which was selected
+ */
+int
+hstream_select(int decoder)
+{
+    stream_decoder = STREAM_DECODER_SCALAR;
+
+#ifdef STREAM_HAVE_AVX2
+    if (decoder == STREAM_DECODER_AVX2 && __builtin_cpu_supports("avx2")) {
+        stream_decoder = STREAM_DECODER_AVX2;
+    } else if (decoder == STREAM_DECODER_AUTO && __builtin_cpu_supports("avx2")) {
+        stream_decoder = _calibrate();
+    }
+#endif
+
+    return stream_decoder;
+}
+
+/**
+ * This function is used to compute the largest size that
+ * encoding a buffer into a set of streams can produce,
+ * including the padding the encoder writes past the end.
+ *
+ * @param length The length of the buffer to encode.
+ * @param count The number of streams.
+ * @return The largest encoded size
+ */
+uint64_t
+hstream_bound(uint64_t length, uint8_t count)
+{
+    return STREAM_HEADER_SIZE(count) + ((length * CODE_MAX_LENGTH + 7) / 8) + count + STREAM_PADDING;
+}
+
+/**
+ * This function is used to encode a buffer into a set of
+ * interleaved streams using a canonical code. The set begins
+ * with the number of streams and the size of every stream
+ * followed by the streams themselves.
+ *
+ * @param hcode The code to encode with.
+ * @param in The buffer to encode.
+ * @param length The length of the buffer.
+ * @param count The number of streams to encode into.
+ * @param out The buffer to encode into.
+ * @param capacity The size of the output buffer.
+ * @return The number of bytes encoded or error code
+ */
+ssize_t
+hstream_encode(hcode_t *hcode, const uint8_t *in, uint64_t length, uint8_t count,
+               uint8_t *out, uint64_t capacity)
+{
+    uint8_t i;
+    uint64_t segment, start, end;
+    uint64_t size, offset;
+
+    if (!hcode || !out) {
+        return -1;
+    } else if (count == 0 || count > STREAM_MAX_COUNT) {
+        return -2;
+    } else if (capacity < hstream_bound(length, count)) {
+        return -3;
+    }
+
+    out[0] = count;
+    offset = STREAM_HEADER_SIZE(count);
+    segment = STREAM_SEGMENT(length, count);
+    for (i = 0; i < count; i++) {
+        start = (i * segment < length) ? i * segment : length;
+        end = (start + segment < length) ? start + segment : length;
+
+        size = _encode_segment(hcode, in + start, end - start, out + offset);
+        if (size > STREAM_SIZE_MAX) {
+            return -4;
+        }
+        hendian_put(out + STREAM_COUNT_SIZE + (i * STREAM_SIZE_SIZE), size, STREAM_SIZE_SIZE);
+        offset += size;
+    }
+
+    return offset;
+}
+
+/**
+ * This function reads the header of a set of streams and sets up
+ * every stream with the segment of the output it decodes into.
+ * Unused lanes at the end have nothing left to decode. This function
+ * is not presented as an interface function.
+ *
+ * @param hcode The code to decode with.
+ * @param in The set of streams.
+ * @param size The size of the set of streams.
+ * @param out The buffer to decode into.
+ * @param length The number of elements to decode.
+ * @param lanes The lanes to set up.
+ * @return The number of streams or error code
+ */
+static int
+_setup(hcode_t *hcode, const uint8_t *in, uint64_t size, uint8_t *out, uint64_t length, slane_t *lanes)
+{
+    uint8_t i, count;
+    uint64_t segment, start, end;
+    uint64_t stream_size, offset;
+
+    if (!hcode || !in) {
+        return -1;
+    } else if (size < STREAM_COUNT_SIZE) {
+        return -2;
+    }
+
+    count = in[0];
+    if (count == 0 || count > STREAM_MAX_COUNT) {
+        return -2;
+    } else if (size < STREAM_HEADER_SIZE(count)) {
+        return -2;
+    } else if (length && !hcode->present) {
+        return -3;
+    }
+
+    memset(lanes, 0, sizeof(slane_t) * (STREAM_MAX_COUNT + 3));
+    offset = STREAM_HEADER_SIZE(count);
+    segment = STREAM_SEGMENT(length, count);
+    for (i = 0; i < count; i++) {
+        stream_size = hendian_get(in + STREAM_COUNT_SIZE + (i * STREAM_SIZE_SIZE), STREAM_SIZE_SIZE);
+        if (stream_size > size - offset) {
+            return -2;
+        }
+
+        start = (i * segment < length) ? i * segment : length;
+        end = (start + segment < length) ? start + segment : length;
+
+        lanes[i].stream = in + offset;
+        lanes[i].position = 0;
+        lanes[i].end = stream_size * 8;
+        lanes[i].out = out ? out + start : NULL;
+        lanes[i].remaining = end - start;
+        offset += stream_size;
+    }
+
+    return count;
+}
+
+/**
+ * This function decodes the remaining elements of every lane with
+ * the selected decoder. This function is not presented as an
+ * interface function.
+ *
+ * @param hcode The code to decode with.
+ * @param in The set of streams.
+ * @param size The size of the set of streams.
+ * @param count The number of streams.
+ * @param lanes The lanes to decode.
+ */
+static void
+_decode_lanes(hcode_t *hcode, const uint8_t *in, uint64_t size, int count, slane_t *lanes)
+{
+    int i;
+
+    if (stream_decoder < 0) {
+        hstream_select(STREAM_DECODER_AUTO);
+    }
+
+#ifdef STREAM_HAVE_AVX2
+    /*
+     * The AVX2 decoder works with 32 bit offsets, so the streams must
+     * be small enough for their bit positions to fit.
+     */
+    if (count == STREAM_WIDE_COUNT && stream_decoder == STREAM_DECODER_AVX2 && size < (1ULL << 28)) {
+        _decode_eight_avx2(hcode->table, in, lanes);
+    }
+#else
+    (void)in;
+    (void)size;
+#endif
+
+    for (i = 0; i < count; i += 4) {
+        _decode_four(hcode->table, &lanes[i]);
+    }
+}
+
+/**
+ * This function checks that every stream decoded its whole segment
+ * and ended within the last byte of its size. This function is not
+ * presented as an interface function.
+ *
+ * @param count The number of streams.
+ * @param lanes The lanes to check.
+ * @return 0 on success or error code
+ */
+static int
+_check(int count, slane_t *lanes)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (lanes[i].remaining || lanes[i].position > lanes[i].end) {
+            return -4;
+        } else if (lanes[i].end - lanes[i].position >= 8) {
+            return -5;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * This function is used to decode a set of interleaved streams
+ * into a buffer which holds exactly the original elements. The
+ * input must be readable for STREAM_PADDING bytes past its size.
+ *
+ * @param hcode The code to decode with.
+ * @param in The set of streams.
+ * @param size The size of the set of streams.
+ * @param out The buffer to decode into.
+ * @param length The number of elements to decode.
+ * @return 0 on success or error code
+ */
+int
+hstream_decode(hcode_t *hcode, const uint8_t *in, uint64_t size, uint8_t *out, uint64_t length)
+{
+    int count;
+    slane_t lanes[STREAM_MAX_COUNT + 3];
+
+    if (!out) {
+        return -1;
+    }
+
+    count = _setup(hcode, in, size, out, length, lanes);
+    if (count < 0) {
+        return count;
+    }
+
+    _decode_lanes(hcode, in, size, count, lanes);
+    return _check(count, lanes);
+}
+
+/**
+ * This function is used to check that a set of interleaved streams
+ * decodes correctly without keeping the output. Every stream decodes
+ * its share of a small scratch buffer over and over again, so memory
+ * use does not depend on the original length.
+ *
+ * @param hcode The code to decode with.
+ * @param in The set of streams.
+ * @param size The size of the set of streams.
+ * @param length The number of elements to decode.
+ * @param scratch The scratch buffer.
+ * @param scratch_size The size of the scratch buffer.
+ * @param checksum Where to store the checksum of the elements or NULL
+ * @return 0 on success or error code
+ */
+int
+hstream_verify(hcode_t *hcode, const uint8_t *in, uint64_t size, uint64_t length,
+               uint8_t *scratch, uint64_t scratch_size, uint32_t *checksum)
+{
+    int i, count;
+    uint64_t chunk, pending;
+    uint64_t totals[STREAM_MAX_COUNT];
+    uint64_t segments[STREAM_MAX_COUNT];
+    uint32_t checksums[STREAM_MAX_COUNT];
+    slane_t lanes[STREAM_MAX_COUNT + 3];
+
+    if (!scratch) {
+        return -1;
+    }
+
+    count = _setup(hcode, in, size, NULL, length, lanes);
+    if (count < 0) {
+        return count;
+    }
+
+    chunk = scratch_size / count;
+    if (!chunk) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        totals[i] = lanes[i].remaining;
+        segments[i] = lanes[i].remaining;
+        checksums[i] = CHECKSUM_INITIAL;
+    }
+
+    do {
+        pending = 0;
+        for (i = 0; i < count; i++) {
+            lanes[i].remaining = (totals[i] < chunk) ? totals[i] : chunk;
+            lanes[i].out = scratch + (i * chunk);
+            totals[i] -= lanes[i].remaining;
+            pending |= totals[i];
+        }
+
+        _decode_lanes(hcode, in, size, count, lanes);
+        for (i = 0; i < count; i++) {
+            if (lanes[i].remaining) {
+                return -4;
+            } else if (checksum) {
+                checksums[i] = hchecksum_update(checksums[i], scratch + (i * chunk),
+                                                lanes[i].out - (scratch + (i * chunk)));
+            }
+        }
+    } while (pending);
+
+    /* Every stream holds the next segment of the elements */
+    if (checksum) {
+        *checksum = CHECKSUM_INITIAL;
+        for (i = 0; i < count; i++) {
+            *checksum = hchecksum_combine(*checksum, checksums[i], segments[i]);
+        }
+    }
+
+    return _check(count, lanes);
+}
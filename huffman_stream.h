@@ -0,0 +1,83 @@
+/*
+ * This file declares the interface for using interleaved huffman
+ * streams. The input is cut into equally sized segments and every
+ * segment is encoded into its own bit stream so that the decoder
+ * can keep several streams in flight at once.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "huffman_code.h"
+#include "huffman_checksum.h"
+
+#ifndef HUFFMAN_STREAM_H
+#define HUFFMAN_STREAM_H
+
+/* Stream Counts */
+#define STREAM_DEFAULT_COUNT            (4U)
+#define STREAM_WIDE_COUNT               (8U)
+#define STREAM_MAX_COUNT                (8U)
+
+/* Decoder Selection */
+#define STREAM_DECODER_SCALAR           (0)
+#define STREAM_DECODER_AVX2             (1)
+#define STREAM_DECODER_AUTO             (2)
+
+/*
+ * Decoding loads 8 bytes at a time, so every buffer handed to the
+ * decoder must be readable this far past its end.
+ */
+#define STREAM_PADDING                  (8U)
+
+/*
+ * These are the macros for the header of a set of streams. The size
+ * of every stream is stored in 4 bytes least significant byte first.
+ */
+#define STREAM_COUNT_SIZE               (sizeof(uint8_t))
+#define STREAM_SIZE_SIZE                (sizeof(uint32_t))
+#define STREAM_SIZE_MAX                 (0xFFFFFFFFU)
+#define STREAM_HEADER_SIZE(count)       (STREAM_COUNT_SIZE + ((count) * STREAM_SIZE_SIZE))
+
+/* The number of elements each stream encodes */
+#define STREAM_SEGMENT(length, count)   (((length) + (count) - 1) / (count))
+
+/**
+ * This function is used to compute the largest size that
+ * encoding a buffer into a set of streams can produce.
+ */
+uint64_t hstream_bound(uint64_t, uint8_t);
+
+/**
+ * This function is used to encode a buffer into a set of
+ * interleaved streams using a canonical code.
+ */
+ssize_t hstream_encode(hcode_t*, const uint8_t*, uint64_t, uint8_t, uint8_t*, uint64_t);
+
+/**
+ * This function is used to pick the decoder used for sets of
+ * STREAM_WIDE_COUNT streams. The AVX2 decoder is only used if
+ * the processor supports it and, when picking automatically, if
+ * it is faster than the scalar decoder.
+ */
+int hstream_select(int);
+
+/**
+ * This function is used to decode a set of interleaved streams
+ * into a buffer which holds exactly the original elements.
+ */
+int hstream_decode(hcode_t*, const uint8_t*, uint64_t, uint8_t*, uint64_t);
+
+/**
+ * This function is used to check that a set of interleaved streams
+ * decodes correctly, using only a small scratch buffer, and to
+ * compute the checksum of what it decodes to.
+ */
+int hstream_verify(hcode_t*, const uint8_t*, uint64_t, uint64_t, uint8_t*, uint64_t, uint32_t*);
+
+#endif
@@ -58,6 +58,59 @@ _parse(helement_t *helement_node, char **opcode_table, char *opcode_string, uint
     }
 }
 
+/**
+ * This function recursively computes the depth of every leaf
+ * node, which is the length of the opcode _parse would build for
+ * it. This function is not presented as an interface function.
+ *
+ * @param helement_node The node of the huffman tree
+ * @param lengths The table which holds the lengths
+ * @param depth The depth of this node
+ * @return The maximum depth found below this node
+ */
+int
+_lengths(helement_t *helement_node, uint8_t *lengths, int depth)
+{
+    int left_depth, right_depth;
+
+    if (helement_node->leaf_node) {
+        lengths[helement_node->element] = depth;
+        return depth;
+    }
+
+    left_depth = right_depth = depth;
+    if (helement_node->left_child) {
+        left_depth = _lengths(helement_node->left_child, lengths, depth + 1);
+    }
+
+    if (helement_node->right_child) {
+        right_depth = _lengths(helement_node->right_child, lengths, depth + 1);
+    }
+
+    return (left_depth > right_depth) ? left_depth : right_depth;
+}
+
+/**
+ * This function recursively frees every element below and
+ * including the given node. This function is not presented
+ * as an interface function.
+ *
+ * @param helement_node The node of the huffman tree
+ */
+void
+_free(helement_t *helement_node)
+{
+    if (helement_node->left_child) {
+        _free(helement_node->left_child);
+    }
+
+    if (helement_node->right_child) {
+        _free(helement_node->right_child);
+    }
+
+    helement_free(helement_node);
+}
+
 /**
  * This function uses depth first recursive algorithm to assign
  * each huffman element in the huffman tree an index and then
@@ -149,142 +202,94 @@ _output(helement_t *helement_node, int fd, uint64_t offset)
 }
 
 /**
- * Read in a single object from a binary file to construct a
- * huffman element. This function is not presented as an
- * interface function.
+ * This function recursively packs the huffman tree elements into
+ * a buffer in pre-order, one bit per node followed by the element
+ * of every leaf node. This function is not presented as an interface
+ * function.
  *
- * @param fd The file to read from.
- * @param index The index of the element
- * @return A huffman element
+ * @param helement_node The node to pack
+ * @param buffer The buffer to pack into, which must be zeroed
+ * @param capacity The size of the buffer in bits
+ * @param position The bit position to pack at
+ * @return 0 on success or -1 if the buffer is too small
  */
-helement_t*
-_input_object(int fd, uint64_t index)
+int
+_pack(helement_t *helement_node, uint8_t *buffer, uint64_t capacity, uint64_t *position)
 {
-    uint64_t element_offset, leaf_flag_offset;
-    uint8_t element, leaf_flag;
-    ssize_t size_to_read;
-    ssize_t bytes_read;
-    helement_t *this_element;
+    uint64_t i;
 
-    /* Get offsets */
-    element_offset = TREE_INPUT_ELEMENT_OFFSET(index);
-    leaf_flag_offset = TREE_INPUT_LEAFNODE_OFFSET(index);
-
-    /* Read in the element */
-    size_to_read = TREE_INPUT_ELEMENT_SIZE;
-    bytes_read = pread(fd, &element, size_to_read, element_offset);
-    if (bytes_read < size_to_read) {
-        return NULL;
+    if (*position + TREE_PACK_LEAF_BITS > capacity) {
+        return -1;
     }
 
-    /* Read in the leaf flag */
-    size_to_read = TREE_INPUT_LEAFNODE_SIZE;
-    bytes_read = pread(fd, &leaf_flag, size_to_read, leaf_flag_offset);
-    if (bytes_read < size_to_read) {
-        return NULL;
+    if (helement_node->leaf_node) {
+        buffer[*position / 8] |= 1U << (*position & 0x7);
+        *position += TREE_PACK_LEAF_BITS;
+
+        if (*position + TREE_PACK_ELEMENT_BITS > capacity) {
+            return -1;
+        }
+        for (i = 0; i < TREE_PACK_ELEMENT_BITS; i++) {
+            if (helement_node->element & (1U << i)) {
+                buffer[*position / 8] |= 1U << (*position & 0x7);
+            }
+            *position += 1;
+        }
+        return 0;
     }
 
-    /* Create a huffman element out of these values */
-    this_element = helement_create(element, leaf_flag, SPECIAL_ELEMENT_FREQUENCY);
-    if (!this_element) {
-        return NULL;
+    *position += TREE_PACK_LEAF_BITS;
+    if (!helement_node->left_child || !helement_node->right_child) {
+        return -1;
+    } else if (_pack(helement_node->left_child, buffer, capacity, position)) {
+        return -1;
     }
 
-    return this_element;
+    return _pack(helement_node->right_child, buffer, capacity, position);
 }
 
 /**
- * This function uses a pre-order fetch algorithm to read
- * in a huffman tree from a file recursively. This function
- * is not presented as an interface function.
+ * This function attaches a node read from a description of a tree
+ * to the child slot on top of the pending stack, and pushes its own
+ * children when it is not a leaf node. The right child is pushed
+ * first so that the left child is read first, as in pre-order. This
+ * function is not presented as an interface function.
  *
- * @param fd The file we read from
- * @param htree The huffman tree we are constructing
- * @param helement_node The tree node we are currently at
- * @param index The index of the current element
+ * @param htree The huffman tree being rebuilt
+ * @param pending The stack of child slots still to be read
+ * @param depth The depth of the stack
+ * @param seen The elements already attached as leaf nodes
+ * @param element The element of the node
  * @param leaf_flag Flag specifying if this is a leaf node
- * @return A huffman tree
+ * @return 0 on success or error code
  */
-uint64_t
-_input(int fd, htree_t *htree, helement_t *helement_node, uint64_t index, uint8_t leaf_flag)
+int
+_attach(htree_t *htree, helement_t ***pending, int *depth, uint8_t *seen, uint8_t element, uint8_t leaf_flag)
 {
-    uint8_t child_leaf_flag;
-    uint64_t leftc_index, rightc_index;
-    helement_t *left_child;
-    helement_t *right_child;
-
-    /*
-     * The working of this function is rather complex and dependent
-     * on the design of how I output the huffman tree onto a file.
-     *
-     * Finding the index of the left child is really simple. It is
-     * simply your own index + 1. This is because of how pre-order
-     * traversal works.
-     *
-     * Finding the index of the right child is a lot more complex.
-     * Something to realize is that there is never a case where
-     * the right child is a leaf node and the left child is not.
-     * That in consideration, there are two cases using which
-     * we calculate the index of the right child.
-     *
-     * 1. When the left child was a leaf node
-     * If this is the case, the index of the right child is simply
-     * the index of the left child + 1. This is again because of how
-     * pre-order traversal works.
-     *
-     * 2. When the left child is not a leaf node
-     * In this case, the index of the right child is the index
-     * of your left childs right child + 1. I'm not sure if this is
-     * because of pre-order traversal or not, but this property holds
-     * true in the tree I emit to a file.
-     * right_index = left_child->right_child->index + 1;
-     *
-     * Once we read in the children, we simply set them to their
-     * parents accordingly.
-     */
+    helement_t *helement_node;
 
-    if (leaf_flag) {
-        return index;
-    } else {
-        /*
-         * Calculate left childs index and then read it in. Set its
-         * parent as us and then set a flag which tells us if this is
-         * a leaf node or not.
-         */
-        leftc_index = index + 1;
-        left_child = _input_object(fd, leftc_index);
-        if (!left_child) {
-            return TREE_BAD_COUNT;
-        } else {
-            child_leaf_flag = left_child->leaf_node;
-            helement_node->left_child = left_child;
-        }
+    if (htree->count >= TREE_PACK_MAX_NODES) {
+        return TREE_ERROR_NODES;
+    } else if (leaf_flag && seen[element]) {
+        return TREE_ERROR_ELEMENT;
+    }
 
-        /* This value should give us the index for the right child because
-         * if the left child is a leaf node then we simply get its value and
-         * increment one.
-         *
-         * If not a leaf node, then we get the value of the left childs right
-         * child because of what we return down below.
-         */
-        rightc_index = _input(fd, htree, left_child, leftc_index, child_leaf_flag);
-        if (rightc_index == TREE_BAD_COUNT) {
-            return TREE_BAD_COUNT;
-        } else {
-            rightc_index += 1;
-        }
+    helement_node = helement_create(leaf_flag ? element : 0, leaf_flag, SPECIAL_ELEMENT_FREQUENCY);
+    if (!helement_node) {
+        return TREE_ERROR_MEMORY;
+    }
 
-        right_child = _input_object(fd, rightc_index);
-        if (!right_child) {
-            return TREE_BAD_COUNT;
-        } else {
-            child_leaf_flag = right_child->leaf_node;
-            helement_node->right_child = right_child;
-        }
+    *(pending[--(*depth)]) = helement_node;
+    htree->count += 1;
 
-        /* This will end up returning the index of the right child */
-        return _input(fd, htree, right_child, rightc_index, child_leaf_flag);
+    if (leaf_flag) {
+        seen[element] = 1;
+    } else {
+        pending[(*depth)++] = &(helement_node->right_child);
+        pending[(*depth)++] = &(helement_node->left_child);
     }
+
+    return 0;
 }
 
 /**
@@ -313,14 +318,23 @@ htree_create()
 
 /**
  * This function is used to free a huffman
- * tree.
+ * tree along with all of its elements.
  *
  * NOTE: This function only free's fields which are based
  * on a tree. List fields are not free'd.
+ *
+ * @param htree The huffman tree to free.
  */
 void htree_free(htree_t *htree)
 {
-    htree = NULL;
+    if (!htree) {
+        return;
+    }
+
+    if (htree->root) {
+        _free(htree->root);
+    }
+    free(htree);
 }
 
 /**
@@ -479,9 +493,32 @@ htree_parse(htree_t *htree)
     htree->_parsed = 1;
     htree->count = 0;
     _parse(htree->root, opcode_table, opcode_string, &(htree->count));
+    free(opcode_string);
     return opcode_table;
 }
 
+/**
+ * This function is used to compute the depth of every leaf
+ * node in the tree, which is the length of its opcode. Elements
+ * which are not part of the tree are left untouched, so the caller
+ * should clear the table beforehand.
+ *
+ * @param htree The tree we want the lengths of.
+ * @param lengths A table of TREE_MAX_TABLE_SIZE lengths.
+ * @return The maximum length or error code
+ */
+int
+htree_lengths(htree_t *htree, uint8_t *lengths)
+{
+    if (!htree) {
+        return -1;
+    } else if (!(htree->root)) {
+        return -2;
+    }
+
+    return _lengths(htree->root, lengths, 0);
+}
+
 /**
  * This function is used to output the tree to a binary file
  * and it does so using a depth first algorithm. It returns the offset
@@ -524,7 +561,7 @@ htree_output(htree_t *htree, int fd, uint64_t offset)
      * in the tree.
      */
     size_to_write = sizeof(htree->count);
-    bytes_written = write(fd, &(htree->count), size_to_write);
+    bytes_written = pwrite(fd, &(htree->count), size_to_write, offset);
     if (bytes_written < size_to_write) {
         return -4;
     } else {
@@ -541,26 +578,19 @@ htree_output(htree_t *htree, int fd, uint64_t offset)
 
 /**
  * This function is used to take input for a huffman tree
- * from a binary file and it does so using a pre-order fetch
- * algorithm.
+ * from a binary file. The whole region the tree can take up is
+ * read in a single call and the tree is rebuilt from memory.
  *
  * @param fd The file we want to read from
+ * @param offset The offset the tree begins at
  * @return A fully constructed huffman tree or error
  */
 htree_t*
-htree_input(int fd)
+htree_input(int fd, uint64_t offset)
 {
-    /*
-     * This is for the way we read in the tree. Essentially, we pass in
-     * this flag so that the helper function knows that the root is not
-     * a leaf node.
-     */
-    const int ROOT_LEAF_FLAG = 0;
-
-    ssize_t size_to_read;
+    uint8_t buffer[TREE_INPUT_MAX_SIZE];
     ssize_t bytes_read;
     htree_t *this_tree;
-    helement_t *helement_node;
 
     /* Create the structure for a huffman tree */
     this_tree = htree_create();
@@ -568,31 +598,175 @@ htree_input(int fd)
         return NULL;
     }
 
-    /*
-     * We need to read in the count and the root element for the tree
-     * and then call the recursive pre-order fetch function to read
-     * in the rest of the tree.
-     */
-    size_to_read = TREE_INPUT_COUNT_SIZE;
-    bytes_read = read(fd, &(this_tree->count), size_to_read);
-    if (bytes_read < size_to_read) {
+    /* A short read is fine, the tree may be all that is left */
+    bytes_read = pread(fd, buffer, sizeof(buffer), offset);
+    if (bytes_read < 0) {
         free(this_tree);
         return NULL;
     }
 
-    /* Read in root */
-    helement_node = _input_object(fd, TREE_INPUT_ROOT_ELEMENT_INDEX);
-    if (!helement_node) {
-        free(this_tree);
+    if (htree_unpack_nodes(this_tree, buffer, bytes_read) < 0) {
+        htree_free(this_tree);
         return NULL;
-    } else {
-        this_tree->root = helement_node;
     }
 
-    _input(fd, this_tree, helement_node, TREE_INPUT_ROOT_ELEMENT_INDEX, ROOT_LEAF_FLAG);
     return this_tree;
 }
 
+/**
+ * This function is used to rebuild a tree from a buffer which
+ * holds it the way htree_output writes it, a count followed by
+ * the element and leaf flag of every node in pre-order. The tree
+ * is rebuilt without recursion, so a malformed tree cannot run us
+ * out of stack.
+ *
+ * @param htree The empty huffman tree we rebuild into.
+ * @param buffer The buffer we unpack from.
+ * @param size The number of bytes in the buffer.
+ * @return The number of bytes unpacked or error code
+ */
+ssize_t
+htree_unpack_nodes(htree_t *htree, const uint8_t *buffer, uint64_t size)
+{
+    /* Every internal node adds one pending child to the stack */
+    helement_t **pending[TREE_PACK_MAX_NODES + 1];
+    uint8_t seen[TREE_MAX_TABLE_SIZE] = {0};
+    uint64_t count, index;
+    int depth, ret;
+
+    if (!htree || !buffer) {
+        return TREE_ERROR_ARGUMENT;
+    } else if (htree->root) {
+        return TREE_ERROR_FULL;
+    } else if (size < TREE_INPUT_COUNT_SIZE) {
+        return TREE_ERROR_SHORT;
+    }
+
+    memcpy(&count, buffer + TREE_INPUT_COUNT_OFFSET, TREE_INPUT_COUNT_SIZE);
+    if (count < 1 || count > TREE_PACK_MAX_NODES) {
+        return TREE_ERROR_COUNT;
+    } else if (size < TREE_INPUT_OBJECT_OFFSET(count)) {
+        return TREE_ERROR_SHORT;
+    }
+
+    htree->count = 0;
+    depth = 0;
+    pending[depth++] = &(htree->root);
+    for (index = 0; depth > 0; index++) {
+        if (index >= count) {
+            return TREE_ERROR_COUNT;
+        }
+
+        /* The root is never a leaf node in the files we write */
+        ret = _attach(htree, pending, &depth, seen,
+                      buffer[TREE_INPUT_ELEMENT_OFFSET(index)],
+                      (index != TREE_INPUT_ROOT_ELEMENT_INDEX) ? buffer[TREE_INPUT_LEAFNODE_OFFSET(index)] : 0);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    if (index != count) {
+        return TREE_ERROR_COUNT;
+    }
+
+    htree->_parsed = 1;
+    return TREE_INPUT_OBJECT_OFFSET(count);
+}
+
+/**
+ * This function is used to pack the tree into a buffer as a bit
+ * packed description. Unlike htree_output, nothing is written to
+ * a file, so the caller can write the tree out in the same call as
+ * whatever follows it.
+ *
+ * @param htree The huffman tree we pack.
+ * @param buffer The buffer we pack into.
+ * @param capacity The size of the buffer.
+ * @return The number of bytes packed or error code
+ */
+ssize_t
+htree_pack(htree_t *htree, uint8_t *buffer, uint64_t capacity)
+{
+    uint64_t position;
+
+    if (!htree || !buffer) {
+        return -1;
+    } else if (!(htree->root)) {
+        return -2;
+    }
+
+    memset(buffer, 0, capacity);
+    position = 0;
+    if (_pack(htree->root, buffer, capacity * 8, &position)) {
+        return -3;
+    }
+
+    return (position + 7) / 8;
+}
+
+/**
+ * This function is used to rebuild a tree from a bit packed
+ * description in a buffer. The tree is rebuilt with a stack of
+ * the children which are still to be read instead of recursion,
+ * so a malformed description cannot run us out of stack.
+ *
+ * @param htree The empty huffman tree we rebuild into.
+ * @param buffer The buffer we unpack from.
+ * @param size The number of bytes in the buffer.
+ * @return The number of bytes unpacked or error code
+ */
+ssize_t
+htree_unpack(htree_t *htree, const uint8_t *buffer, uint64_t size)
+{
+    /* Every internal node adds one pending child to the stack */
+    helement_t **pending[TREE_PACK_MAX_NODES + 1];
+    uint8_t seen[TREE_MAX_TABLE_SIZE] = {0};
+    uint64_t i, position, capacity;
+    uint8_t element, leaf_flag;
+    int depth, ret;
+
+    if (!htree || !buffer) {
+        return TREE_ERROR_ARGUMENT;
+    } else if (htree->root) {
+        return TREE_ERROR_FULL;
+    }
+
+    capacity = size * 8;
+    position = 0;
+    htree->count = 0;
+
+    depth = 0;
+    pending[depth++] = &(htree->root);
+    while (depth > 0) {
+        if (position + TREE_PACK_LEAF_BITS > capacity) {
+            return TREE_ERROR_SHORT;
+        }
+
+        leaf_flag = (buffer[position / 8] >> (position & 0x7)) & 0x1;
+        position += TREE_PACK_LEAF_BITS;
+
+        element = 0;
+        if (leaf_flag) {
+            if (position + TREE_PACK_ELEMENT_BITS > capacity) {
+                return TREE_ERROR_SHORT;
+            }
+            for (i = 0; i < TREE_PACK_ELEMENT_BITS; i++) {
+                element |= ((buffer[position / 8] >> (position & 0x7)) & 0x1) << i;
+                position += 1;
+            }
+        }
+
+        ret = _attach(htree, pending, &depth, seen, element, leaf_flag);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    htree->_parsed = 1;
+    return (position + 7) / 8;
+}
+
 /**
  * This function is used to state step the huffman tree
  * depending on the opcode which is given. An opcode of
@@ -38,6 +38,30 @@
 #define TREE_INPUT_ELEMENT_OFFSET(element)      (TREE_INPUT_OBJECT_OFFSET(element))
 #define TREE_INPUT_LEAFNODE_OFFSET(element)     (TREE_INPUT_OBJECT_OFFSET(element) + TREE_INPUT_LEAFNODE_SIZE)
 
+/*
+ * These are the macros for a bit packed huffman tree. The tree is
+ * stored in pre-order with a single bit for every node, set for a
+ * leaf node, and the element of every leaf node right after its bit.
+ * Bits are stored least significant first within every byte.
+ */
+#define TREE_PACK_LEAF_BITS                     (1U)
+#define TREE_PACK_ELEMENT_BITS                  (8U)
+#define TREE_PACK_MAX_NODES                     (2 * TREE_MAX_TABLE_SIZE - 1)
+#define TREE_PACK_MAX_BITS                      (TREE_PACK_MAX_NODES * TREE_PACK_LEAF_BITS + TREE_MAX_TABLE_SIZE * TREE_PACK_ELEMENT_BITS)
+#define TREE_PACK_MAX_SIZE                      ((TREE_PACK_MAX_BITS + 7) / 8)
+
+/* This is the most a tree written by htree_output can take up */
+#define TREE_INPUT_MAX_SIZE                     (TREE_INPUT_OBJECT_OFFSET(TREE_PACK_MAX_NODES))
+
+/* Unpack Errors */
+#define TREE_ERROR_ARGUMENT                     (-1)
+#define TREE_ERROR_FULL                         (-2)
+#define TREE_ERROR_SHORT                        (-3)
+#define TREE_ERROR_NODES                        (-4)
+#define TREE_ERROR_MEMORY                       (-5)
+#define TREE_ERROR_COUNT                        (-6)
+#define TREE_ERROR_ELEMENT                      (-7)
+
 typedef struct huffman_tree {
     /* This is the beginning of the tree */
     helement_t *root;
@@ -62,7 +86,7 @@ htree_t* htree_create();
 
 /**
  * This function is used to free a huffman
- * tree.
+ * tree along with all of its elements.
  *
  * NOTE: This function only free's fields which are based
  * on a tree. List fields are not free'd.
@@ -95,6 +119,12 @@ int htree_connect(helement_t*, helement_t*, helement_t*);
  */
 char** htree_parse(htree_t*);
 
+/**
+ * This function is used to compute the depth of every leaf
+ * node in the tree, which is the length of its opcode.
+ */
+int htree_lengths(htree_t*, uint8_t*);
+
 /**
  * This function is used to output the tree to a binary file
  * and it does so using a depth first algorithm. It returns the offset
@@ -104,10 +134,29 @@ ssize_t htree_output(htree_t*, int, uint64_t);
 
 /**
  * This function is used to take input for a huffman tree
- * from a binary file and it does so using a pre-order fetch
- * algorithm.
+ * from a binary file at an offset. The tree is read in a
+ * single call and rebuilt from memory.
+ */
+htree_t* htree_input(int, uint64_t);
+
+/**
+ * This function is used to rebuild a tree from a buffer which
+ * holds it the way htree_output writes it.
+ */
+ssize_t htree_unpack_nodes(htree_t*, const uint8_t*, uint64_t);
+
+/**
+ * This function is used to pack the tree into a buffer as
+ * a bit packed description, so that it can be written out
+ * together with the opcodes.
+ */
+ssize_t htree_pack(htree_t*, uint8_t*, uint64_t);
+
+/**
+ * This function is used to rebuild a tree from a bit packed
+ * description in a buffer.
  */
-htree_t* htree_input(int);
+ssize_t htree_unpack(htree_t*, const uint8_t*, uint64_t);
 
 /**
  * This function is used to state step the huffman tree
@@ -0,0 +1,428 @@
+/*
+ * This file defines the interface for reading and writing files
+ * through io_uring. Reads and writes are queued on a ring shared
+ * with the kernel and many of them are in flight at once, into
+ * buffers which can be registered with the kernel up front. The
+ * ring is set up with the raw system calls, so no library is
+ * needed, and creating one fails on systems without io_uring so
+ * that callers can fall back to plain reads and writes.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include "huffman_uring.h"
+
+#ifdef URING_HAVE_IO_URING
+
+/**
+ * This function is used to set up a new ring with room for a
+ * number of entries. The submission ring, the completion ring and
+ * the submission entries are mapped from the kernel. Where io_uring
+ * is missing or not allowed, nothing is left behind and NULL is
+ * returned.
+ *
+ * @param entries The number of entries the ring holds.
+ * @return A ring or NULL
+ */
+huring_t*
+huring_create(uint32_t entries)
+{
+    struct io_uring_params params;
+    huring_t *temp;
+    uint8_t *sq_ring, *cq_ring;
+
+    if (entries < 1 || entries > URING_MAX_ENTRIES) {
+        return NULL;
+    }
+
+    temp = calloc(1, sizeof(huring_t));
+    if (!temp) {
+        return NULL;
+    }
+
+    memset(&params, 0, sizeof(params));
+    temp->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (temp->fd < 0) {
+        free(temp);
+        return NULL;
+    }
+
+    temp->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    temp->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    temp->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    /* Newer kernels map both rings at once */
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (temp->cq_ring_size > temp->sq_ring_size) {
+            temp->sq_ring_size = temp->cq_ring_size;
+        }
+        temp->cq_ring_size = temp->sq_ring_size;
+    }
+
+    temp->sq_ring = mmap(NULL, temp->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, temp->fd, IORING_OFF_SQ_RING);
+    temp->cq_ring = temp->sq_ring;
+    if (temp->sq_ring != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        temp->cq_ring = mmap(NULL, temp->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, temp->fd, IORING_OFF_CQ_RING);
+    }
+    temp->sqes = mmap(NULL, temp->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, temp->fd, IORING_OFF_SQES);
+    if (temp->sq_ring == MAP_FAILED || temp->cq_ring == MAP_FAILED || temp->sqes == MAP_FAILED) {
+        huring_free(temp);
+        return NULL;
+    }
+
+    sq_ring = temp->sq_ring;
+    temp->sq_head = (uint32_t*)(sq_ring + params.sq_off.head);
+    temp->sq_tail = (uint32_t*)(sq_ring + params.sq_off.tail);
+    temp->sq_array = (uint32_t*)(sq_ring + params.sq_off.array);
+    temp->sq_mask = *(uint32_t*)(sq_ring + params.sq_off.ring_mask);
+    temp->sq_entries = params.sq_entries;
+
+    cq_ring = temp->cq_ring;
+    temp->cq_head = (uint32_t*)(cq_ring + params.cq_off.head);
+    temp->cq_tail = (uint32_t*)(cq_ring + params.cq_off.tail);
+    temp->cq_mask = *(uint32_t*)(cq_ring + params.cq_off.ring_mask);
+    temp->cqes = cq_ring + params.cq_off.cqes;
+    temp->tail = *temp->sq_tail;
+    return temp;
+}
+
+/**
+ * This function is used to tear down a ring. Anything still in
+ * flight is cancelled by the kernel when the ring is closed.
+ *
+ * @param huring The ring to tear down
+ */
+void
+huring_free(huring_t *huring)
+{
+    if (!huring) {
+        return;
+    }
+
+    if (huring->sqes && huring->sqes != MAP_FAILED) {
+        munmap(huring->sqes, huring->sqes_size);
+    }
+    if (huring->cq_ring && huring->cq_ring != MAP_FAILED && huring->cq_ring != huring->sq_ring) {
+        munmap(huring->cq_ring, huring->cq_ring_size);
+    }
+    if (huring->sq_ring && huring->sq_ring != MAP_FAILED) {
+        munmap(huring->sq_ring, huring->sq_ring_size);
+    }
+
+    close(huring->fd);
+    free(huring);
+}
+
+/**
+ * This function is used to register buffers with a ring. Reads
+ * and writes into a registered buffer name it by its index, and the
+ * kernel does not have to map it again for every one of them.
+ *
+ * @param huring The ring.
+ * @param buffers The buffers to register.
+ * @param count The number of buffers.
+ * @return 0 on success or error code
+ */
+int
+huring_register(huring_t *huring, const struct iovec *buffers, uint32_t count)
+{
+    if (!huring || !buffers || !count) {
+        return URING_ERROR_ARGUMENT;
+    }
+
+    if (syscall(__NR_io_uring_register, huring->fd, IORING_REGISTER_BUFFERS, buffers, count) < 0) {
+        return URING_ERROR_UNSUPPORTED;
+    }
+
+    huring->registered = 1;
+    return 0;
+}
+
+/**
+ * This function fills in the next submission entry of a ring.
+ * This function is not presented as an interface function.
+ *
+ * @param huring The ring.
+ * @param opcode The operation.
+ * @param fd The file.
+ * @param buffer The buffer.
+ * @param length The number of bytes.
+ * @param offset The offset in the file.
+ * @param index The index of the registered buffer or URING_UNREGISTERED.
+ * @param user_data What the completion hands back.
+ * @return 0 on success or error code
+ */
+static int
+_queue(huring_t *huring, uint8_t opcode, int fd, const void *buffer, uint32_t length,
+       uint64_t offset, int index, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe;
+    uint32_t tail, slot;
+
+    if (huring->queued + huring->in_flight >= huring->sq_entries) {
+        return URING_ERROR_FULL;
+    }
+
+    tail = huring->tail;
+    slot = tail & huring->sq_mask;
+    sqe = (struct io_uring_sqe*)huring->sqes + slot;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    if (index != URING_UNREGISTERED) {
+        sqe->buf_index = index;
+    }
+
+    huring->sq_array[slot] = slot;
+    huring->tail = tail + 1;
+    huring->queued += 1;
+    return 0;
+}
+
+/**
+ * This function enters the kernel to hand it every queued entry
+ * and, if asked to, to wait for a completion. The release of the
+ * tail makes the entries visible to the kernel. Only the entries
+ * the kernel took are in flight, and the rest stay queued, already
+ * past the tail, for the next time. This function is not presented
+ * as an interface function.
+ *
+ * @param huring The ring.
+ * @param submit The number of entries to hand to the kernel.
+ * @param wait Whether to wait for a completion.
+ * @return The number of entries the kernel took or -errno
+ */
+static int
+_enter(huring_t *huring, uint32_t submit, int wait)
+{
+    int submitted;
+
+    __atomic_store_n(huring->sq_tail, huring->tail, __ATOMIC_RELEASE);
+    do {
+        submitted = syscall(__NR_io_uring_enter, huring->fd, submit, wait ? 1 : 0,
+                            wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted < 0) {
+        return -errno;
+    }
+
+    huring->queued -= submitted;
+    huring->in_flight += submitted;
+    return submitted;
+}
+
+/**
+ * This function is used to queue a read of a file at an offset
+ * into a buffer. The read is only started once it is submitted.
+ *
+ * @param huring The ring.
+ * @param fd The file to read.
+ * @param buffer The buffer to read into.
+ * @param length The number of bytes to read.
+ * @param offset The offset in the file.
+ * @param index The index of the registered buffer or URING_UNREGISTERED.
+ * @param user_data What the completion hands back.
+ * @return 0 on success or error code
+ */
+int
+huring_read(huring_t *huring, int fd, void *buffer, uint32_t length, uint64_t offset,
+            int index, uint64_t user_data)
+{
+    if (!huring || !buffer) {
+        return URING_ERROR_ARGUMENT;
+    }
+
+    return _queue(huring, (index == URING_UNREGISTERED) ? IORING_OP_READ : IORING_OP_READ_FIXED,
+                  fd, buffer, length, offset, index, user_data);
+}
+
+/**
+ * This function is used to queue a write of a buffer into a file
+ * at an offset. The write is only started once it is submitted.
+ *
+ * @param huring The ring.
+ * @param fd The file to write.
+ * @param buffer The buffer to write from.
+ * @param length The number of bytes to write.
+ * @param offset The offset in the file.
+ * @param index The index of the registered buffer or URING_UNREGISTERED.
+ * @param user_data What the completion hands back.
+ * @return 0 on success or error code
+ */
+int
+huring_write(huring_t *huring, int fd, const void *buffer, uint32_t length, uint64_t offset,
+             int index, uint64_t user_data)
+{
+    if (!huring || !buffer) {
+        return URING_ERROR_ARGUMENT;
+    }
+
+    return _queue(huring, (index == URING_UNREGISTERED) ? IORING_OP_WRITE : IORING_OP_WRITE_FIXED,
+                  fd, buffer, length, offset, index, user_data);
+}
+
+/**
+ * This function is used to hand every queued entry to the kernel
+ * in a single system call. The kernel may take only some of them,
+ * or none while it is short of room until completions are reaped,
+ * and whatever it does not take stays queued. Waiting for a
+ * completion hands the queued entries to the kernel again.
+ *
+ * @param huring The ring.
+ * @return The number of entries submitted or error code
+ */
+int
+huring_submit(huring_t *huring)
+{
+    int submitted;
+
+    if (!huring) {
+        return URING_ERROR_ARGUMENT;
+    } else if (!huring->queued) {
+        return 0;
+    }
+
+    submitted = _enter(huring, huring->queued, 0);
+    if (submitted == -EAGAIN || submitted == -EBUSY) {
+        return 0;
+    }
+    return submitted;
+}
+
+/**
+ * This function is used to take the next completion off a ring.
+ * When asked to wait, the kernel is entered until one completes,
+ * and is handed whatever is still queued on the way. While the
+ * kernel is short of room for the queued entries, only what is in
+ * flight is waited on, and with nothing in flight they are handed
+ * to it again until it takes them.
+ *
+ * @param huring The ring.
+ * @param user_data Where to put what the entry was submitted with.
+ * @param result Where to put the result, bytes or a negative errno.
+ * @param wait Whether to wait for a completion.
+ * @return 1 if a completion was taken, 0 if there was none or error code
+ */
+int
+huring_reap(huring_t *huring, uint64_t *user_data, int32_t *result, int wait)
+{
+    struct io_uring_cqe *cqe;
+    uint32_t head;
+    int ret;
+
+    if (!huring || !user_data || !result) {
+        return URING_ERROR_ARGUMENT;
+    }
+
+    while (1) {
+        head = *huring->cq_head;
+        if (head != __atomic_load_n(huring->cq_tail, __ATOMIC_ACQUIRE)) {
+            break;
+        } else if (!wait || (!huring->in_flight && !huring->queued)) {
+            return 0;
+        }
+
+        ret = _enter(huring, huring->queued, 1);
+        if ((ret == -EAGAIN || ret == -EBUSY) && huring->in_flight) {
+            ret = _enter(huring, 0, 1);
+        } else if (ret == -EAGAIN || ret == -EBUSY) {
+            sched_yield();
+            ret = 0;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    cqe = (struct io_uring_cqe*)huring->cqes + (head & huring->cq_mask);
+    *user_data = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(huring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    huring->in_flight -= 1;
+    return 1;
+}
+
+#else
+
+/*
+ * Without io_uring a ring can never be set up, so none of the
+ * functions below are ever reached with a ring.
+ */
+huring_t*
+huring_create(uint32_t entries)
+{
+    (void)entries;
+    return NULL;
+}
+
+void
+huring_free(huring_t *huring)
+{
+    (void)huring;
+}
+
+int
+huring_register(huring_t *huring, const struct iovec *buffers, uint32_t count)
+{
+    (void)huring;
+    (void)buffers;
+    (void)count;
+    return URING_ERROR_UNSUPPORTED;
+}
+
+int
+huring_read(huring_t *huring, int fd, void *buffer, uint32_t length, uint64_t offset,
+            int index, uint64_t user_data)
+{
+    (void)huring;
+    (void)fd;
+    (void)buffer;
+    (void)length;
+    (void)offset;
+    (void)index;
+    (void)user_data;
+    return URING_ERROR_UNSUPPORTED;
+}
+
+int
+huring_write(huring_t *huring, int fd, const void *buffer, uint32_t length, uint64_t offset,
+             int index, uint64_t user_data)
+{
+    (void)huring;
+    (void)fd;
+    (void)buffer;
+    (void)length;
+    (void)offset;
+    (void)index;
+    (void)user_data;
+    return URING_ERROR_UNSUPPORTED;
+}
+
+int
+huring_submit(huring_t *huring)
+{
+    (void)huring;
+    return URING_ERROR_UNSUPPORTED;
+}
+
+int
+huring_reap(huring_t *huring, uint64_t *user_data, int32_t *result, int wait)
+{
+    (void)huring;
+    (void)user_data;
+    (void)result;
+    (void)wait;
+    return URING_ERROR_UNSUPPORTED;
+}
+
+#endif
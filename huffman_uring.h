@@ -0,0 +1,129 @@
+/*
+ * This file declares the interface for reading and writing files
+ * through io_uring. Reads and writes are queued on a ring shared
+ * with the kernel and many of them are in flight at once, into
+ * buffers which can be registered with the kernel up front. The
+ * ring is set up with the raw system calls, so no library is
+ * needed, and creating one fails on systems without io_uring so
+ * that callers can fall back to plain reads and writes.
+ *
+ * Author: Yash Gupta <ygupta@ucsc.edu>
+ * Copyright: Yash Gupta, UC Santa Cruz
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sched.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define URING_HAVE_IO_URING
+#endif
+#endif
+
+#ifndef HUFFMAN_URING_H
+#define HUFFMAN_URING_H
+
+/* Limits */
+#define URING_MAX_ENTRIES               (4096U)
+
+/* A buffer index which means the buffer was not registered */
+#define URING_UNREGISTERED              (-1)
+
+/* Uring Errors */
+#define URING_ERROR_ARGUMENT            (-1)
+#define URING_ERROR_FULL                (-2)
+#define URING_ERROR_UNSUPPORTED         (-3)
+
+typedef struct huffman_uring {
+    /* The file of the ring */
+    int fd;
+
+    /* These are the submission ring and its entries, shared with the kernel */
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    void *sqes;
+
+    /* These are the completion ring and its entries */
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    void *cqes;
+
+    /* These are the mappings of the rings */
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    /* This is the tail of the submission ring up to the last entry filled in */
+    uint32_t tail;
+
+    /*
+     * This is the number of entries filled in but not yet taken by
+     * the kernel, which may already be past the shared tail when the
+     * kernel took fewer of them than it was handed.
+     */
+    uint32_t queued;
+
+    /* This is the number of entries submitted but not yet reaped */
+    uint32_t in_flight;
+
+    /* This is set once buffers are registered */
+    uint8_t registered;
+} huring_t;
+
+/**
+ * This function is used to set up a new ring with room for a
+ * number of entries. It returns NULL where io_uring is missing.
+ */
+huring_t* huring_create(uint32_t);
+
+/**
+ * This function is used to tear down a ring.
+ */
+void huring_free(huring_t*);
+
+/**
+ * This function is used to register buffers with a ring so
+ * that they are mapped by the kernel once instead of on every
+ * read and write.
+ */
+int huring_register(huring_t*, const struct iovec*, uint32_t);
+
+/**
+ * This function is used to queue a read of a file at an offset
+ * into a buffer.
+ */
+int huring_read(huring_t*, int, void*, uint32_t, uint64_t, int, uint64_t);
+
+/**
+ * This function is used to queue a write of a buffer into a
+ * file at an offset.
+ */
+int huring_write(huring_t*, int, const void*, uint32_t, uint64_t, int, uint64_t);
+
+/**
+ * This function is used to hand every queued entry to the
+ * kernel, returning how many of them it took.
+ */
+int huring_submit(huring_t*);
+
+/**
+ * This function is used to take the next completion off a
+ * ring, waiting for one if asked to.
+ */
+int huring_reap(huring_t*, uint64_t*, int32_t*, int);
+
+#endif